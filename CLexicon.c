@@ -5,286 +5,4908 @@
  * retrieval of strings (char*). It functions the same as a set but is
  * internally optimized to process strings efficiently. The internal
  * structure of the CLexicon is a tree of "LexNodes" in which each LexNode
- * has 26 children, one for each letter of the English alphabet.
+ * has one child for every byte that follows its prefix in some word. Letters
+ * are folded to lower case; every other byte except '\0' is stored as it is,
+ * so digits, punctuation and UTF-8 text are words like any other.
+ *
+ * LexNodes live in slabs owned by the CLexicon and refer to each other by
+ * 32-bit index rather than by pointer. Each node stores a bitmask of the
+ * letters it has children for and the number of words beneath it, followed by
+ * only those children, so a node with one child costs 12 bytes instead of
+ * reserving room for all 26. The few nodes with children for other bytes add
+ * a short list of them, or a bitmap of all 256 once the list would grow long.
+ * Nodes on the path of a word given a weight also carry the weights that
+ * clex_top_k ranks completions by.
+ *
+ * A lexicon that will no longer change can be frozen, which merges identical
+ * subtrees into a directed acyclic word graph packed into a single array.
+ * Because nodes refer to each other by index, that array can be written to a
+ * file as-is and later mapped straight back into memory.
  *
  * Modeled after the "Lexicon" class from the Stanford C++ Libraries.
  */
 
-#include "CLexicon.h"   //includes <stdbool.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include <ctype.h>
+#include "CLexicon.h"   //includes <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define ALPHA_SIZE 26
+#define MAX_WORD_LEN CLEX_MAX_WORD_LEN
+#define SLAB_SHIFT 16
+#define SLAB_WORDS (1 << SLAB_SHIFT)
+#define SLAB_MASK (SLAB_WORDS - 1)
+#define NUM_SYMBOLS 256
+#define MAX_CHILDREN (NUM_SYMBOLS - 1 - ALPHA_SIZE)     //every byte but '\0' and the capital letters
+#define LETTER_MASK 0x03FFFFFFu
+#define NODE_WORD (1u << ALPHA_SIZE)
+#define NODE_WEIGHTED (1u << (ALPHA_SIZE + 1))
+#define EXTRA_SHIFT (ALPHA_SIZE + 2)
+#define EXTRA_MASK (15u << EXTRA_SHIFT)
+#define MAX_EXTRA_KEYS 4
+#define EXTRA_BITMAP 15u            //extras field of a node whose other bytes are in a bitmap
+#define EXTRA_CHAIN 14u             //extras field of a frozen node standing for a chain of nodes
+#define MIN_CHAIN_LEN 2
+#define BITMAP_WORDS (1 + NUM_SYMBOLS / 32)
+#define MAX_NODE_WORDS (4 + BITMAP_WORDS + MAX_CHILDREN)
+#define MIN_REGISTER_BUCKETS 1024
+#define LOAD_BUFFER_SIZE (1 << 20)
+#define BATCH_LANES 8
+#define READER_SLOTS 64
+#define MAX_OLD_TABLES 32
+#define RANKED_STACK_ENTRIES 128
+#define MAX_PATTERN_SYMBOLS 127
+#define MAX_BUILD_THREADS 64
+#define JUMP_ENTRIES (ALPHA_SIZE * ALPHA_SIZE)
+#define POOL_CHUNK_WORDS 1024       //words a CLexPool worker looks up per chunk it takes
+#define LAYOUT_TOP_WORDS 65536      //words of an image laid out breadth first (see layout_image)
+#define LAYOUT_WAITING UINT32_MAX   //place of a node on layout_image's stack
+#define NUL_TERMINATED SIZE_MAX     //length argument meaning "read up to the '\0'"
+#define IMAGE_MAGIC 0x58454c43u     //"CLEX" when read back as bytes on a little-endian machine
+#define IMAGE_VERSION 5
+#define IMAGE_BYTE_ORDER 0x01020304u
+
+//With CLEX_COUNTERS defined, COUNT adds n to one of the lexicon's lookup counters (see clex_stats).
+#ifdef CLEX_COUNTERS
+#define COUNT(lex, counter, n) __atomic_fetch_add(&(lex)->counters[counter], (n), __ATOMIC_RELAXED)
+#else
+#define COUNT(lex, counter, n) ((void)0)
+#endif
+enum { COUNT_LOOKUPS, COUNT_HITS, COUNT_MISSES, COUNT_NODES, NUM_COUNTERS };
+
+
+            /* * * Struct Definitions * * */
+
+
+/* Struct: LexNode
+ * ---------------
+ * A node is a variable-length record of 32-bit words in the lexicon's slabs, identified by
+ * the index of its first word. Bits 0-25 of info say which letters have a child, bit 26
+ * is the word flag and bit 27 marks a WeightedNode. count is the number of words in the node's
+ * subtree, the node's own word included. The children array holds one index per child, in byte
+ * order, so in a node with only letter children the child for letter c sits at position
+ * popcount(info & ((1 << c) - 1)).
+ * Children for bytes other than letters are recorded by the extras field, bits 28-31 of info.
+ * A field of 1-4 means that many such bytes, packed in ascending order into one word between
+ * the header and the children. EXTRA_BITMAP means more: a word counting them and a 256-bit
+ * bitmap of them take that place instead. Nodes with only letter children, the usual kind, have
+ * a field of 0 and nothing in between.
+ * In a frozen image, a node with one child may also stand for the chain of single-child nodes
+ * below it that have no word of their own (see compress_image). Such a chain node has the field
+ * EXTRA_CHAIN, and bits 0-25 hold the length of its label instead of letters: the bytes along
+ * the chain, packed four to a word between the header and its one child, the node the chain ends
+ * at. The header is that of the chain's first node; the nodes inside it are implied.
+ * Index 0 is reserved and never handed out, so a child index of 0 means "no child".
+ * Nodes change size when they gain or lose children, so they are reallocated and their
+ * parent updated rather than edited in place; the root's index is therefore not fixed.
+ */
+struct LexNode {
+    uint32_t info;
+    uint32_t count;
+    uint32_t children[];
+};
+
+/* Struct: WeightedNode
+ * --------------------
+ * The layout of a LexNode whose info has NODE_WEIGHTED set: two more words come before the
+ * children. weight is the weight of the node's own word, and best is the greatest weight of
+ * any word in its subtree, which lets clex_top_k skip subtrees that cannot rank. Only nodes on
+ * the path of a word given a weight are weighted, so a lexicon that never uses weights keeps
+ * the smaller layout throughout; every ancestor of a weighted node is itself weighted.
+ */
+typedef struct {
+    uint32_t info;
+    uint32_t count;
+    uint32_t weight;
+    uint32_t best;
+    uint32_t children[];
+} WeightedNode;
+
+/* Struct: ReaderSlot
+ * ------------------
+ * In concurrent mode, counts the lookups in progress on threads assigned to this slot, split by
+ * the parity of the epoch they started in. Each slot has a cache line to itself so that readers
+ * on different cores do not contend.
+ */
+typedef struct {
+    uint32_t active[2];
+    char padding[64 - 2 * sizeof(uint32_t)];
+} ReaderSlot;
+
+/* Struct: RetireList
+ * ------------------
+ * In concurrent mode, nodes a writer has unlinked but that a reader may still be visiting.
+ * They go back to the freelists once every reader that could have seen them is done.
+ */
+typedef struct {
+    uint32_t* nodes;
+    uint32_t count;
+    uint32_t capacity;
+} RetireList;
+
+/* Struct: KeptBlock
+ * ------------------
+ * Storage a lexicon gave up while a snapshot could still be reading it: a slab, an image, or the
+ * mapping of an image from a file. It is freed, or unmapped, once no snapshot is left that may.
+ */
+typedef struct {
+    void* memory;
+    size_t size;
+    bool mapped;
+} KeptBlock;
+
+/* Struct: Cursor
+ * --------------
+ * A place in the tree that a reader has walked to: a node, or a point partway along the label
+ * of a chain node, which has no index of its own. offset is the number of label bytes walked
+ * so far, so a cursor with offset 0 is at the node itself.
+ */
+typedef struct {
+    uint32_t node;
+    uint32_t offset;
+} Cursor;
+
+struct CLexiconImplementation {
+    uint32_t root;
+    int wordcount;
+    uint32_t** slabs;       //slab i holds the words with indices [i * SLAB_WORDS, (i+1) * SLAB_WORDS)
+    uint32_t nslabs;
+    uint32_t slab_capacity; //number of entries allocated in the slabs table
+    uint32_t slab_used;     //number of words handed out from the last slab
+    uint32_t freelists[MAX_NODE_WORDS + 1];    //released nodes by size in words, linked through info
+    uint32_t dead;          //roots of unlinked subtrees not yet released, linked through count
+    uint32_t* image;        //while frozen, the single block every slab points into; NULL otherwise
+    uint32_t image_words;
+    uint32_t image_capacity; //words allocated for the image, which may exceed image_words
+    void* mapping;          //when the image comes from clex_open_mapped, the mapped file; NULL otherwise
+    size_t mapping_size;
+    CLexAllocator allocator;
+    Cursor jump[JUMP_ENTRIES];  //places of the two-letter prefixes (see jump_place)
+    bool concurrent;        //set by clex_set_concurrent; the fields below are only used when it is
+    uint32_t epoch;
+    ReaderSlot* readers;    //READER_SLOTS slots, indexed by the reading thread's reader_slot
+    RetireList retired;     //nodes unlinked in the current epoch
+    RetireList waiting;     //nodes unlinked in the previous epoch
+    uint32_t** old_tables[MAX_OLD_TABLES];     //slabs tables replaced while readers may hold them
+    uint32_t old_capacities[MAX_OLD_TABLES];
+    uint32_t nold_tables;
+    pthread_mutex_t writer_lock;
+    CLexicon* reversed;     //with a suffix index (see clex_set_suffix_index), the words spelled backwards
+    CLexicon* snapshots;    //the newest live snapshot of the lexicon, or NULL
+    uint32_t shared_words;  //while there are snapshots, nodes at indices below this may be in one
+    bool is_snapshot;       //the fields below are only used by snapshots (see clex_snapshot)
+    CLexicon* origin;       //the lexicon the snapshot was taken of, NULL once it is deleted
+    CLexicon* older;        //the next older and newer live snapshots of the same origin
+    CLexicon* newer;
+    RetireList deferred;    //nodes the origin unlinked that this or an older snapshot may visit
+    KeptBlock* kept;        //storage the origin gave up that this or an older snapshot may visit
+    uint32_t nkept;
+    uint32_t kept_capacity;
+#ifdef CLEX_COUNTERS
+    uint64_t counters[NUM_COUNTERS];
+#endif
+};
+
+/* Struct: NodeRegister
+ * --------------------
+ * Used while freezing a lexicon. Nodes are written to a growing output array, and an open
+ * addressing hash table over that array finds an identical node that was already written,
+ * so that equal subtrees are stored once. Bucket value 0 marks an empty bucket.
+ */
+typedef struct {
+    uint32_t* words;
+    uint32_t nwords;
+    uint32_t capacity;
+    uint32_t* buckets;
+    uint32_t nbuckets;
+    uint32_t nentries;
+} NodeRegister;
+
+/* Struct: ChainCompressor
+ * ------------------------
+ * State of compress_image's pass over a finished register, words. parents[i] is the number of
+ * nodes with the node at i as a child, counted up to 2, and copies[i] is the index in out of
+ * that node's compressed copy once it has been written, or 0 before.
+ */
+typedef struct {
+    CLexicon* lex;
+    const uint32_t* words;
+    uint8_t* parents;
+    uint32_t* copies;
+    NodeRegister out;
+} ChainCompressor;
+
+/* Struct: WordLoader
+ * ------------------
+ * State kept by clex_add_from_file between lines. word holds the symbols (see fold_case) of the
+ * last word added, and slots[d] points at the slot holding the index of the node reached after
+ * its first d bytes (slots[0] is &lex->root). Successive words only rewrite these from the
+ * first byte at which they differ, so the next word can resume below their common prefix.
+ * pending[d] is the number of new words not yet counted in the node at slots[d]; it is added
+ * to the node when the loader leaves that node rather than once per word.
+ */
+typedef struct {
+    CLexicon* lex;
+    int wordlen;
+    uint8_t word[MAX_WORD_LEN];
+    uint32_t* slots[MAX_WORD_LEN + 1];
+    uint32_t pending[MAX_WORD_LEN + 1];
+} WordLoader;
+
+/* Struct: WordSlice
+ * -----------------
+ * A run of whole lines of a word file held in memory, from start up to end, whose words all
+ * begin with the same symbol. Every line but the last of the file ends in its '\n'.
+ */
+typedef struct {
+    size_t start;
+    size_t end;
+    uint8_t symbol;
+} WordSlice;
+
+/* Struct: ShardBuilder
+ * --------------------
+ * State of one thread of clex_add_from_file_parallel. It loads the slices of the file whose
+ * symbol has been given to its shard (see shard_of) into a private lexicon through loader, so
+ * that no two threads ever share a node, an arena, a lock or a byte of the file.
+ */
+typedef struct {
+    uint8_t* file;
+    const WordSlice* slices;
+    size_t nslices;
+    const uint8_t* shard_of;
+    int shard;
+    bool successful;
+    WordLoader loader;
+} ShardBuilder;
+
+/* Struct: SetBuilder
+ * ------------------
+ * State of one thread of clex_union, clex_intersect and clex_difference, which combine a and b
+ * as op says (one of the SET_ constants) into out. A thread builds only the root children whose
+ * symbol has been given to its shard, and shard 0 the empty word too, so that threads building
+ * private lexicons share nothing.
+ */
+enum { SET_UNION, SET_INTERSECT, SET_DIFFERENCE };
+
+typedef struct {
+    CLexicon* out;
+    CLexicon* a;
+    CLexicon* b;
+    int op;
+    const uint8_t* shard_of;
+    int shard;
+    uint32_t root;
+} SetBuilder;
+
+/* Struct: Graft
+ * -------------
+ * A private lexicon built by one thread of clex_add_from_file_parallel or combine_lexicons, whose
+ * slabs graft_shards appends to those of the lexicon the threads build for. The children of root
+ * hold the shard's words.
+ */
+typedef struct {
+    CLexicon* shard;
+    uint32_t root;
+    uint32_t delta;     //what relocate_graft adds to the shard's indices to make them the lexicon's
+} Graft;
+
+/* Struct: OpenNode
+ * ----------------
+ * A node of a DawgBuilder still open to change, kept as a list of its children's symbols and
+ * indices in symbol order until it is written out as a LexNode. info holds only the word flag.
+ */
+typedef struct {
+    uint32_t info;
+    int nchildren;
+    uint8_t symbols[MAX_CHILDREN];
+    uint32_t children[MAX_CHILDREN];
+} OpenNode;
+
+/* Struct: DawgBuilder
+ * -------------------
+ * State kept by clex_add_from_sorted_file between lines. Only the nodes along the last word
+ * are still open to change: open[d] is the node reached after its first d bytes, with its last
+ * child not yet filled in. Every other node has already been written to reg, deduplicated
+ * against the nodes written before it.
+ */
+typedef struct {
+    CLexicon* lex;
+    NodeRegister reg;
+    int wordlen;
+    uint8_t word[MAX_WORD_LEN];
+    OpenNode open[MAX_WORD_LEN + 1];
+} DawgBuilder;
+
+/* Struct: BatchLane
+ * -----------------
+ * One lookup in flight in clex_contains_batch_helper: the rest of the word still to be walked,
+ * the node reached so far (already prefetched) and how far along its label if it is a chain
+ * node, and where in the batch the word came from.
+ */
+typedef struct {
+    const char* rest;
+    const LexNode* node;
+    uint32_t offset;
+    size_t word;
+} BatchLane;
+
+/* Struct: PoolWorker
+ * ------------------
+ * One thread of a CLexPool. range holds the chunks of the current job it has yet to look up,
+ * the first in its low 32 bits and one past the last in its high 32 bits. The worker takes
+ * chunks from the front and other workers steal from the back, both by compare-and-swap, so
+ * taking work never locks. Each worker has a cache line to itself.
+ */
+typedef struct {
+    uint64_t range;
+    pthread_t thread;
+    CLexPool* pool;
+    int index;
+    char padding[64 - sizeof(uint64_t) - sizeof(pthread_t) - sizeof(CLexPool*) - sizeof(int)];
+} PoolWorker;
+
+struct CLexPoolImplementation {
+    PoolWorker* workers;
+    int nthreads;               //workers actually started, which may be 0
+    int capacity;               //workers allocated
+    CLexAllocator allocator;
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;   //signalled when a job is submitted or the pool is deleted
+    pthread_cond_t job_done;    //signalled when the last worker finishes a job
+    uint64_t generation;        //number of jobs submitted so far
+    int busy;                   //workers still working on the current job
+    bool stopping;
+    CLexicon* lex;              //the current job: lookups of words[0, n) into out
+    const char** words;
+    size_t n;
+    bool* out;
+};
+
+/* Struct: RankedEntry
+ * -------------------
+ * One candidate in clex_top_k's queue: either a word ready to be returned, ranked by its own
+ * weight, or the part of a node's subtree still to be searched, ranked by the best weight in it.
+ * That part is the children whose letters are set in letters, the node's own word if NODE_WORD
+ * is set there too, and its children for other bytes if the EXTRA_MASK bits are. For a place
+ * offset bytes along a chain node, the EXTRA_MASK bits stand for its one child instead. word
+ * holds the len bytes leading to the node.
+ */
+typedef struct {
+    uint32_t weight;
+    uint32_t node;
+    uint32_t letters;
+    bool is_word;
+    uint8_t offset;
+    uint8_t len;
+    char word[MAX_WORD_LEN];
+} RankedEntry;
+
+/* Struct: FuzzySearch
+ * --------------------
+ * State of clex_fuzzy_search's walk, kept as an explicit stack like a CLexIterator's. rows[d]
+ * is the row of the edit distance table for the first d bytes of word: rows[d][j] is the
+ * number of edits between them and the first j bytes of the query. next[d] is the smallest
+ * symbol not yet tried below nodes[d].
+ */
+typedef struct {
+    uint8_t query[MAX_WORD_LEN];
+    int querylen;
+    int max_edits;
+    Cursor nodes[MAX_WORD_LEN + 1];
+    uint16_t next[MAX_WORD_LEN + 1];
+    uint8_t rows[MAX_WORD_LEN + 1][MAX_WORD_LEN + 1];
+    char word[MAX_WORD_LEN + 1];
+} FuzzySearch;
+
+/* Type: PatternStates
+ * -------------------
+ * A set of positions in a compiled pattern (see PatternMatcher), one bit per position.
+ */
+typedef unsigned __int128 PatternStates;
+
+/* Struct: PatternMatcher
+ * ----------------------
+ * A pattern for clex_match_pattern compiled into a bit-parallel automaton. A state set has bit i
+ * set when the bytes walked so far can match the first i symbols of the pattern. matches[c] has
+ * bit i set when symbol i is the byte c or a '?', stars has bit i set when symbol i is a '*',
+ * and final is the bit for the whole pattern. Runs of '*' are merged into one when compiling.
+ */
+typedef struct {
+    PatternStates matches[NUM_SYMBOLS];
+    PatternStates stars;
+    PatternStates final;
+} PatternMatcher;
+
+/* Struct: RankedQueue
+ * -------------------
+ * A binary heap of RankedEntries with the best-ranked entry on top (see ranked_before). It
+ * starts out in the initial array on the caller's stack and only moves to memory from the
+ * lexicon's allocator if the search outgrows it.
+ */
+typedef struct {
+    RankedEntry* entries;
+    size_t count;
+    size_t capacity;
+    RankedEntry initial[RANKED_STACK_ENTRIES];
+} RankedQueue;
+
+/* Struct: SuffixSearch
+ * ---------------------
+ * State of clex_contains_suffix and clex_visit_suffix. With a suffix index, words come from it
+ * spelled backwards and are turned around into word; otherwise every word of the lexicon comes
+ * by, and only those ending in the len symbols of suffix are passed on. found is set once any is.
+ */
+typedef struct {
+    const char* suffix;
+    size_t len;
+    CLexVisitor visit;
+    void* context;
+    bool found;
+    char word[MAX_WORD_LEN + 1];
+} SuffixSearch;
+
+/* Struct: ScanState
+ * ------------------
+ * One state of a CLexScanner: a place in the tree, depth bytes below the root. Its edges, the
+ * children of that place, are entries first up to the next state's first of the scanner's symbols
+ * and targets, in symbol order. fail is the state for the longest proper suffix of its bytes that
+ * is also a place in the tree, and output the nearest state along the fail links whose bytes are a
+ * word, or 0 if there is none.
+ */
+typedef struct {
+    uint32_t first;
+    uint32_t fail;
+    uint32_t output;
+    uint16_t depth;
+    uint16_t is_word;
+} ScanState;
+
+struct CLexScannerImplementation {
+    CLexAllocator allocator;
+    uint32_t nstates;
+    uint32_t capacity;          //states allocated, which may exceed nstates
+    ScanState* states;          //capacity + 1 entries; the one after the last state holds only first
+    uint8_t* symbols;
+    uint32_t* targets;
+    uint32_t root_next[NUM_SYMBOLS];    //the root's edges for every byte, 0 where it has none
+};
+
+/* Struct: CLexInfixImplementation
+ * -------------------------------
+ * A suffix array over the words of a lexicon. text holds the words in order, each followed by a
+ * '\0', and starts[i] is where word i begins in it. suffixes holds the offset of every suffix
+ * of a word that is not empty, sorted byte by byte up to the end of its word, so the suffixes
+ * beginning with any given bytes, and thereby the words containing them, are next to each other.
+ */
+struct CLexInfixImplementation {
+    CLexAllocator allocator;
+    uint8_t* text;
+    uint32_t text_bytes;
+    uint32_t text_capacity;
+    uint32_t* starts;
+    uint32_t nwords;
+    uint32_t* suffixes;
+    uint32_t nsuffixes;
+};
+
+/* Type: WordHandler
+ * -----------------
+ * Called by read_word_file with each word of a file, as symbols (see fold_case).
+ * Returns false to stop reading and report failure.
+ */
+typedef bool (*WordHandler)(void* state, const uint8_t* word, int wordlen);
+
+/* Struct: ImageHeader
+ * -------------------
+ * The start of a file written by clex_save_binary. It is followed directly by the
+ * nwords words of a frozen image, in the byte order of the machine that wrote it.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t wordcount;
+    uint32_t root;
+    uint32_t nwords;
+} ImageHeader;
+
+
+
+            /* * * Local Helper Functions * * */
+
+
+/* Table: fold_case
+ * ----------------
+ * Maps every byte to the symbol it is stored as: capital letters to lower case, and every
+ * other byte to itself. Only '\0' maps to 0, so one lookup both folds a byte and finds the end
+ * of a word. Bytes of UTF-8 text are left alone, so only ASCII letters are case-insensitive.
+ */
+#define BYTE(c) [c] = c
+#define CAPITAL(c) [c - 'a' + 'A'] = c
+static const uint8_t fold_case[256] = {
+    #define ROW(r) BYTE(r), BYTE(r + 1), BYTE(r + 2), BYTE(r + 3), BYTE(r + 4), BYTE(r + 5), BYTE(r + 6), BYTE(r + 7)
+    ROW(0), ROW(8), ROW(16), ROW(24), ROW(32), ROW(40), ROW(48), ROW(56),
+    ROW(64), ROW(72), ROW(80), ROW(88), ROW(96), ROW(104), ROW(112), ROW(120),
+    ROW(128), ROW(136), ROW(144), ROW(152), ROW(160), ROW(168), ROW(176), ROW(184),
+    ROW(192), ROW(200), ROW(208), ROW(216), ROW(224), ROW(232), ROW(240), ROW(248),
+    #undef ROW
+    CAPITAL('a'), CAPITAL('b'), CAPITAL('c'), CAPITAL('d'), CAPITAL('e'), CAPITAL('f'), CAPITAL('g'),
+    CAPITAL('h'), CAPITAL('i'), CAPITAL('j'), CAPITAL('k'), CAPITAL('l'), CAPITAL('m'), CAPITAL('n'),
+    CAPITAL('o'), CAPITAL('p'), CAPITAL('q'), CAPITAL('r'), CAPITAL('s'), CAPITAL('t'), CAPITAL('u'),
+    CAPITAL('v'), CAPITAL('w'), CAPITAL('x'), CAPITAL('y'), CAPITAL('z')
+};
+#undef CAPITAL
+#undef BYTE
+
+/* Functions: default_alloc, default_free
+ * --------------------------------------
+ * The allocator used when the client does not supply one. Simply wraps malloc and free.
+ */
+static void* default_alloc(void* context, size_t size) {
+    return malloc(size);
+}
+
+static void default_free(void* context, void* ptr, size_t size) {
+    free(ptr);
+}
+
+static const CLexAllocator default_allocator = { default_alloc, default_free, NULL };
+
+/* Function: node_at
+ * -----------------
+ * Translates a node index into a pointer to the node. Slabs never move once allocated,
+ * so the pointer stays valid until the node is reallocated or the lexicon is cleared.
+ * The slabs table is reloaded on every call, because a concurrent writer may replace it
+ * with a larger one holding the slab of a node the reader has just reached.
+ */
+static inline LexNode* node_at(CLexicon* lex, uint32_t index) {
+    uint32_t** slabs = __atomic_load_n(&lex->slabs, __ATOMIC_ACQUIRE);
+    return (LexNode*)&slabs[index >> SLAB_SHIFT][index & SLAB_MASK];
+}
+
+/* Function: load_slot
+ * -------------------
+ * Reads a node index from a child slot or the root. Paired with publish, so that a node a
+ * reader finds through a slot is seen fully written.
+ */
+static inline uint32_t load_slot(const uint32_t* slot) {
+    return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+}
+
+/* Function: publish
+ * -----------------
+ * Stores a node index into a child slot or the root. Every change readers can see is made
+ * either this way, after the node has been written in full, or by set_info.
+ */
+static inline void publish(uint32_t* slot, uint32_t index) {
+    __atomic_store_n(slot, index, __ATOMIC_RELEASE);
+}
+
+/* Function: load_info
+ * -------------------
+ * Reads the info word of a node that a concurrent writer may be changing (see set_info).
+ */
+static inline uint32_t load_info(const LexNode* node) {
+    return __atomic_load_n(&node->info, __ATOMIC_RELAXED);
+}
+
+/* Function: load_wordcount
+ * ------------------------
+ * Reads the wordcount, which a concurrent writer may be changing (see add_words).
+ */
+static inline int load_wordcount(CLexicon* lex) {
+    return __atomic_load_n(&lex->wordcount, __ATOMIC_RELAXED);
+}
+
+/* Function: set_info
+ * ------------------
+ * Changes the info word of a node that readers may be visiting. Only the word flag is ever
+ * changed this way; a node's letters are fixed once it has been published.
+ */
+static inline void set_info(LexNode* node, uint32_t info) {
+    __atomic_store_n(&node->info, info, __ATOMIC_RELAXED);
+}
+
+/* Function: load_count
+ * --------------------
+ * Reads the subtree word count of a node that a concurrent writer may be changing.
+ */
+static inline uint32_t load_count(const LexNode* node) {
+    return __atomic_load_n(&node->count, __ATOMIC_RELAXED);
+}
+
+/* Function: add_count
+ * -------------------
+ * Adjusts the subtree word count of a node that readers may be visiting.
+ */
+static inline void add_count(LexNode* node, int delta) {
+    __atomic_store_n(&node->count, node->count + delta, __ATOMIC_RELAXED);
+}
+
+/* Function: add_words
+ * -------------------
+ * Adjusts the wordcount. Writers are serialized, so no atomic read-modify-write is needed;
+ * the store is atomic only so that clex_wordcount never reads a torn value.
+ */
+static inline void add_words(CLexicon* lex, int delta) {
+    __atomic_store_n(&lex->wordcount, lex->wordcount + delta, __ATOMIC_RELAXED);
+}
+
+/* Function: header_words
+ * ----------------------
+ * Returns the number of 32-bit words that come before the children of a node with the given
+ * info word: two, or four for a WeightedNode.
+ */
+static inline uint32_t header_words(uint32_t info) {
+    return (info & NODE_WEIGHTED) ? 4 : 2;
+}
+
+/* Functions: is_chain, chain_length
+ * ----------------------------------
+ * Tell whether a node with the given info word is a chain node (see LexNode), and if it is,
+ * how many bytes its label holds.
+ */
+static inline bool is_chain(uint32_t info) {
+    return (info & EXTRA_MASK) == EXTRA_CHAIN << EXTRA_SHIFT;
+}
+
+static inline uint32_t chain_length(uint32_t info) {
+    return info & LETTER_MASK;
+}
+
+/* Function: extra_words
+ * ---------------------
+ * Returns the number of 32-bit words between the header and the children of a node with the
+ * given info word, which record its children for bytes other than letters, or hold the label
+ * of a chain node (see LexNode).
+ */
+static inline uint32_t extra_words(uint32_t info) {
+    uint32_t extras = info >> EXTRA_SHIFT;
+    if(extras == 0) return 0;
+    if(extras == EXTRA_CHAIN) return (chain_length(info) + 3) / 4;
+    return extras == EXTRA_BITMAP ? BITMAP_WORDS : 1;
+}
+
+/* Function: extra_slots
+ * ---------------------
+ * Returns the words of a node that record its children for bytes other than letters.
+ */
+static inline const uint32_t* extra_slots(const LexNode* node, uint32_t info) {
+    return (const uint32_t*)node + header_words(info);
+}
+
+/* Function: child_slots
+ * ---------------------
+ * Returns the children array of a node with the given info word, wherever its layout puts it.
+ */
+static inline uint32_t* child_slots(const LexNode* node, uint32_t info) {
+    return (uint32_t*)node + header_words(info) + extra_words(info);
+}
+
+/* Function: child_count
+ * ---------------------
+ * Returns the number of children of a node with the given info word.
+ */
+static inline int child_count(const LexNode* node, uint32_t info) {
+    uint32_t extras = info >> EXTRA_SHIFT;
+    if(extras == EXTRA_CHAIN) return 1;
+    int count = __builtin_popcount(info & LETTER_MASK);
+    if(extras == EXTRA_BITMAP) return count + extra_slots(node, info)[0];
+    return count + extras;
+}
+
+/* Function: node_words
+ * --------------------
+ * Returns the size in 32-bit words of a node.
+ */
+static inline uint32_t node_words(const LexNode* node) {
+    uint32_t info = node->info;
+    return header_words(info) + extra_words(info) + child_count(node, info);
+}
+
+/* Function: extras_below
+ * ----------------------
+ * Returns the number of a node's children for bytes other than letters whose symbol is less than
+ * sym. The node must have some.
+ */
+static inline int extras_below(const LexNode* node, uint32_t info, int sym) {
+    const uint32_t* extra = extra_slots(node, info);
+    uint32_t extras = info >> EXTRA_SHIFT;
+    int below = 0;
+    if(extras != EXTRA_BITMAP) {
+        while(below < (int)extras && (int)((extra[0] >> (8 * below)) & 0xFF) < sym) below++;
+        return below;
+    }
+    const uint32_t* bitmap = extra + 1;
+    for(int w = 0; w < sym >> 5; w++) below += __builtin_popcount(bitmap[w]);
+    if(sym & 31) below += __builtin_popcount(bitmap[sym >> 5] & ((1u << (sym & 31)) - 1));
+    return below;
+}
+
+/* Function: has_extra
+ * -------------------
+ * Returns true if a node has a child for sym, a byte other than a letter.
+ */
+static inline bool has_extra(const LexNode* node, uint32_t info, int sym) {
+    const uint32_t* extra = extra_slots(node, info);
+    uint32_t extras = info >> EXTRA_SHIFT;
+    if(extras == EXTRA_BITMAP) return (extra[1 + (sym >> 5)] >> (sym & 31)) & 1;
+    for(uint32_t i = 0; i < extras; i++) {
+        if(((extra[0] >> (8 * i)) & 0xFF) == (uint32_t)sym) return true;
+    }
+    return false;
+}
+
+/* Function: next_extra
+ * --------------------
+ * Returns the smallest symbol of at least sym among a node's children for bytes other than
+ * letters, or NUM_SYMBOLS if there is none.
+ */
+static inline int next_extra(const LexNode* node, uint32_t info, int sym) {
+    const uint32_t* extra = extra_slots(node, info);
+    uint32_t extras = info >> EXTRA_SHIFT;
+    if(extras != EXTRA_BITMAP) {
+        for(uint32_t i = 0; i < extras; i++) {
+            int key = (extra[0] >> (8 * i)) & 0xFF;
+            if(key >= sym) return key;
+        }
+        return NUM_SYMBOLS;
+    }
+    const uint32_t* bitmap = extra + 1;
+    for(int w = sym >> 5; w < NUM_SYMBOLS / 32; w++) {
+        uint32_t bits = bitmap[w];
+        if(w == sym >> 5) bits &= ~0u << (sym & 31);
+        if(bits != 0) return 32 * w + __builtin_ctz(bits);
+    }
+    return NUM_SYMBOLS;
+}
+
+/* Function: symbol_rank
+ * ---------------------
+ * Returns the position in the children array of a node's child for sym, or of where that
+ * child would go: the number of its children whose symbols are less than sym.
+ */
+static inline int symbol_rank(const LexNode* node, uint32_t info, int sym) {
+    uint32_t c = sym - 'a';
+    int rank;
+    if(sym <= 'a') rank = 0;
+    else if(c >= ALPHA_SIZE) rank = __builtin_popcount(info & LETTER_MASK);
+    else rank = __builtin_popcount(info & ((1u << c) - 1));
+    if(info & EXTRA_MASK) rank += extras_below(node, info, sym);
+    return rank;
+}
+
+/* Function: find_slot
+ * -------------------
+ * Returns the slot holding node's child for symbol sym, or NULL if there is none.
+ */
+static inline uint32_t* find_slot(const LexNode* node, uint32_t info, int sym) {
+    uint32_t c = sym - 'a';
+    if(c < ALPHA_SIZE) {
+        if(!(info & (1u << c))) return NULL;
+    } else if(!(info & EXTRA_MASK) || !has_extra(node, info, sym)) {
+        return NULL;
+    }
+    return &child_slots(node, info)[symbol_rank(node, info, sym)];
+}
+
+/* Function: other_child_of
+ * ------------------------
+ * The part of child_of for nodes with children for bytes other than letters, kept out of line so
+ * that the letter path inlined into every walk stays small.
+ */
+static __attribute__((noinline)) uint32_t other_child_of(const LexNode* node, uint32_t info, int sym) {
+    const uint32_t* slot = find_slot(node, info, sym);
+    return slot == NULL ? 0 : load_slot(slot);
+}
+
+/* Function: child_of
+ * ------------------
+ * Returns the index of node's child for symbol sym (see fold_case), or 0 if there is none.
+ * Letters below a node with only letter children, the common case, take one popcount.
+ * The node must not be a chain node; walks that may meet one go through a Cursor instead.
+ */
+static inline uint32_t child_of(const LexNode* node, int sym) {
+    uint32_t info = load_info(node);
+    uint32_t c = sym - 'a';
+    if(c < ALPHA_SIZE && !(info & EXTRA_MASK)) {
+        uint32_t bit = 1u << c;
+        if(!(info & bit)) return 0;
+        return load_slot(&child_slots(node, info)[__builtin_popcount(info & (bit - 1))]);
+    }
+    return other_child_of(node, info, sym);
+}
+
+/* Function: next_child
+ * --------------------
+ * Finds node's child with the smallest symbol of at least *sym, stores that symbol in *sym and
+ * returns the child's index. Returns 0 if there is no such child. Walks that keep the next
+ * symbol to try at every depth visit children in byte order this way, whatever the node's kind.
+ */
+static inline uint32_t next_child(const LexNode* node, uint32_t info, int* sym) {
+    int next = NUM_SYMBOLS;
+    if(*sym <= 'z') {
+        int from = *sym > 'a' ? *sym - 'a' : 0;
+        uint32_t letters = info & (LETTER_MASK << from) & LETTER_MASK;
+        if(letters != 0) next = 'a' + __builtin_ctz(letters);
+    }
+    if(info & EXTRA_MASK) {
+        int extra = next_extra(node, info, *sym);
+        if(extra < next) next = extra;
+    }
+    if(next == NUM_SYMBOLS) return 0;
+    *sym = next;
+    return load_slot(&child_slots(node, info)[symbol_rank(node, info, next)]);
+}
+
+/* Function: node_children
+ * -----------------------
+ * Copies the symbols and indices of a node's children, in symbol order, into symbols and
+ * children, and returns how many there are.
+ */
+static int node_children(const LexNode* node, uint8_t* symbols, uint32_t* children) {
+    uint32_t info = node->info;
+    int n = 0;
+    for(int sym = 1; ; sym++) {
+        uint32_t child = next_child(node, info, &sym);
+        if(child == 0) break;
+        symbols[n] = sym;
+        children[n++] = child;
+    }
+    return n;
+}
+
+/* Function: chain_label
+ * ---------------------
+ * Returns the bytes of a chain node's label.
+ */
+static inline const uint8_t* chain_label(const LexNode* node, uint32_t info) {
+    return (const uint8_t*)extra_slots(node, info);
+}
+
+/* Function: cursor_next
+ * ---------------------
+ * As next_child, for the place cur in the tree: finds its child with the smallest symbol of at
+ * least *sym, stores that symbol in *sym and returns a cursor at the child. Inside a chain node
+ * the only child is the next byte of the label. Returns a cursor at node 0 if there is no such
+ * child.
+ */
+static inline Cursor cursor_next(CLexicon* lex, Cursor cur, int* sym) {
+    const LexNode* node = node_at(lex, cur.node);
+    uint32_t info = load_info(node);
+    Cursor next = { 0, 0 };
+    if(!is_chain(info)) {
+        next.node = next_child(node, info, sym);
+    } else if(chain_label(node, info)[cur.offset] >= *sym) {
+        *sym = chain_label(node, info)[cur.offset];
+        if(cur.offset + 1 < chain_length(info)) next = (Cursor){ cur.node, cur.offset + 1 };
+        else next.node = load_slot(child_slots(node, info));
+    }
+    return next;
+}
+
+/* Function: cursor_node
+ * ---------------------
+ * Returns the node whose count and best weight are those of the place cur: the node itself, or
+ * for a place inside a chain node, the node the chain ends at. Every word below such a place is
+ * below that node too, since the nodes in between have one child and no word.
+ */
+static inline const LexNode* cursor_node(CLexicon* lex, Cursor cur) {
+    const LexNode* node = node_at(lex, cur.node);
+    if(cur.offset == 0) return node;
+    return node_at(lex, load_slot(child_slots(node, load_info(node))));
+}
+
+/* Function: cursor_is_word
+ * ------------------------
+ * Returns true if the bytes leading to the place cur are a word. A place inside a chain never is.
+ */
+static inline bool cursor_is_word(CLexicon* lex, Cursor cur) {
+    return cur.offset == 0 && (load_info(node_at(lex, cur.node)) & NODE_WORD);
+}
+
+/* Function: cursor_child
+ * -----------------------
+ * Returns a cursor at the child of the place cur for symbol sym, or at node 0 if there is none.
+ * Inside a chain node that is the next place along the label, if its byte is sym.
+ */
+static inline Cursor cursor_child(CLexicon* lex, Cursor cur, int sym) {
+    const LexNode* node = node_at(lex, cur.node);
+    uint32_t info = load_info(node);
+    if(!is_chain(info)) return (Cursor){ child_of(node, sym), 0 };
+    if(chain_label(node, info)[cur.offset] != sym) return (Cursor){ 0, 0 };
+    if(cur.offset + 1 < chain_length(info)) return (Cursor){ cur.node, cur.offset + 1 };
+    return (Cursor){ load_slot(child_slots(node, info)), 0 };
+}
+
+/* Function: jump_key
+ * ------------------
+ * Returns the entry of the jump table for the first two bytes of word, or -1 if they are not
+ * both letters. The second byte is only read if the first is a letter.
+ */
+static inline int jump_key(const char* word) {
+    uint32_t c0 = fold_case[(uint8_t)word[0]] - 'a';
+    if(c0 >= ALPHA_SIZE) return -1;
+    uint32_t c1 = fold_case[(uint8_t)word[1]] - 'a';
+    if(c1 >= ALPHA_SIZE) return -1;
+    return c0 * ALPHA_SIZE + c1;
+}
+
+/* Function: jump_place
+ * --------------------
+ * Returns the place in the tree of the two-letter prefix with the given key (see jump_key), or
+ * a cursor at node 0 if no word begins with it. Lookups start there instead of at the root, which
+ * saves them the two nodes every lookup would otherwise read first. Writers keep each entry in
+ * step with the tree (see jump_refresh), storing its node with publish like any child slot.
+ */
+static inline Cursor jump_place(CLexicon* lex, int key) {
+    Cursor cur;
+    cur.node = load_slot(&lex->jump[key].node);
+    cur.offset = __atomic_load_n(&lex->jump[key].offset, __ATOMIC_RELAXED);
+    return cur;
+}
+
+/* Function: jump_refresh
+ * ----------------------
+ * Walks from the root to the two-letter prefix with the given key and stores its place in the
+ * jump table. Called by every writer whose change may have moved that place: the only node a
+ * change to one word can move in the table is the one its own first two letters lead to.
+ */
+static void jump_refresh(CLexicon* lex, int key) {
+    Cursor cur = { lex->root, 0 };
+    for(int d = 0; d < 2 && cur.node != 0; d++) {
+        int c = 'a' + (d == 0 ? key / ALPHA_SIZE : key % ALPHA_SIZE);
+        int sym = c;
+        cur = cursor_next(lex, cur, &sym);
+        if(sym != c) cur = (Cursor){ 0, 0 };
+    }
+    __atomic_store_n(&lex->jump[key].offset, cur.offset, __ATOMIC_RELAXED);
+    publish(&lex->jump[key].node, cur.node);
+}
+
+/* Functions: jump_update, jump_rebuild
+ * ------------------------------------
+ * jump_update refreshes the entry for the first two bytes of the word of wordlen bytes, if they
+ * are letters. jump_rebuild refreshes every entry, after changes to many words or to all of them.
+ */
+static inline void jump_update(CLexicon* lex, const char* word, long wordlen) {
+    int key = wordlen >= 2 ? jump_key(word) : -1;
+    if(key >= 0) jump_refresh(lex, key);
+}
+
+static void jump_rebuild(CLexicon* lex) {
+    for(int key = 0; key < JUMP_ENTRIES; key++) {
+        jump_refresh(lex, key);
+    }
+}
+
+/* Function: write_node
+ * --------------------
+ * Writes a node with the header of the node at header (its word and weighted flags, count and
+ * weights) and the given n children, in symbol order, to out, in whichever layout they need.
+ * Returns the node's size in words.
+ */
+static uint32_t write_node(uint32_t* out, const uint32_t* header, const uint8_t* symbols, const uint32_t* children, int n) {
+    uint32_t info = header[0] & (NODE_WORD | NODE_WEIGHTED);
+    uint32_t hwords = header_words(info);
+    uint32_t extra[BITMAP_WORDS] = { 0 };
+    uint32_t nextras = 0;
+    for(int i = 0; i < n; i++) {
+        uint32_t c = symbols[i] - 'a';
+        if(c < ALPHA_SIZE) {
+            info |= 1u << c;
+            continue;
+        }
+        if(nextras < MAX_EXTRA_KEYS) extra[0] |= (uint32_t)symbols[i] << (8 * nextras);
+        extra[1 + (symbols[i] >> 5)] |= 1u << (symbols[i] & 31);
+        nextras++;
+    }
+    //Up to MAX_EXTRA_KEYS bytes fit in the keys word; more are kept in the bitmap.
+    uint32_t nwords = 0;
+    if(nextras > MAX_EXTRA_KEYS) {
+        info |= EXTRA_BITMAP << EXTRA_SHIFT;
+        extra[0] = nextras;
+        nwords = BITMAP_WORDS;
+    } else if(nextras > 0) {
+        info |= nextras << EXTRA_SHIFT;
+        nwords = 1;
+    }
+    out[0] = info;
+    memcpy(out + 1, header + 1, (hwords - 1) * sizeof(uint32_t));
+    memcpy(out + hwords, extra, nwords * sizeof(uint32_t));
+    memcpy(out + hwords + nwords, children, n * sizeof(uint32_t));
+    return hwords + nwords + n;
+}
+
+/* Functions: load_weight, load_best
+ * ---------------------------------
+ * Read the weight of a node's own word and the best weight in its subtree, both of which a
+ * concurrent writer may be changing. A node that is not weighted has weight 0 throughout.
+ */
+static inline uint32_t load_weight(const LexNode* node) {
+    if(!(load_info(node) & NODE_WEIGHTED)) return 0;
+    return __atomic_load_n(&((const WeightedNode*)node)->weight, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t load_best(const LexNode* node) {
+    if(!(load_info(node) & NODE_WEIGHTED)) return 0;
+    return __atomic_load_n(&((const WeightedNode*)node)->best, __ATOMIC_RELAXED);
+}
+
+/* Functions: set_weight, set_best
+ * -------------------------------
+ * Change the weights of a WeightedNode that readers may be visiting.
+ */
+static inline void set_weight(LexNode* node, uint32_t weight) {
+    __atomic_store_n(&((WeightedNode*)node)->weight, weight, __ATOMIC_RELAXED);
+}
+
+static inline void set_best(LexNode* node, uint32_t best) {
+    __atomic_store_n(&((WeightedNode*)node)->best, best, __ATOMIC_RELAXED);
+}
+
+/* Function: grow_slabs
+ * --------------------
+ * Makes room in the slabs table for at least nslabs slabs. The table is at least doubled each
+ * time it grows, which keeps the number of tables replaced in concurrent mode within
+ * MAX_OLD_TABLES.
+ */
+static void grow_slabs(CLexicon* lex, uint32_t nslabs) {
+    if(nslabs <= lex->slab_capacity) return;
+    uint32_t capacity = lex->slab_capacity == 0 ? 8 : lex->slab_capacity * 2;
+    if(capacity < nslabs) capacity = nslabs;
+    uint32_t** slabs = lex->allocator.alloc(lex->allocator.context, capacity * sizeof(uint32_t*));
+    if(lex->nslabs > 0) memcpy(slabs, lex->slabs, lex->nslabs * sizeof(uint32_t*));
+    //Readers may still be translating indices through the old table, so in concurrent
+    //mode it is kept until the lexicon is next cleared.
+    if(lex->concurrent && lex->slabs != NULL) {
+        lex->old_tables[lex->nold_tables] = lex->slabs;
+        lex->old_capacities[lex->nold_tables++] = lex->slab_capacity;
+    } else if(lex->slabs != NULL) {
+        lex->allocator.free(lex->allocator.context, lex->slabs, lex->slab_capacity * sizeof(uint32_t*));
+    }
+    __atomic_store_n(&lex->slabs, slabs, __ATOMIC_RELEASE);
+    lex->slab_capacity = capacity;
+}
+
+/* Function: new_slab
+ * ------------------
+ * Requests a fresh slab from the lexicon's allocator and appends it to the slabs table,
+ * doubling the table when it is full. The first word of the first slab is skipped so
+ * that index 0 is never handed out.
+ */
+static void new_slab(CLexicon* lex) {
+    grow_slabs(lex, lex->nslabs + 1);
+    lex->slabs[lex->nslabs] = lex->allocator.alloc(lex->allocator.context, SLAB_WORDS * sizeof(uint32_t));
+    lex->nslabs++;
+    lex->slab_used = lex->nslabs == 1 ? 1 : 0;
+}
+
+/* Function: keep_block
+ * --------------------
+ * Adds a block of storage given up by a snapshot's origin to the snapshot's kept blocks.
+ */
+static void keep_block(CLexicon* snap, void* memory, size_t size, bool mapped) {
+    if(snap->nkept == snap->kept_capacity) {
+        uint32_t capacity = snap->kept_capacity == 0 ? 16 : snap->kept_capacity * 2;
+        KeptBlock* kept = snap->allocator.alloc(snap->allocator.context, capacity * sizeof(KeptBlock));
+        if(snap->nkept > 0) memcpy(kept, snap->kept, snap->nkept * sizeof(KeptBlock));
+        if(snap->kept != NULL) snap->allocator.free(snap->allocator.context, snap->kept, snap->kept_capacity * sizeof(KeptBlock));
+        snap->kept = kept;
+        snap->kept_capacity = capacity;
+    }
+    snap->kept[snap->nkept++] = (KeptBlock){ memory, size, mapped };
+}
+
+/* Function: free_block
+ * --------------------
+ * Hands a block of the lexicon's storage back to the allocator, or unmaps it. While the lexicon
+ * has snapshots, any of them may still be reading the block, so the newest keeps it instead
+ * (see release_snapshot).
+ */
+static void free_block(CLexicon* lex, void* memory, size_t size, bool mapped) {
+    if(lex->snapshots != NULL) keep_block(lex->snapshots, memory, size, mapped);
+    else if(mapped) munmap(memory, size);
+    else lex->allocator.free(lex->allocator.context, memory, size);
+}
+
+/* Function: forget_shared
+ * -----------------------
+ * Called once every node of the lexicon has been copied to new storage and the old storage
+ * handed to free_block, so that no node shares anything with a snapshot any more. The nodes
+ * the snapshots were deferring lived in the old storage, which they now keep whole.
+ */
+static void forget_shared(CLexicon* lex) {
+    lex->shared_words = 0;
+    for(CLexicon* snap = lex->snapshots; snap != NULL; snap = snap->older) {
+        snap->deferred.count = 0;
+    }
+}
+
+/* Function: free_image
+ * --------------------
+ * Releases the image of a frozen lexicon, unmapping it if it came from a file.
+ */
+static void free_image(CLexicon* lex) {
+    if(lex->mapping != NULL) {
+        free_block(lex, lex->mapping, lex->mapping_size, true);
+        lex->mapping = NULL;
+        lex->mapping_size = 0;
+    } else {
+        free_block(lex, lex->image, lex->image_capacity * sizeof(uint32_t), false);
+    }
+    lex->image = NULL;
+    lex->image_words = 0;
+    lex->image_capacity = 0;
+}
+
+/* Function: free_slabs
+ * --------------------
+ * Returns every slab to the allocator, releasing all nodes of the lexicon at once.
+ * Runs in time proportional to the number of slabs rather than the number of nodes.
+ * The slabs of a frozen lexicon all point into its image, which is freed instead.
+ * The slabs table itself is kept for reuse, but tables it replaced are freed, as are the
+ * retired nodes, which lived in the slabs. Snapshots keep the storage instead (see free_block).
+ */
+static void free_slabs(CLexicon* lex) {
+    if(lex->image != NULL) {
+        free_image(lex);
+    } else {
+        for(uint32_t i = 0; i < lex->nslabs; i++) {
+            free_block(lex, lex->slabs[i], SLAB_WORDS * sizeof(uint32_t), false);
+        }
+    }
+    forget_shared(lex);
+    lex->nslabs = 0;
+    lex->slab_used = 0;
+    memset(lex->freelists, 0, sizeof(lex->freelists));
+    lex->dead = 0;
+    for(uint32_t i = 0; i < lex->nold_tables; i++) {
+        lex->allocator.free(lex->allocator.context, lex->old_tables[i], lex->old_capacities[i] * sizeof(uint32_t*));
+    }
+    lex->nold_tables = 0;
+    lex->retired.count = 0;
+    lex->waiting.count = 0;
+}
+
+/* Function: release_node
+ * ----------------------
+ * Returns a single node to the freelist for its size so that a later alloc_node can reuse it.
+ * The slab memory itself stays owned by the lexicon until it is cleared or deleted.
+ */
+static inline void release_node(CLexicon* lex, uint32_t index) {
+    LexNode* node = node_at(lex, index);
+    uint32_t nwords = node_words(node);
+    node->info = lex->freelists[nwords];
+    lex->freelists[nwords] = index;
+}
+
+/* Function: release_span
+ * ----------------------
+ * Puts the len words from index on, which no node uses, on the freelists as nodes of three
+ * words, the last of them two or four words long if len is not a multiple of three. A single
+ * word is too small for any node and is left out.
+ */
+static void release_span(CLexicon* lex, uint32_t index, uint32_t len) {
+    while(len >= 2) {
+        uint32_t nwords = len == 2 || len == 4 ? len : 3;
+        node_at(lex, index)->info = lex->freelists[nwords];
+        lex->freelists[nwords] = index;
+        index += nwords;
+        len -= nwords;
+    }
+}
+
+/* Function: release_dead_node
+ * ---------------------------
+ * Takes the first subtree off the dead list, puts its children on the list in its place, and
+ * releases its root. Unlinked subtrees are released this way, one node at a time as the
+ * memory is wanted again, so that cutting off a subtree never has to walk it.
+ */
+static void release_dead_node(CLexicon* lex) {
+    uint32_t index = lex->dead;
+    LexNode* node = node_at(lex, index);
+    lex->dead = node->count;
+    const uint32_t* children = child_slots(node, node->info);
+    int nchildren = child_count(node, node->info);
+    for(int i = 0; i < nchildren; i++) {
+        node_at(lex, children[i])->count = lex->dead;
+        lex->dead = children[i];
+    }
+    release_node(lex, index);
+}
+
+/* Function: release_subtree
+ * -------------------------
+ * Puts an unlinked subtree on the dead list, leaving its nodes to be released by alloc_node.
+ */
+static inline void release_subtree(CLexicon* lex, uint32_t index) {
+    node_at(lex, index)->count = lex->dead;
+    lex->dead = index;
+}
+
+/* Function: alloc_node
+ * --------------------
+ * Reserves room for a node of nwords words and returns its index. Nodes of the same size
+ * released by earlier operations are reused first, releasing dead subtrees until one turns
+ * up; otherwise the node is carved out of the current slab, and a new slab is started when
+ * the current one cannot fit it. While nodes are shared with a snapshot, nothing is reused,
+ * so that every node at an index below shared_words is one the snapshots may hold.
+ */
+static inline uint32_t alloc_node(CLexicon* lex, uint32_t nwords) {
+    if(lex->shared_words == 0) {
+        while(lex->freelists[nwords] == 0 && lex->dead != 0) release_dead_node(lex);
+        uint32_t index = lex->freelists[nwords];
+        if(index != 0) {
+            lex->freelists[nwords] = node_at(lex, index)->info;
+            return index;
+        }
+    }
+    if(lex->nslabs == 0 || lex->slab_used + nwords > SLAB_WORDS) new_slab(lex);
+    uint32_t index = ((lex->nslabs - 1) << SLAB_SHIFT) | lex->slab_used;
+    lex->slab_used += nwords;
+    return index;
+}
+
+/* Function: retire_push
+ * ---------------------
+ * Appends one entry to a retire list of the lexicon: the one for the current epoch, or the
+ * deferred nodes of a snapshot.
+ */
+static void retire_push(CLexicon* lex, RetireList* list, uint32_t entry) {
+    if(list->count == list->capacity) {
+        uint32_t capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+        uint32_t* nodes = lex->allocator.alloc(lex->allocator.context, capacity * sizeof(uint32_t));
+        if(list->count > 0) memcpy(nodes, list->nodes, list->count * sizeof(uint32_t));
+        if(list->nodes != NULL) lex->allocator.free(lex->allocator.context, list->nodes, list->capacity * sizeof(uint32_t));
+        list->nodes = nodes;
+        list->capacity = capacity;
+    }
+    list->nodes[list->count++] = entry;
+}
+
+/* Function: retire_node
+ * ---------------------
+ * Releases a node that has just been unlinked from the tree. In concurrent mode a reader may
+ * still be visiting it, so it is only queued; reclaim releases it once that can no longer be.
+ * A node that may be in a snapshot is deferred until the snapshot is gone (see release_snapshot).
+ */
+static void retire_node(CLexicon* lex, uint32_t index) {
+    if(index < lex->shared_words) retire_push(lex, &lex->snapshots->deferred, index);
+    else if(lex->concurrent) retire_push(lex, &lex->retired, index);
+    else release_node(lex, index);
+}
+
+/* Function: retire_subtree
+ * ------------------------
+ * As retire_node, but for a whole subtree that has just been unlinked. In a retire list the
+ * subtree's root is preceded by a 0, which is never a node index. Below a node that is not in
+ * any snapshot there may still be nodes that are, so while there are snapshots such a subtree
+ * is walked down to the nodes it shares with them, which are deferred with their subtrees.
+ */
+static void retire_subtree(CLexicon* lex, uint32_t index) {
+    if(index < lex->shared_words) {
+        retire_push(lex, &lex->snapshots->deferred, 0);
+        retire_push(lex, &lex->snapshots->deferred, index);
+    } else if(lex->shared_words != 0) {
+        LexNode* node = node_at(lex, index);
+        const uint32_t* children = child_slots(node, node->info);
+        int nchildren = child_count(node, node->info);
+        for(int i = 0; i < nchildren; i++) {
+            retire_subtree(lex, children[i]);
+        }
+        retire_node(lex, index);
+    } else if(lex->concurrent) {
+        retire_push(lex, &lex->retired, 0);
+        retire_push(lex, &lex->retired, index);
+    } else {
+        release_subtree(lex, index);
+    }
+}
+
+/* Function: release_retired
+ * -------------------------
+ * Releases every node and subtree in a retire list and empties it.
+ */
+static void release_retired(CLexicon* lex, RetireList* list) {
+    for(uint32_t i = 0; i < list->count; i++) {
+        if(list->nodes[i] == 0) release_subtree(lex, list->nodes[++i]);
+        else release_node(lex, list->nodes[i]);
+    }
+    list->count = 0;
+}
+
+/* Function: reclaim
+ * -----------------
+ * Called by a writer after its changes are published. Readers count themselves in their slot
+ * under the parity of the epoch they started in. Once no reader of the previous epoch's parity
+ * remains, every reader still running started after the previous writes were visible, so the
+ * nodes waiting since then are released, this epoch's nodes start waiting, and the epoch moves
+ * on. If a reader from the previous epoch is still running, the nodes simply wait for a later
+ * writer.
+ */
+static void reclaim(CLexicon* lex) {
+    if(lex->retired.count == 0 && lex->waiting.count == 0) return;
+    //Orders the writer's unlinks before its reads of the counters (see reader_enter).
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int previous = (lex->epoch + 1) & 1;
+    for(int i = 0; i < READER_SLOTS; i++) {
+        if(__atomic_load_n(&lex->readers[i].active[previous], __ATOMIC_ACQUIRE) != 0) return;
+    }
+    release_retired(lex, &lex->waiting);
+    RetireList released = lex->waiting;
+    lex->waiting = lex->retired;
+    lex->retired = released;
+    lex->retired.count = 0;
+    __atomic_store_n(&lex->epoch, lex->epoch + 1, __ATOMIC_SEQ_CST);
+}
+
+/* Function: free_retire_list
+ * --------------------------
+ * Returns a retire list's array to the allocator.
+ */
+static void free_retire_list(CLexicon* lex, RetireList* list) {
+    if(list->nodes != NULL) lex->allocator.free(lex->allocator.context, list->nodes, list->capacity * sizeof(uint32_t));
+    *list = (RetireList){ NULL, 0, 0 };
+}
+
+/* Thread-local: reader_slot
+ * -------------------------
+ * The ReaderSlot a thread counts itself in, handed out round-robin on the thread's first
+ * lookup in a concurrent lexicon. Threads sharing a slot are counted together.
+ */
+static __thread int reader_slot = -1;
+static int next_reader_slot = 0;
+
+/* Function: reader_enter
+ * ----------------------
+ * Starts a lookup. Does nothing unless the lexicon is concurrent; otherwise counts the lookup
+ * in the thread's slot and returns the slot, with the epoch parity it was counted under in
+ * parity. The fence pairs with the one in reclaim: either the writer sees this count, or this
+ * lookup sees every node the writer unlinked before looking.
+ */
+static inline ReaderSlot* reader_enter(CLexicon* lex, int* parity) {
+    *parity = 0;
+    if(!lex->concurrent) return NULL;
+    if(reader_slot < 0) reader_slot = __atomic_fetch_add(&next_reader_slot, 1, __ATOMIC_RELAXED) % READER_SLOTS;
+    ReaderSlot* slot = &lex->readers[reader_slot];
+    *parity = __atomic_load_n(&lex->epoch, __ATOMIC_RELAXED) & 1;
+    __atomic_fetch_add(&slot->active[*parity], 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return slot;
+}
+
+/* Function: reader_exit
+ * ---------------------
+ * Ends a lookup started by reader_enter.
+ */
+static inline void reader_exit(ReaderSlot* slot, int parity) {
+    if(slot != NULL) __atomic_fetch_sub(&slot->active[parity], 1, __ATOMIC_RELEASE);
+}
+
+/* Function: writer_lock
+ * ---------------------
+ * Serializes the functions that change a concurrent lexicon. Lookups never take the lock.
+ */
+static inline void writer_lock(CLexicon* lex) {
+    if(lex->concurrent) pthread_mutex_lock(&lex->writer_lock);
+}
+
+/* Function: writer_unlock
+ * -----------------------
+ * Ends a change started by writer_lock, first releasing any retired nodes that readers are done with.
+ */
+static inline void writer_unlock(CLexicon* lex) {
+    if(!lex->concurrent) return;
+    reclaim(lex);
+    pthread_mutex_unlock(&lex->writer_lock);
+}
+
+/* Function: create_node
+ * -----------------------
+ * Creates a new LexNode with no children whose word status is false. Returns its index.
+ */
+static inline uint32_t create_node(CLexicon* lex) {
+    uint32_t index = alloc_node(lex, 2);
+    node_at(lex, index)->info = 0;
+    node_at(lex, index)->count = 0;
+    return index;
+}
+
+/* Function: rebuild_node
+ * ----------------------
+ * Reallocates the node at index with the given n children, in symbol order, in place of its
+ * own, and releases the old copy. Its header is kept. Returns the node's new index, which the
+ * caller must store in place of the old one.
+ */
+static uint32_t rebuild_node(CLexicon* lex, uint32_t index, const uint8_t* symbols, const uint32_t* children, int n) {
+    uint32_t node[MAX_NODE_WORDS];
+    uint32_t nwords = write_node(node, (const uint32_t*)node_at(lex, index), symbols, children, n);
+    uint32_t new_index = alloc_node(lex, nwords);
+    memcpy(node_at(lex, new_index), node, nwords * sizeof(uint32_t));
+    retire_node(lex, index);
+    return new_index;
+}
+
+/* Function: insert_child
+ * ----------------------
+ * Reallocates the node at index with room for one more child, links child under symbol sym,
+ * and releases the old copy. Returns the node's new index, which the caller must store in
+ * place of the old one. A letter under a node with only letter children is a straight copy;
+ * anything else goes through rebuild_node, which may change the node's layout.
+ */
+static uint32_t insert_child(CLexicon* lex, uint32_t index, int sym, uint32_t child) {
+    uint32_t info = node_at(lex, index)->info;
+    uint32_t c = sym - 'a';
+    if(c >= ALPHA_SIZE || (info & EXTRA_MASK)) {
+        uint8_t symbols[MAX_CHILDREN + 1];
+        uint32_t children[MAX_CHILDREN + 1];
+        const LexNode* node = node_at(lex, index);
+        int n = node_children(node, symbols, children);
+        int pos = symbol_rank(node, info, sym);
+        memmove(symbols + pos + 1, symbols + pos, n - pos);
+        memmove(children + pos + 1, children + pos, (n - pos) * sizeof(uint32_t));
+        symbols[pos] = sym;
+        children[pos] = child;
+        return rebuild_node(lex, index, symbols, children, n + 1);
+    }
+    uint32_t bit = 1u << c;
+    int pos = __builtin_popcount(info & (bit - 1));
+    int nchildren = __builtin_popcount(info & LETTER_MASK);
+
+    uint32_t new_index = alloc_node(lex, header_words(info) + nchildren + 1);
+    LexNode* old_node = node_at(lex, index);
+    LexNode* new_node = node_at(lex, new_index);
+    memcpy(new_node, old_node, header_words(info) * sizeof(uint32_t));
+    new_node->info = info | bit;
+    uint32_t* old_children = child_slots(old_node, info);
+    uint32_t* new_children = child_slots(new_node, info);
+    memcpy(new_children, old_children, pos * sizeof(uint32_t));
+    new_children[pos] = child;
+    memcpy(new_children + pos + 1, old_children + pos, (nchildren - pos) * sizeof(uint32_t));
+    retire_node(lex, index);
+    return new_index;
+}
+
+/* Function: remove_child
+ * ----------------------
+ * Reallocates the node at index without its child for symbol sym, and releases the old copy.
+ * The removed child itself is left untouched. Returns the node's new index, which the caller
+ * must store in place of the old one.
+ */
+static uint32_t remove_child(CLexicon* lex, uint32_t index, int sym) {
+    uint32_t info = node_at(lex, index)->info;
+    uint32_t c = sym - 'a';
+    if(c >= ALPHA_SIZE || (info & EXTRA_MASK)) {
+        uint8_t symbols[MAX_CHILDREN];
+        uint32_t children[MAX_CHILDREN];
+        const LexNode* node = node_at(lex, index);
+        int n = node_children(node, symbols, children);
+        int pos = symbol_rank(node, info, sym);
+        memmove(symbols + pos, symbols + pos + 1, n - pos - 1);
+        memmove(children + pos, children + pos + 1, (n - pos - 1) * sizeof(uint32_t));
+        return rebuild_node(lex, index, symbols, children, n - 1);
+    }
+    uint32_t bit = 1u << c;
+    int pos = __builtin_popcount(info & (bit - 1));
+    int nchildren = __builtin_popcount(info & LETTER_MASK);
+
+    uint32_t new_index = alloc_node(lex, header_words(info) + nchildren - 1);
+    LexNode* old_node = node_at(lex, index);
+    LexNode* new_node = node_at(lex, new_index);
+    memcpy(new_node, old_node, header_words(info) * sizeof(uint32_t));
+    new_node->info = info & ~bit;
+    uint32_t* old_children = child_slots(old_node, info);
+    uint32_t* new_children = child_slots(new_node, info);
+    memcpy(new_children, old_children, pos * sizeof(uint32_t));
+    memcpy(new_children + pos, old_children + pos + 1, (nchildren - pos - 1) * sizeof(uint32_t));
+    retire_node(lex, index);
+    return new_index;
+}
+
+/* Function: make_weighted
+ * -------------------------
+ * Reallocates the node at index as a WeightedNode whose word and subtree both weigh 0, and
+ * releases the old copy. Returns the node's new index, which the caller must store in place
+ * of the old one.
+ */
+static uint32_t make_weighted(CLexicon* lex, uint32_t index) {
+    uint32_t nwords = node_words(node_at(lex, index));
+    uint32_t new_index = alloc_node(lex, nwords + 2);
+    LexNode* old_node = node_at(lex, index);
+    WeightedNode* new_node = (WeightedNode*)node_at(lex, new_index);
+    new_node->info = old_node->info | NODE_WEIGHTED;
+    new_node->count = old_node->count;
+    new_node->weight = 0;
+    new_node->best = 0;
+    //The extras and children follow the header unchanged.
+    memcpy(new_node->children, old_node->children, (nwords - 2) * sizeof(uint32_t));
+    retire_node(lex, index);
+    return new_index;
+}
+
+/* Function: hash_node
+ * -------------------
+ * Hashes the nwords words of a node (FNV-1a over whole words).
+ */
+static inline uint32_t hash_node(const uint32_t* node, uint32_t nwords) {
+    uint32_t hash = 2166136261u;
+    for(uint32_t i = 0; i < nwords; i++) {
+        hash = (hash ^ node[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Function: register_grow
+ * -----------------------
+ * Doubles the register's hash table and reinserts every node already written.
+ */
+static void register_grow(CLexicon* lex, NodeRegister* reg) {
+    uint32_t nbuckets = reg->nbuckets == 0 ? MIN_REGISTER_BUCKETS : reg->nbuckets * 2;
+    uint32_t* buckets = lex->allocator.alloc(lex->allocator.context, nbuckets * sizeof(uint32_t));
+    memset(buckets, 0, nbuckets * sizeof(uint32_t));
+    for(uint32_t i = 0; i < reg->nbuckets; i++) {
+        uint32_t index = reg->buckets[i];
+        if(index == 0) continue;
+        uint32_t b = hash_node(reg->words + index, node_words((const LexNode*)(reg->words + index))) & (nbuckets - 1);
+        while(buckets[b] != 0) b = (b + 1) & (nbuckets - 1);
+        buckets[b] = index;
+    }
+    if(reg->buckets != NULL) lex->allocator.free(lex->allocator.context, reg->buckets, reg->nbuckets * sizeof(uint32_t));
+    reg->buckets = buckets;
+    reg->nbuckets = nbuckets;
+}
+
+/* Function: register_init
+ * -----------------------
+ * Prepares an empty register whose output starts with the reserved word 0.
+ */
+static void register_init(CLexicon* lex, NodeRegister* reg) {
+    reg->capacity = MIN_REGISTER_BUCKETS;
+    reg->words = lex->allocator.alloc(lex->allocator.context, reg->capacity * sizeof(uint32_t));
+    reg->words[0] = 0;
+    reg->nwords = 1;
+    reg->buckets = NULL;
+    reg->nbuckets = 0;
+    reg->nentries = 0;
+}
+
+/* Function: register_node
+ * -----------------------
+ * Returns the index in the register's output of a node identical to the given one,
+ * writing the node to the output first if no identical node has been written yet.
+ */
+static uint32_t register_node(CLexicon* lex, NodeRegister* reg, const uint32_t* node) {
+    uint32_t nwords = node_words((const LexNode*)node);
+    if(2 * (reg->nentries + 1) > reg->nbuckets) register_grow(lex, reg);
+
+    uint32_t b = hash_node(node, nwords) & (reg->nbuckets - 1);
+    for(; reg->buckets[b] != 0; b = (b + 1) & (reg->nbuckets - 1)) {
+        uint32_t index = reg->buckets[b];
+        if(memcmp(reg->words + index, node, nwords * sizeof(uint32_t)) == 0) return index;
+    }
+
+    if(reg->nwords + nwords > reg->capacity) {
+        uint32_t capacity = reg->capacity * 2 + nwords;
+        uint32_t* words = lex->allocator.alloc(lex->allocator.context, capacity * sizeof(uint32_t));
+        memcpy(words, reg->words, reg->nwords * sizeof(uint32_t));
+        lex->allocator.free(lex->allocator.context, reg->words, reg->capacity * sizeof(uint32_t));
+        reg->words = words;
+        reg->capacity = capacity;
+    }
+    uint32_t index = reg->nwords;
+    memcpy(reg->words + index, node, nwords * sizeof(uint32_t));
+    reg->nwords += nwords;
+    reg->buckets[b] = index;
+    reg->nentries++;
+    return index;
+}
+
+/* Function: freeze_node
+ * ---------------------
+ * Registers the subtree at index bottom-up: every child is registered first so that two
+ * nodes compare equal exactly when their whole subtrees are equal. Returns the index of
+ * the subtree's root in the register's output.
+ */
+static uint32_t freeze_node(CLexicon* lex, NodeRegister* reg, uint32_t index) {
+    const LexNode* node = node_at(lex, index);
+    uint32_t frozen[MAX_NODE_WORDS];
+    uint32_t header = header_words(node->info) + extra_words(node->info);
+    memcpy(frozen, node, header * sizeof(uint32_t));
+    const uint32_t* children = child_slots(node, node->info);
+    int nchildren = child_count(node, node->info);
+    for(int i = 0; i < nchildren; i++) {
+        frozen[header + i] = freeze_node(lex, reg, children[i]);
+    }
+    return register_node(lex, reg, frozen);
+}
+
+/* Function: compress_node
+ * -----------------------
+ * Writes the compressed copy of the node at index in comp's input, and of everything beneath it,
+ * to comp's output, and returns the copy's index there. A node with one child takes in the
+ * single-child nodes below it that have no word and no other parent, becoming a chain node if
+ * that makes a label of at least MIN_CHAIN_LEN bytes. Nodes with another parent are left to be
+ * copied once for all their parents, so no part of the graph is ever stored twice.
+ */
+static uint32_t compress_node(ChainCompressor* comp, uint32_t index) {
+    if(comp->copies[index] != 0) return comp->copies[index];
+    const LexNode* node = (const LexNode*)(comp->words + index);
+    uint32_t info = node->info;
+    uint32_t hwords = header_words(info);
+    uint32_t compressed[MAX_NODE_WORDS];
+    int nchildren = child_count(node, info);
+    if(nchildren == 1) {
+        uint8_t label[MAX_WORD_LEN];
+        uint32_t length = 0;
+        uint32_t end;
+        const LexNode* at = node;
+        for(;;) {
+            int sym = 1;
+            end = next_child(at, at->info, &sym);
+            label[length++] = sym;
+            at = (const LexNode*)(comp->words + end);
+            if(length == MAX_WORD_LEN || (at->info & NODE_WORD) || comp->parents[end] > 1) break;
+            if(child_count(at, at->info) != 1) break;
+        }
+        if(length >= MIN_CHAIN_LEN) {
+            uint32_t lwords = (length + 3) / 4;
+            compressed[0] = (info & (NODE_WORD | NODE_WEIGHTED)) | (EXTRA_CHAIN << EXTRA_SHIFT) | length;
+            memcpy(compressed + 1, (const uint32_t*)node + 1, (hwords - 1) * sizeof(uint32_t));
+            memset(compressed + hwords, 0, lwords * sizeof(uint32_t));
+            memcpy(compressed + hwords, label, length);
+            compressed[hwords + lwords] = compress_node(comp, end);
+            comp->copies[index] = register_node(comp->lex, &comp->out, compressed);
+            return comp->copies[index];
+        }
+    }
+    uint32_t header = hwords + extra_words(info);
+    memcpy(compressed, node, header * sizeof(uint32_t));
+    const uint32_t* children = child_slots(node, info);
+    for(int i = 0; i < nchildren; i++) {
+        compressed[header + i] = compress_node(comp, children[i]);
+    }
+    comp->copies[index] = register_node(comp->lex, &comp->out, compressed);
+    return comp->copies[index];
+}
+
+/* Function: compress_image
+ * ------------------------
+ * Replaces the minimized graph in reg, whose root is at root, with a copy in which chains of
+ * single-child nodes are stored as chain nodes (see compress_node), and returns the new root.
+ * Every lookup that would have taken one node per byte of such a chain reads one node instead.
+ * The old words and hash table are released, and reg is left holding the copy's.
+ */
+static uint32_t compress_image(CLexicon* lex, NodeRegister* reg, uint32_t root) {
+    ChainCompressor comp;
+    comp.lex = lex;
+    comp.words = reg->words;
+    comp.parents = lex->allocator.alloc(lex->allocator.context, reg->nwords);
+    comp.copies = lex->allocator.alloc(lex->allocator.context, reg->nwords * sizeof(uint32_t));
+    memset(comp.parents, 0, reg->nwords);
+    memset(comp.copies, 0, reg->nwords * sizeof(uint32_t));
+    //The register's nodes lie one after another from word 1, so they can be read in order.
+    for(uint32_t index = 1; index < reg->nwords; index += node_words((const LexNode*)(reg->words + index))) {
+        const LexNode* node = (const LexNode*)(reg->words + index);
+        const uint32_t* children = child_slots(node, node->info);
+        for(int i = child_count(node, node->info) - 1; i >= 0; i--) {
+            if(comp.parents[children[i]] < 2) comp.parents[children[i]]++;
+        }
+    }
+    register_init(lex, &comp.out);
+    root = compress_node(&comp, root);
+
+    lex->allocator.free(lex->allocator.context, comp.parents, reg->nwords);
+    lex->allocator.free(lex->allocator.context, comp.copies, reg->nwords * sizeof(uint32_t));
+    lex->allocator.free(lex->allocator.context, reg->words, reg->capacity * sizeof(uint32_t));
+    lex->allocator.free(lex->allocator.context, reg->buckets, reg->nbuckets * sizeof(uint32_t));
+    *reg = comp.out;
+    return root;
+}
+
+/* Function: place_node
+ * --------------------
+ * Copies the node at index in words to the end of image, at *next, and records where it went.
+ */
+static inline void place_node(const uint32_t* words, uint32_t index, uint32_t* places, uint32_t* image, uint32_t* next) {
+    const LexNode* node = (const LexNode*)(words + index);
+    uint32_t nwords = node_words(node);
+    places[index] = *next;
+    memcpy(image + *next, node, nwords * sizeof(uint32_t));
+    *next += nwords;
+}
+
+/* Function: push_children
+ * -----------------------
+ * Pushes the children of node that are neither placed nor already waiting (see layout_image)
+ * onto stack, lightest first, so that the child with the most words beneath it is popped first.
+ */
+static void push_children(const uint32_t* words, const LexNode* node, uint32_t* places, uint32_t* stack, uint32_t* nstack) {
+    const uint32_t* children = child_slots(node, node->info);
+    uint32_t base = *nstack;
+    for(int i = child_count(node, node->info) - 1; i >= 0; i--) {
+        uint32_t child = children[i];
+        if(places[child] != 0) continue;
+        places[child] = LAYOUT_WAITING;
+        uint32_t count = ((const LexNode*)(words + child))->count;
+        uint32_t j = (*nstack)++;
+        for(; j > base && ((const LexNode*)(words + stack[j - 1]))->count > count; j--) stack[j] = stack[j - 1];
+        stack[j] = child;
+    }
+}
+
+/* Function: layout_image
+ * ----------------------
+ * Copies the frozen graph in the nwords words at words, whose root is at *root, into a new block
+ * of nwords words, and returns it along with the new root in *root and the number of words used
+ * in *image_words. The nodes are renumbered for the order lookups visit them in: breadth first
+ * until LAYOUT_TOP_WORDS words are placed, so that the levels every lookup passes through share
+ * a few pages, then depth first below each of those nodes, visiting the child with the most words
+ * beneath it first, so that a node is usually followed directly by the child most lookups go on
+ * to. A node shared by several parents is placed where it is first reached.
+ */
+static uint32_t* layout_image(CLexicon* lex, const uint32_t* words, uint32_t nwords, uint32_t* root, uint32_t* image_words) {
+    //places[i] is the new index of the node at i once it has been placed. Each node is on the
+    //stack at most once, and takes at least two words, so the stack needs room for half as many.
+    uint32_t* places = lex->allocator.alloc(lex->allocator.context, nwords * sizeof(uint32_t));
+    uint32_t* stack = lex->allocator.alloc(lex->allocator.context, (nwords / 2 + 1) * sizeof(uint32_t));
+    uint32_t* image = lex->allocator.alloc(lex->allocator.context, nwords * sizeof(uint32_t));
+    memset(places, 0, nwords * sizeof(uint32_t));
+    image[0] = 0;
+    uint32_t next = 1;
+    place_node(words, *root, places, image, &next);
+
+    //The copies still hold their children's old indices, so the nodes placed so far double as
+    //the breadth-first queue.
+    uint32_t at = 1;
+    for(; at < next && next < LAYOUT_TOP_WORDS; at += node_words((const LexNode*)(image + at))) {
+        const LexNode* node = (const LexNode*)(image + at);
+        const uint32_t* children = child_slots(node, node->info);
+        for(int i = 0; i < child_count(node, node->info); i++) {
+            if(places[children[i]] == 0) place_node(words, children[i], places, image, &next);
+        }
+    }
+    for(uint32_t top = next; at < top; at += node_words((const LexNode*)(image + at))) {
+        uint32_t nstack = 0;
+        push_children(words, (const LexNode*)(image + at), places, stack, &nstack);
+        while(nstack > 0) {
+            uint32_t index = stack[--nstack];
+            place_node(words, index, places, image, &next);
+            push_children(words, (const LexNode*)(words + index), places, stack, &nstack);
+        }
+    }
+
+    for(at = 1; at < next; at += node_words((const LexNode*)(image + at))) {
+        LexNode* node = (LexNode*)(image + at);
+        uint32_t* children = child_slots(node, node->info);
+        for(int i = child_count(node, node->info) - 1; i >= 0; i--) children[i] = places[children[i]];
+    }
+    *root = places[*root];
+    *image_words = next;
+    lex->allocator.free(lex->allocator.context, places, nwords * sizeof(uint32_t));
+    lex->allocator.free(lex->allocator.context, stack, (nwords / 2 + 1) * sizeof(uint32_t));
+    return image;
+}
+
+/* Function: build_image
+ * ---------------------
+ * Fills reg with a minimized copy of the lexicon's nodes (see freeze_node), its chains
+ * compressed (see compress_image) and laid out for lookups (see layout_image), without changing
+ * the lexicon itself. Word 0 of the output is reserved and zeroed. The register's hash table is
+ * released; its words are left for the caller to free. Returns the index of the root.
+ */
+static uint32_t build_image(CLexicon* lex, NodeRegister* reg) {
+    register_init(lex, reg);
+    uint32_t root = freeze_node(lex, reg, lex->root);
+    root = compress_image(lex, reg, root);
+    lex->allocator.free(lex->allocator.context, reg->buckets, reg->nbuckets * sizeof(uint32_t));
+    uint32_t nwords;
+    uint32_t* image = layout_image(lex, reg->words, reg->nwords, &root, &nwords);
+    lex->allocator.free(lex->allocator.context, reg->words, reg->capacity * sizeof(uint32_t));
+    reg->words = image;
+    reg->capacity = reg->nwords;
+    reg->nwords = nwords;
+    return root;
+}
+
+/* Function: adopt_image
+ * ---------------------
+ * Releases the lexicon's current nodes and makes the given block of nwords words (out of
+ * capacity allocated) its frozen node storage. The slabs table is rebuilt to point into the
+ * block, so node_at works on frozen and mutable lexicons alike.
+ */
+static void adopt_image(CLexicon* lex, uint32_t* image, uint32_t nwords, uint32_t capacity, uint32_t root) {
+    free_slabs(lex);
+    uint32_t nslabs = (nwords + SLAB_WORDS - 1) >> SLAB_SHIFT;
+    if(nslabs > lex->slab_capacity) {
+        lex->allocator.free(lex->allocator.context, lex->slabs, lex->slab_capacity * sizeof(uint32_t*));
+        lex->slabs = lex->allocator.alloc(lex->allocator.context, nslabs * sizeof(uint32_t*));
+        lex->slab_capacity = nslabs;
+    }
+    for(uint32_t i = 0; i < nslabs; i++) {
+        lex->slabs[i] = image + ((size_t)i << SLAB_SHIFT);
+    }
+    lex->nslabs = nslabs;
+    lex->image = image;
+    lex->image_words = nwords;
+    lex->image_capacity = capacity;
+    lex->root = root;
+    jump_rebuild(lex);
+}
+
+static uint32_t thaw_node(CLexicon* lex, uint32_t** old_slabs, uint32_t index);
+
+/* Function: thaw_chain
+ * --------------------
+ * Copies a frozen chain node from the place from bytes along its label, and everything beneath
+ * it, into the lexicon's own arena as the chain of single-child nodes it stands for. The nodes
+ * inside the chain have no word, and take their count and best weight from the node it ends at
+ * (see cursor_node), being weighted if that node is. Returns the index of the copy's first node.
+ */
+static uint32_t thaw_chain(CLexicon* lex, uint32_t** old_slabs, const LexNode* old_node, uint32_t from) {
+    uint32_t info = old_node->info;
+    const uint8_t* label = chain_label(old_node, info);
+    uint32_t child = thaw_node(lex, old_slabs, child_slots(old_node, info)[0]);
+    const LexNode* end = node_at(lex, child);
+    const uint32_t inside[4] = { end->info & NODE_WEIGHTED, end->count, 0, load_best(end) };
+    //Builds the chain from the bottom up, so each node can be written with its child in place.
+    for(uint32_t k = chain_length(info); k-- > from; ) {
+        uint32_t node[MAX_NODE_WORDS];
+        uint32_t nwords = write_node(node, k == 0 ? (const uint32_t*)old_node : inside, &label[k], &child, 1);
+        child = alloc_node(lex, nwords);
+        memcpy(node_at(lex, child), node, nwords * sizeof(uint32_t));
+    }
+    return child;
+}
+
+/* Function: thaw_node
+ * -------------------
+ * Copies the node at index in the slabs table old_slabs, and everything beneath it, into the
+ * lexicon's own arena. Nodes shared in a frozen graph are copied once per parent, turning the
+ * graph back into a tree. The table may also be that of another lexicon, frozen or not, which
+ * must not change during the copy. Returns the index of the copy.
+ */
+static uint32_t thaw_node(CLexicon* lex, uint32_t** old_slabs, uint32_t index) {
+    const LexNode* old_node = (const LexNode*)&old_slabs[index >> SLAB_SHIFT][index & SLAB_MASK];
+    uint32_t info = old_node->info;
+    if(is_chain(info)) return thaw_chain(lex, old_slabs, old_node, 0);
+    uint32_t header = header_words(info) + extra_words(info);
+    uint32_t nwords = node_words(old_node);
+    uint32_t new_index = alloc_node(lex, nwords);
+    memcpy(node_at(lex, new_index), old_node, header * sizeof(uint32_t));
+    for(uint32_t i = 0; header + i < nwords; i++) {
+        uint32_t child = thaw_node(lex, old_slabs, child_slots(old_node, info)[i]);
+        child_slots(node_at(lex, new_index), info)[i] = child;
+    }
+    return new_index;
+}
+
+/* Function: thaw
+ * --------------
+ * Turns a frozen lexicon back into an ordinary mutable tree. Called by every function that
+ * modifies the lexicon, so that clients never need to thaw explicitly.
+ */
+static void thaw(CLexicon* lex) {
+    uint32_t** old_slabs = lex->slabs;
+    uint32_t old_capacity = lex->slab_capacity;
+
+    //The arena starts over with a new slabs table; the image stays until the copy is done.
+    lex->slabs = NULL;
+    lex->nslabs = 0;
+    lex->slab_capacity = 0;
+    memset(lex->freelists, 0, sizeof(lex->freelists));
+    lex->dead = 0;
+    lex->root = thaw_node(lex, old_slabs, lex->root);
+    jump_rebuild(lex);
+
+    free_image(lex);
+    forget_shared(lex);
+    lex->allocator.free(lex->allocator.context, old_slabs, old_capacity * sizeof(uint32_t*));
+}
+
+/* Function: relayout_node
+ * -----------------------
+ * Copies the node at index in the slabs table old_slabs, and everything beneath it, into the
+ * lexicon's own arena, in the order layout_image uses below the top of an image: each node is
+ * followed by the subtree of its child with the most words beneath it, then by those of the
+ * others in turn. Returns the index of the copy.
+ */
+static uint32_t relayout_node(CLexicon* lex, uint32_t** old_slabs, uint32_t index) {
+    const LexNode* old_node = (const LexNode*)&old_slabs[index >> SLAB_SHIFT][index & SLAB_MASK];
+    uint32_t info = old_node->info;
+    uint32_t nwords = node_words(old_node);
+    uint32_t new_index = alloc_node(lex, nwords);
+    memcpy(node_at(lex, new_index), old_node, nwords * sizeof(uint32_t));
+    const uint32_t* children = child_slots(old_node, info);
+    int nchildren = child_count(old_node, info);
+    uint8_t order[MAX_CHILDREN];
+    for(int i = 0; i < nchildren; i++) {
+        uint32_t count = ((const LexNode*)&old_slabs[children[i] >> SLAB_SHIFT][children[i] & SLAB_MASK])->count;
+        int j = i;
+        for(; j > 0; j--) {
+            uint32_t prev = children[order[j - 1]];
+            if(((const LexNode*)&old_slabs[prev >> SLAB_SHIFT][prev & SLAB_MASK])->count >= count) break;
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    for(int i = 0; i < nchildren; i++) {
+        uint32_t child = relayout_node(lex, old_slabs, children[order[i]]);
+        child_slots(node_at(lex, new_index), info)[order[i]] = child;
+    }
+    return new_index;
+}
+
+/* Function: relayout_arena
+ * ------------------------
+ * Copies the tree of a lexicon that is not frozen into a new arena (see relayout_node) and
+ * releases the old one, nodes unlinked but not yet reused included. Afterwards the lexicon
+ * shares no nodes with its snapshots, which keep the old arena.
+ */
+static void relayout_arena(CLexicon* lex) {
+    uint32_t** old_slabs = lex->slabs;
+    uint32_t old_nslabs = lex->nslabs;
+    uint32_t old_capacity = lex->slab_capacity;
+
+    lex->slabs = NULL;
+    lex->nslabs = 0;
+    lex->slab_capacity = 0;
+    memset(lex->freelists, 0, sizeof(lex->freelists));
+    lex->dead = 0;
+    lex->root = relayout_node(lex, old_slabs, lex->root);
+    jump_rebuild(lex);
+
+    for(uint32_t i = 0; i < old_nslabs; i++) {
+        free_block(lex, old_slabs[i], SLAB_WORDS * sizeof(uint32_t), false);
+    }
+    forget_shared(lex);
+    lex->allocator.free(lex->allocator.context, old_slabs, old_capacity * sizeof(uint32_t*));
+    for(uint32_t i = 0; i < lex->nold_tables; i++) {
+        lex->allocator.free(lex->allocator.context, lex->old_tables[i], lex->old_capacities[i] * sizeof(uint32_t*));
+    }
+    lex->nold_tables = 0;
+    lex->retired.count = 0;
+    lex->waiting.count = 0;
+}
+
+/* Function: unshare_tree
+ * ----------------------
+ * Gives a lexicon that shares nodes with its snapshots a copy of its tree of its own, so that
+ * bulk changes can be made in place. Without lookups to mind the lexicon moves to a new arena
+ * (see relayout_arena). In concurrent mode lookups may be running through the old nodes, so the
+ * copy is carved out of new slabs next to them instead, where alloc_node puts every node while
+ * there are snapshots, and the old table stays valid if the slabs table grows (see new_slab).
+ * Once the root and the jump table are published the old tree is retired as an unlinked
+ * subtree: the nodes a snapshot holds are deferred to it, the others released when no lookup
+ * can be visiting them.
+ */
+static void unshare_tree(CLexicon* lex) {
+    if(!lex->concurrent) {
+        relayout_arena(lex);
+        return;
+    }
+    uint32_t old_root = lex->root;
+    publish(&lex->root, relayout_node(lex, lex->slabs, old_root));
+    jump_rebuild(lex);
+    retire_subtree(lex, old_root);
+    lex->shared_words = 0;
+}
+
+/* Function: merge_node
+ * --------------------
+ * Adds the words below the place cur in src to the subtree of dst at *slot, which stands for the
+ * same bytes, and returns how many of them were new. Children that dst lacks are grafted in
+ * whole (see thaw_node); the rest are merged in turn. A word of src with a weight other than 0
+ * gives its weight to the same word in dst. Every node on the way back up is then made weighted
+ * if a child is, and its best weight refreshed, so the weights above the merge stay right.
+ */
+static int merge_node(CLexicon* dst, uint32_t* slot, CLexicon* src, Cursor cur) {
+    int added = 0;
+    for(int sym = 1; ; sym++) {
+        Cursor child = cursor_next(src, cur, &sym);
+        if(child.node == 0) break;
+        LexNode* node = node_at(dst, *slot);
+        uint32_t* child_slot = find_slot(node, node->info, sym);
+        if(child_slot != NULL) {
+            added += merge_node(dst, child_slot, src, child);
+            continue;
+        }
+        const LexNode* from = node_at(src, child.node);
+        uint32_t copy = child.offset == 0 ? thaw_node(dst, src->slabs, child.node) : thaw_chain(dst, src->slabs, from, child.offset);
+        added += node_at(dst, copy)->count;
+        publish(slot, insert_child(dst, *slot, sym, copy));
+    }
+
+    LexNode* node = node_at(dst, *slot);
+    if(cursor_is_word(src, cur)) {
+        if(!(node->info & NODE_WORD)) {
+            set_info(node, node->info | NODE_WORD);
+            added++;
+        }
+        uint32_t weight = load_weight(node_at(src, cur.node));
+        if(weight != 0) {
+            if(!(node->info & NODE_WEIGHTED)) publish(slot, make_weighted(dst, *slot));
+            node = node_at(dst, *slot);
+            set_weight(node, weight);
+        }
+    }
+    bool weighted = false;
+    uint32_t best = (node->info & NODE_WORD) ? load_weight(node) : 0;
+    const uint32_t* children = child_slots(node, node->info);
+    for(int i = child_count(node, node->info) - 1; i >= 0; i--) {
+        const LexNode* child = node_at(dst, children[i]);
+        if(!(child->info & NODE_WEIGHTED)) continue;
+        weighted = true;
+        if(load_best(child) > best) best = load_best(child);
+    }
+    if(weighted && !(node->info & NODE_WEIGHTED)) {
+        publish(slot, make_weighted(dst, *slot));
+        node = node_at(dst, *slot);
+    }
+    if(node->info & NODE_WEIGHTED) set_best(node, best);
+    add_count(node, added);
+    return added;
+}
+
+/* Function: copy_place
+ * ---------------------
+ * Copies everything below the place cur in src into the arena of dst (see thaw_node) and
+ * returns the index of the copy.
+ */
+static uint32_t copy_place(CLexicon* dst, CLexicon* src, Cursor cur) {
+    if(cur.offset == 0) return thaw_node(dst, src->slabs, cur.node);
+    return thaw_chain(dst, src->slabs, node_at(src, cur.node), cur.offset);
+}
+
+/* Function: write_combined
+ * ------------------------
+ * Writes a new node to the arena of lex with the given n children, already in lex, and own word
+ * of the given weight if word is set, and returns its index. Its count and best weight are taken
+ * from the children, and it is weighted if its word has a weight or a child is weighted.
+ */
+static uint32_t write_combined(CLexicon* lex, bool word, uint32_t weight, const uint8_t* symbols, const uint32_t* children, int n) {
+    //The header is that of a WeightedNode, which write_node shortens if nothing is weighted.
+    uint32_t header[4] = { word ? NODE_WORD : 0, word ? 1 : 0, weight, weight };
+    bool weighted = weight != 0;
+    for(int i = 0; i < n; i++) {
+        const LexNode* child = node_at(lex, children[i]);
+        header[1] += child->count;
+        if(!(child->info & NODE_WEIGHTED)) continue;
+        weighted = true;
+        if(load_best(child) > header[3]) header[3] = load_best(child);
+    }
+    if(weighted) header[0] |= NODE_WEIGHTED;
+    uint32_t node[MAX_NODE_WORDS];
+    uint32_t nwords = write_node(node, header, symbols, children, n);
+    uint32_t index = alloc_node(lex, nwords);
+    memcpy(node_at(lex, index), node, nwords * sizeof(uint32_t));
+    return index;
+}
+
+/* Function: combine_node
+ * ----------------------
+ * Builds the node of builder->out for the places ca in a and cb in b, which stand for the same
+ * bytes, with the words below them that builder->op keeps, and returns its index, or 0 if no
+ * word is kept. A place missing from one side has node 0. The children of both are walked in
+ * lockstep, each pair combined in turn before the node is written; a subtree that is kept whole,
+ * because the other side has nothing there, is copied node for node instead. Words keep the
+ * weight they have in a, or else in b. At the root (top) only the children and word given to the
+ * builder's shard are combined.
+ */
+static uint32_t combine_node(const SetBuilder* builder, Cursor ca, Cursor cb, bool top) {
+    int op = builder->op;
+    if(!top && cb.node == 0) return op == SET_INTERSECT ? 0 : copy_place(builder->out, builder->a, ca);
+    if(!top && ca.node == 0) return op == SET_UNION ? copy_place(builder->out, builder->b, cb) : 0;
+
+    CLexicon* a = builder->a;
+    CLexicon* b = builder->b;
+    uint8_t symbols[MAX_CHILDREN];
+    uint32_t children[MAX_CHILDREN];
+    int n = 0;
+    int sa = 1, sb = 1;
+    Cursor na = cursor_next(a, ca, &sa);
+    Cursor nb = cursor_next(b, cb, &sb);
+    //Past the last child of a, only a union has anything left to take from b.
+    while(na.node != 0 || (op == SET_UNION && nb.node != 0)) {
+        int sym = na.node == 0 ? sb : nb.node == 0 || sa < sb ? sa : sb;
+        Cursor xa = na.node != 0 && sa == sym ? na : (Cursor){ 0, 0 };
+        Cursor xb = nb.node != 0 && sb == sym ? nb : (Cursor){ 0, 0 };
+        if(!top || builder->shard_of[sym] == builder->shard) {
+            uint32_t child = combine_node(builder, xa, xb, false);
+            if(child != 0) {
+                symbols[n] = sym;
+                children[n++] = child;
+            }
+        }
+        if(xa.node != 0) {
+            sa++;
+            na = cursor_next(a, ca, &sa);
+        }
+        if(xb.node != 0) {
+            sb++;
+            nb = cursor_next(b, cb, &sb);
+        }
+    }
+
+    bool in_a = cursor_is_word(a, ca);
+    bool in_b = cursor_is_word(b, cb);
+    bool word = op == SET_UNION ? in_a || in_b : op == SET_INTERSECT ? in_a && in_b : in_a && !in_b;
+    if(top && builder->shard != 0) word = false;
+    if(!word && n == 0) return 0;
+    uint32_t weight = 0;
+    if(word && in_a) weight = load_weight(node_at(a, ca.node));
+    if(word && weight == 0 && in_b) weight = load_weight(node_at(b, cb.node));
+    return write_combined(builder->out, word, weight, symbols, children, n);
+}
+
+/* Function: relocate_node
+ * -----------------------
+ * Adds delta to the index of every child in the subtree at index, whose nodes are about to be
+ * moved delta words along in the index space of another lexicon.
+ */
+static void relocate_node(CLexicon* lex, uint32_t index, uint32_t delta) {
+    LexNode* node = node_at(lex, index);
+    uint32_t* children = child_slots(node, node->info);
+    int nchildren = child_count(node, node->info);
+    for(int i = 0; i < nchildren; i++) {
+        relocate_node(lex, children[i], delta);
+        children[i] += delta;
+    }
+}
+
+/* Function: build_set_shard
+ * -------------------------
+ * Thread body of a SetBuilder: combines the shard's part of the two roots into a new root in out.
+ */
+static void* build_set_shard(void* arg) {
+    SetBuilder* builder = arg;
+    builder->root = combine_node(builder, (Cursor){ builder->a->root, 0 }, (Cursor){ builder->b->root, 0 }, true);
+    return NULL;
+}
+
+/* Function: relocate_graft
+ * ------------------------
+ * Thread body of a Graft: relocates everything below its root by its delta.
+ */
+static void* relocate_graft(void* arg) {
+    Graft* graft = arg;
+    if(graft->root != 0) relocate_node(graft->shard, graft->root, graft->delta);
+    return NULL;
+}
+
+/* Function: run_builders
+ * ----------------------
+ * Runs body on each of the n builders, which are size bytes apart, every one but the first on a
+ * thread of its own. A builder whose thread could not be started is run on the calling thread
+ * instead.
+ */
+static void run_builders(void* builders, size_t size, int n, void* (*body)(void*)) {
+    pthread_t threads[MAX_BUILD_THREADS];
+    bool started[MAX_BUILD_THREADS] = { false };
+    for(int t = 1; t < n; t++) {
+        started[t] = pthread_create(&threads[t], NULL, body, (char*)builders + t * size) == 0;
+    }
+    for(int t = 0; t < n; t++) {
+        if(!started[t]) body((char*)builders + t * size);
+    }
+    for(int t = 0; t < n; t++) {
+        if(started[t]) pthread_join(threads[t], NULL);
+    }
+}
+
+/* Function: assign_shards
+ * -----------------------
+ * Hands the symbols with words out to at most nthreads shards, the most words first, each to
+ * the shard with the fewest words so far, and returns how many shards there are. counts holds
+ * the number of words below each symbol; symbols without any go to shard 0.
+ */
+static int assign_shards(const uint64_t* counts, int nthreads, uint8_t* shard_of) {
+    int nsymbols = 0;
+    uint8_t symbols[NUM_SYMBOLS];
+    for(int c = 1; c < NUM_SYMBOLS; c++) {
+        if(counts[c] > 0) symbols[nsymbols++] = c;
+    }
+    if(nthreads > nsymbols) nthreads = nsymbols;
+    if(nthreads > MAX_BUILD_THREADS) nthreads = MAX_BUILD_THREADS;
+    if(nthreads < 1) nthreads = 1;
+    //Sorts the symbols by count, most words first, with an insertion sort since there are few.
+    for(int i = 1; i < nsymbols; i++) {
+        uint8_t c = symbols[i];
+        int j = i;
+        for(; j > 0 && counts[symbols[j - 1]] < counts[c]; j--) symbols[j] = symbols[j - 1];
+        symbols[j] = c;
+    }
+    memset(shard_of, 0, NUM_SYMBOLS);
+    uint64_t load[MAX_BUILD_THREADS] = { 0 };
+    for(int i = 0; i < nsymbols; i++) {
+        int lightest = 0;
+        for(int t = 1; t < nthreads; t++) {
+            if(load[t] < load[lightest]) lightest = t;
+        }
+        shard_of[symbols[i]] = lightest;
+        load[lightest] += counts[symbols[i]];
+    }
+    return nthreads;
+}
+
+/* Function: graft_shards
+ * ----------------------
+ * Appends the slabs of the n shards to the slabs table of lex, once every child index in them
+ * has been moved along to where their slabs end up (see relocate_graft), and deletes what is
+ * left of the shards. The root children of each shard are stored in child_of_symbol, for the
+ * caller to link them into lex; the roots themselves are released, as are the free nodes of the
+ * shards and the unused ends of every slab but the last (see release_span), which becomes the
+ * one lex carves new nodes from. Nothing in the slabs has been seen by a reader.
+ */
+static void graft_shards(CLexicon* lex, Graft* grafts, int n, uint32_t* child_of_symbol) {
+    uint32_t nslabs = lex->nslabs;
+    for(int t = 0; t < n; t++) {
+        grafts[t].delta = nslabs << SLAB_SHIFT;
+        nslabs += grafts[t].shard->nslabs;
+    }
+    run_builders(grafts, sizeof(Graft), n, relocate_graft);
+    grow_slabs(lex, nslabs);
+
+    for(int t = 0; t < n; t++) {
+        CLexicon* shard = grafts[t].shard;
+        uint32_t delta = grafts[t].delta;
+        if(lex->nslabs > 0) release_span(lex, ((lex->nslabs - 1) << SLAB_SHIFT) | lex->slab_used, SLAB_WORDS - lex->slab_used);
+        memcpy(&lex->slabs[lex->nslabs], shard->slabs, shard->nslabs * sizeof(uint32_t*));
+        lex->nslabs += shard->nslabs;
+        lex->slab_used = shard->slab_used;
+        for(uint32_t nwords = 0; nwords <= MAX_NODE_WORDS; nwords++) {
+            if(shard->freelists[nwords] == 0) continue;
+            uint32_t index = shard->freelists[nwords] + delta;
+            for(; node_at(lex, index)->info != 0; index = node_at(lex, index)->info) {
+                node_at(lex, index)->info += delta;
+            }
+            node_at(lex, index)->info = lex->freelists[nwords];
+            lex->freelists[nwords] = shard->freelists[nwords] + delta;
+        }
+        if(grafts[t].root != 0) {
+            const LexNode* node = node_at(lex, grafts[t].root + delta);
+            for(int sym = 1; ; sym++) {
+                uint32_t child = next_child(node, node->info, &sym);
+                if(child == 0) break;
+                child_of_symbol[sym] = child;
+            }
+            release_node(lex, grafts[t].root + delta);
+        }
+        if(shard->root != grafts[t].root) release_node(lex, shard->root + delta);
+        //Its slabs belong to lex now, so only the table and the struct go.
+        shard->nslabs = 0;
+        clex_delete(shard);
+    }
+}
+
+/* Function: combine_lexicons
+ * --------------------------
+ * Does the work of clex_union, clex_intersect and clex_difference. With more than one thread,
+ * the root children of a are handed out to shards by their word counts (see assign_shards), and
+ * each shard builds its part into a private lexicon. Rather than being copied into the result,
+ * the shards' slabs are then appended to its slabs table (see graft_shards); only the root is
+ * written anew. Both lexicons are locked as for clex_merge.
+ */
+static CLexicon* combine_lexicons(CLexicon* a, CLexicon* b, int op, int nthreads) {
+    CLexicon* first = a < b ? a : b;
+    CLexicon* second = a < b ? b : a;
+    writer_lock(first);
+    if(second != first) writer_lock(second);
+
+    uint64_t counts[NUM_SYMBOLS] = { 0 };
+    for(int sym = 1; ; sym++) {
+        Cursor child = cursor_next(a, (Cursor){ a->root, 0 }, &sym);
+        if(child.node == 0) break;
+        counts[sym] = cursor_node(a, child)->count;
+    }
+    //Children only b has go to shard 0.
+    uint8_t shard_of[NUM_SYMBOLS];
+    nthreads = assign_shards(counts, nthreads, shard_of);
+
+    CLexicon* out = clex_create_with_allocator(&a->allocator);
+    SetBuilder builders[MAX_BUILD_THREADS];
+    for(int t = 0; t < nthreads; t++) {
+        builders[t] = (SetBuilder){ nthreads == 1 ? out : clex_create_with_allocator(&a->allocator), a, b, op, shard_of, t, 0 };
+    }
+    run_builders(builders, sizeof(SetBuilder), nthreads, build_set_shard);
+    uint32_t root = builders[0].root;
+    if(nthreads > 1) {
+        //The word of the empty prefix is read before the root of shard 0 is released.
+        const LexNode* word_root = builders[0].root == 0 ? NULL : node_at(builders[0].out, builders[0].root);
+        bool word = word_root != NULL && (word_root->info & NODE_WORD);
+        uint32_t weight = word ? load_weight(word_root) : 0;
+        Graft grafts[MAX_BUILD_THREADS];
+        for(int t = 0; t < nthreads; t++) {
+            grafts[t] = (Graft){ builders[t].out, builders[t].root, 0 };
+        }
+        uint32_t child_of_symbol[NUM_SYMBOLS] = { 0 };
+        graft_shards(out, grafts, nthreads, child_of_symbol);
+        //The shards' children are interleaved in symbol order, as write_node wants them.
+        int n = 0;
+        uint8_t root_symbols[MAX_CHILDREN];
+        uint32_t root_children[MAX_CHILDREN];
+        for(int sym = 1; sym < NUM_SYMBOLS; sym++) {
+            if(child_of_symbol[sym] == 0) continue;
+            root_symbols[n] = sym;
+            root_children[n++] = child_of_symbol[sym];
+        }
+        root = word || n > 0 ? write_combined(out, word, weight, root_symbols, root_children, n) : 0;
+    }
+    if(root != 0) {
+        release_node(out, out->root);
+        out->root = root;
+        out->wordcount = node_at(out, root)->count;
+    }
+    jump_rebuild(out);
+
+    if(second != first) writer_unlock(second);
+    writer_unlock(first);
+    return out;
+}
+
+/* Function: find_index
+ * ---------------------
+ * Traverses the tree from the root along word, folding case through fold_case as it goes, and
+ * returns the index of the node the word ends at. len is as for word_length. Returns 0 if the tree
+ * ends first or word contains a '\0' within len bytes. The number of bytes walked is stored in
+ * wordlen. Used by writers, which thaw a frozen lexicon first and so never meet a chain node;
+ * readers use find_cursor.
+ */
+static inline uint32_t find_index(CLexicon* lex, const char* word, size_t len, size_t* wordlen) {
+    uint32_t curr = load_slot(&lex->root);
+    size_t i = 0;
+    for(; i < len; i++) {
+        uint8_t c = fold_case[(uint8_t)word[i]];
+        if(c == 0) {
+            //The terminator is only looked for on this path, so other bytes cost one table lookup.
+            if(len == NUL_TERMINATED) break;
+            return 0;
+        }
+        //If the tree ends before target node is reached, there is no such node.
+        curr = child_of(node_at(lex, curr), c);
+        if(curr == 0) return 0;
+    }
+    *wordlen = i;
+    return curr;
+}
+
+/* Function: find_node
+ * -------------------
+ * As find_index, but returns a pointer to the node, or NULL if there is none.
+ */
+static inline LexNode* find_node(CLexicon* lex, const char* word, size_t len, size_t* wordlen) {
+    uint32_t index = find_index(lex, word, len, wordlen);
+    return index == 0 ? NULL : node_at(lex, index);
+}
+
+/* Function: find_cursor
+ * ----------------------
+ * As find_index, but for readers, which may be walking a frozen image: returns the place the
+ * word ends at, which may be partway along a chain node, or a cursor at node 0 if there is none.
+ * The word is compared with a chain's whole label in one tight loop, folding each of its bytes,
+ * instead of taking one node per byte. A word beginning with two letters starts at their place
+ * in the jump table (see jump_place).
+ */
+static inline Cursor find_cursor(CLexicon* lex, const char* word, size_t len, size_t* wordlen) {
+    Cursor cur = { load_slot(&lex->root), 0 };
+    size_t i = 0;
+    int key = len >= 2 ? jump_key(word) : -1;
+    if(key >= 0) {
+        cur = jump_place(lex, key);
+        if(cur.node == 0) return cur;
+        i = 2;
+    }
+    while(i < len) {
+        uint8_t c = fold_case[(uint8_t)word[i]];
+        if(c == 0) {
+            if(len == NUL_TERMINATED) break;
+            return (Cursor){ 0, 0 };
+        }
+        const LexNode* node = node_at(lex, cur.node);
+        uint32_t info = load_info(node);
+        COUNT(lex, COUNT_NODES, 1);
+        if(!is_chain(info)) {
+            cur.node = child_of(node, c);
+            if(cur.node == 0) return cur;
+            i++;
+            continue;
+        }
+        //Only a place from the jump table can start partway along a label.
+        const uint8_t* label = chain_label(node, info);
+        uint32_t length = chain_length(info);
+        uint32_t k = cur.offset;
+        while(k < length && i < len && fold_case[(uint8_t)word[i]] == label[k]) {
+            k++;
+            i++;
+        }
+        if(k < length) {
+            //No label byte is '\0', so the word either ends here or leaves the chain.
+            if(i < len && (word[i] != '\0' || len != NUL_TERMINATED)) return (Cursor){ 0, 0 };
+            cur.offset = k;
+            break;
+        }
+        cur = (Cursor){ load_slot(child_slots(node, info)), 0 };
+    }
+    *wordlen = i;
+    return cur;
+}
+
+/* Function: word_length
+ * ---------------------
+ * Returns the number of bytes in word, reading len bytes, or up to the first '\0' when len is
+ * NUL_TERMINATED. Returns -1 if a '\0' comes within len bytes, since no word can hold one, so
+ * that callers can refuse a word before changing the tree.
+ */
+static inline long word_length(const char* word, size_t len) {
+    if(len == NUL_TERMINATED) return strlen(word);
+    return memchr(word, '\0', len) == NULL ? (long)len : -1;
+}
+
+/* Function: own_path
+ * ------------------
+ * Makes sure that no node on the path of the len bytes of word, as far as it exists, is shared
+ * with a snapshot, so that it can be changed in place. Each shared node is copied, from the root
+ * down, and its copy published in place of it; the copy still shares the node's children. The
+ * node itself is deferred until no snapshot holds it.
+ */
+static void own_path(CLexicon* lex, const char* word, long len) {
+    if(lex->shared_words == 0) return;
+    uint32_t* slot = &lex->root;
+    for(long i = 0; ; i++) {
+        uint32_t index = *slot;
+        if(index < lex->shared_words) {
+            uint32_t nwords = node_words(node_at(lex, index));
+            uint32_t copy = alloc_node(lex, nwords);
+            memcpy(node_at(lex, copy), node_at(lex, index), nwords * sizeof(uint32_t));
+            publish(slot, copy);
+            retire_node(lex, index);
+        }
+        if(i == len) return;
+        LexNode* node = node_at(lex, *slot);
+        slot = find_slot(node, node->info, fold_case[(uint8_t)word[i]]);
+        if(slot == NULL) return;
+    }
+}
+
+/* Functions: reverse_add, reverse_remove
+ * --------------------------------------
+ * Add the len bytes of word to the lexicon's suffix index spelled backwards, or remove them.
+ */
+static void reverse_add(CLexicon* lex, const char* word, long len) {
+    char reversed[MAX_WORD_LEN + 1];
+    for(long i = 0; i < len; i++) reversed[i] = word[len - 1 - i];
+    clex_add_n(lex->reversed, reversed, len);
+}
+
+static void reverse_remove(CLexicon* lex, const char* word, long len) {
+    char reversed[MAX_WORD_LEN + 1];
+    for(long i = 0; i < len; i++) reversed[i] = word[len - 1 - i];
+    clex_remove_n(lex->reversed, reversed, len);
+}
+
+/* Function: reverse_subtree
+ * -------------------------
+ * Removes from the suffix index every word below the node at index, whose first depth bytes are
+ * in word already, before the subtree is cut off. The lexicon must not be frozen.
+ */
+static void reverse_subtree(CLexicon* lex, uint32_t index, char* word, int depth) {
+    const LexNode* node = node_at(lex, index);
+    if(node->info & NODE_WORD) reverse_remove(lex, word, depth);
+    for(int sym = 1; ; sym++) {
+        uint32_t child = next_child(node, node->info, &sym);
+        if(child == 0) break;
+        word[depth] = sym;
+        reverse_subtree(lex, child, word, depth + 1);
+    }
+}
+
+/* Function: add_reversed
+ * ----------------------
+ * CLexVisitor for reverse_rebuild, which adds each word to the suffix index given as context.
+ */
+static bool add_reversed(void* context, const char* word, size_t len) {
+    char reversed[MAX_WORD_LEN + 1];
+    for(size_t i = 0; i < len; i++) reversed[i] = word[len - 1 - i];
+    clex_add_n(context, reversed, len);
+    return true;
+}
+
+/* Function: reverse_rebuild
+ * -------------------------
+ * Fills the suffix index anew from every word of the lexicon, after a change too large to follow
+ * word by word. Does nothing if the lexicon has no suffix index.
+ */
+static void reverse_rebuild(CLexicon* lex) {
+    if(lex->reversed == NULL) return;
+    clex_clear(lex->reversed);
+    clex_visit_prefix(lex, "", add_reversed, lex->reversed);
+}
+
+/* Fuction: clex_simple_add
+ * ------------------------
+ * Adds a word of wordlen bytes to the lexicon, folding its case on the way through
+ * fold_case. The word must already have been checked with word_length. Retains the
+ * "clex" prefix because it could theoretically be listed in the header file and considered
+ * available for client use. Remains hidden now for the sake of simplicity of presentation.
+ */
+static inline void clex_simple_add(CLexicon* lex, const char* word, long wordlen) {
+    //The walk down counts the word in every node on its path, so it must be known to be new.
+    size_t walked;
+    LexNode* existing = find_node(lex, word, wordlen, &walked);
+    if(existing != NULL && (existing->info & NODE_WORD)) return;
+    own_path(lex, word, wordlen);
+
+    //For every character in the word, accesses (or creates) subnodes. slot always holds
+    //the index of the current node, so that a reallocated node can be relinked.
+    uint32_t* slot = &lex->root;
+    for(long i = 0; i < wordlen; i++) {
+        int c = fold_case[(uint8_t)word[i]];
+        LexNode* node = node_at(lex, *slot);
+        if(child_of(node, c) == 0) {
+            publish(slot, insert_child(lex, *slot, c, create_node(lex)));
+            node = node_at(lex, *slot);
+        }
+        add_count(node, 1);
+        slot = find_slot(node, node->info, c);
+    }
+    LexNode* last_node = node_at(lex, *slot);
+    add_count(last_node, 1);
+    set_info(last_node, last_node->info | NODE_WORD);
+    add_words(lex, 1);
+    if(lex->reversed != NULL) reverse_add(lex, word, wordlen);
+}
+
+/* Function: refresh_best
+ * ------------------------
+ * Recomputes the best weight of the nodes on the path of the len bytes of word, deepest
+ * first, after a weight on the path has changed or part of it has been cut off. The path is
+ * followed only as far as it still exists. A node's best is the weight of its own word or the
+ * best of a child, whichever is greater; once a node's best comes out unchanged, so will that
+ * of every node above it. Nodes that are not weighted have nothing weighted below them either.
+ */
+static void refresh_best(CLexicon* lex, const char* word, long len) {
+    if(!(node_at(lex, lex->root)->info & NODE_WEIGHTED)) return;
+    uint32_t path[MAX_WORD_LEN + 1];
+    path[0] = lex->root;
+    long depth = 0;
+    while(depth < len) {
+        uint32_t child = child_of(node_at(lex, path[depth]), fold_case[(uint8_t)word[depth]]);
+        if(child == 0) break;
+        path[++depth] = child;
+    }
+    for(long d = depth; d >= 0; d--) {
+        LexNode* node = node_at(lex, path[d]);
+        if(!(node->info & NODE_WEIGHTED)) return;
+        uint32_t best = (node->info & NODE_WORD) ? load_weight(node) : 0;
+        const uint32_t* children = child_slots(node, node->info);
+        int nchildren = child_count(node, node->info);
+        for(int i = 0; i < nchildren; i++) {
+            uint32_t child_best = load_best(node_at(lex, children[i]));
+            if(child_best > best) best = child_best;
+        }
+        if(best == load_best(node)) return;
+        set_best(node, best);
+    }
+}
+
+/* Function: weigh_word
+ * --------------------
+ * Adds a word of wordlen bytes, which must already have been checked with word_length, if
+ * it is not in the lexicon yet, and sets its weight. Every node on its path is made weighted
+ * on the way down, so that the best weights above it can be kept.
+ */
+static void weigh_word(CLexicon* lex, const char* word, long wordlen, uint32_t weight) {
+    clex_simple_add(lex, word, wordlen);
+    own_path(lex, word, wordlen);
+    uint32_t* slot = &lex->root;
+    for(long i = 0; ; i++) {
+        if(!(node_at(lex, *slot)->info & NODE_WEIGHTED)) publish(slot, make_weighted(lex, *slot));
+        LexNode* node = node_at(lex, *slot);
+        if(i == wordlen) {
+            set_weight(node, weight);
+            break;
+        }
+        slot = find_slot(node, node->info, fold_case[(uint8_t)word[i]]);
+    }
+    refresh_best(lex, word, wordlen);
+}
+
+/* Function: common_prefix
+ * -----------------------
+ * Returns the length of the longest common prefix of two words of symbols.
+ */
+static inline int common_prefix(const uint8_t* a, int alen, const uint8_t* b, int blen) {
+    int common = 0;
+    while(common < alen && common < blen && a[common] == b[common]) common++;
+    return common;
+}
+
+/* Function: fold_block
+ * --------------------
+ * Folds n bytes in place as fold_case does, sixteen at a time where the machine has vector
+ * instructions for it, and returns true if any of them is a '\0'. Capital letters are the only
+ * bytes fold_case changes, and each is changed by setting the same bit.
+ */
+static bool fold_block(uint8_t* bytes, size_t n) {
+    size_t i = 0;
+    bool nul = false;
+#if defined(__SSE2__)
+    __m128i nuls = _mm_setzero_si128();
+    for(; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+        //Bytes from 0x80 up compare as negative, so they are never taken for capitals.
+        __m128i capitals = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+        nuls = _mm_or_si128(nuls, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i*)(bytes + i), _mm_or_si128(v, _mm_and_si128(capitals, _mm_set1_epi8('a' - 'A'))));
+    }
+    nul = _mm_movemask_epi8(nuls) != 0;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    uint8x16_t nuls = vdupq_n_u8(0);
+    for(; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(bytes + i);
+        uint8x16_t capitals = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(ALPHA_SIZE));
+        nuls = vorrq_u8(nuls, vceqq_u8(v, vdupq_n_u8(0)));
+        vst1q_u8(bytes + i, vorrq_u8(v, vandq_u8(capitals, vdupq_n_u8('a' - 'A'))));
+    }
+    nul = vmaxvq_u8(nuls) != 0;
+#endif
+    for(; i < n; i++) {
+        bytes[i] = fold_case[bytes[i]];
+        nul |= bytes[i] == 0;
+    }
+    return nul;
+}
+
+/* Function: read_word_file
+ * ------------------------
+ * Reads a word file in blocks of LOAD_BUFFER_SIZE bytes, splits it into lines by hand, and
+ * passes each line to handler as symbols. Each block is folded to lower case as it is read
+ * (see fold_block), so lines are handed over straight from the buffer, and a trailing carriage
+ * return is ignored. Every other byte is part of the word. Returns false if the file cannot be
+ * read, if a line is empty, longer than MAX_WORD_LEN, or contains a '\0', or if the handler
+ * returns false.
+ */
+static bool read_word_file(CLexicon* lex, FILE* file, WordHandler handler, void* state) {
+    char* buffer = lex->allocator.alloc(lex->allocator.context, LOAD_BUFFER_SIZE);
+    size_t buffered = 0;
+    bool successful = true;
+    bool nuls = false;      //whether some block had a '\0', so that lines must be checked for one
+    //Reads blocks from the file, handing every complete line in the block to the handler.
+    while(successful) {
+        size_t nread = fread(buffer + buffered, 1, LOAD_BUFFER_SIZE - buffered, file);
+        if(fold_block((uint8_t*)buffer + buffered, nread)) nuls = true;
+        char* end = buffer + buffered + nread;
+        char* line = buffer;
+        char* newline = NULL;
+        //Carries a partial last line over to the next block; at the end of the file it is the last word.
+        if(nread == 0) {
+            if(ferror(file)) successful = false;
+            if(line == end) break;
+            newline = end;
+        }
+        while(successful && (newline != NULL || (newline = memchr(line, '\n', end - line)) != NULL)) {
+            size_t len = newline - line;
+            if(len > 0 && line[len - 1] == '\r') len--;
+            successful = len > 0 && len <= MAX_WORD_LEN && !(nuls && memchr(line, '\0', len) != NULL);
+            if(successful) successful = handler(state, (const uint8_t*)line, len);
+            line = newline < end ? newline + 1 : end;
+            newline = NULL;
+        }
+        if(nread == 0) break;
+        buffered = end - line;
+        memmove(buffer, line, buffered);
+        //A line that fills the whole buffer is far too long to be a word.
+        if(buffered == LOAD_BUFFER_SIZE) successful = false;
+    }
+
+    lex->allocator.free(lex->allocator.context, buffer, LOAD_BUFFER_SIZE);
+    return successful;
+}
+
+/* Function: loader_flush
+ * -----------------------
+ * Adds the pending word counts to the nodes the loader holds below depth, which it is about to
+ * leave. Flushing below depth -1 settles every count at the end of a file.
+ */
+static void loader_flush(WordLoader* loader, int depth) {
+    for(int d = depth + 1; d <= loader->wordlen; d++) {
+        if(loader->pending[d] == 0) continue;
+        add_count(node_at(loader->lex, *loader->slots[d]), loader->pending[d]);
+        loader->pending[d] = 0;
+    }
+}
+
+/* Function: loader_add_word
+ * -------------------------
+ * WordHandler for clex_add_from_file. Adds one word to the lexicon; the walk down the tree
+ * resumes at the end of the prefix shared with the previous word instead of at the root,
+ * which for sorted input skips most of each word.
+ */
+static bool loader_add_word(void* state, const uint8_t* word, int len) {
+    WordLoader* loader = state;
+    int common = common_prefix(loader->word, loader->wordlen, word, len);
+    loader_flush(loader, common);
+    memcpy(loader->word + common, word + common, len - common);
+
+    CLexicon* lex = loader->lex;
+    uint32_t** slots = loader->slots;
+    for(int d = common; d < len; d++) {
+        LexNode* node = node_at(lex, *slots[d]);
+        slots[d + 1] = find_slot(node, node->info, loader->word[d]);
+        if(slots[d + 1] == NULL) {
+            //Only slots above this depth stay valid, and they are the only ones reused.
+            publish(slots[d], insert_child(lex, *slots[d], loader->word[d], create_node(lex)));
+            node = node_at(lex, *slots[d]);
+            slots[d + 1] = find_slot(node, node->info, loader->word[d]);
+        }
+    }
+    loader->wordlen = len;
+
+    LexNode* last_node = node_at(lex, *slots[len]);
+    if(!(last_node->info & NODE_WORD)) {
+        set_info(last_node, last_node->info | NODE_WORD);
+        add_words(lex, 1);
+        for(int d = 0; d <= len; d++) {
+            loader->pending[d]++;
+        }
+    }
+    return true;
+}
+
+/* Function: read_whole_file
+ * ---------------------------
+ * Reads all of file into a buffer from the lexicon's allocator, which grows by doubling, and
+ * returns it, with its length in size and its capacity in capacity. Returns NULL if the file
+ * cannot be read.
+ */
+static uint8_t* read_whole_file(CLexicon* lex, FILE* file, size_t* size, size_t* capacity) {
+    *capacity = LOAD_BUFFER_SIZE;
+    *size = 0;
+    uint8_t* buffer = lex->allocator.alloc(lex->allocator.context, *capacity);
+    size_t nread;
+    while((nread = fread(buffer + *size, 1, *capacity - *size, file)) > 0) {
+        *size += nread;
+        if(*size < *capacity) continue;
+        uint8_t* grown = lex->allocator.alloc(lex->allocator.context, *capacity * 2);
+        memcpy(grown, buffer, *size);
+        lex->allocator.free(lex->allocator.context, buffer, *capacity);
+        buffer = grown;
+        *capacity *= 2;
+    }
+    if(ferror(file)) {
+        lex->allocator.free(lex->allocator.context, buffer, *capacity);
+        return NULL;
+    }
+    return buffer;
+}
+
+/* Function: slice_words
+ * ---------------------
+ * The pass of clex_add_from_file_parallel over the whole file, which splits it into lines as
+ * read_word_file does, counts the words by their symbol (see fold_case) in an array of
+ * NUM_SYMBOLS counts, and cuts it into WordSlices, one for each run of lines beginning with the
+ * same symbol. Only the first byte of each line is folded here; the shards fold the rest, and
+ * find any '\0'. The slices are kept in a growing array from the lexicon's allocator. Returns
+ * false if a line is empty or longer than MAX_WORD_LEN.
+ */
+static bool slice_words(CLexicon* lex, const uint8_t* file, size_t size, uint64_t* counts, WordSlice** slices, size_t* nslices, size_t* capacity) {
+    *capacity = 64;
+    *nslices = 0;
+    *slices = lex->allocator.alloc(lex->allocator.context, *capacity * sizeof(WordSlice));
+    for(size_t line = 0; line < size; ) {
+        const uint8_t* newline = memchr(file + line, '\n', size - line);
+        size_t end = newline != NULL ? (size_t)(newline - file) : size;
+        size_t len = end - line;
+        if(len > 0 && file[end - 1] == '\r') len--;
+        if(len == 0 || len > MAX_WORD_LEN) return false;
+        uint8_t symbol = fold_case[file[line]];
+        counts[symbol]++;
+        if(*nslices == 0 || (*slices)[*nslices - 1].symbol != symbol) {
+            if(*nslices == *capacity) {
+                WordSlice* grown = lex->allocator.alloc(lex->allocator.context, *capacity * 2 * sizeof(WordSlice));
+                memcpy(grown, *slices, *nslices * sizeof(WordSlice));
+                lex->allocator.free(lex->allocator.context, *slices, *capacity * sizeof(WordSlice));
+                *slices = grown;
+                *capacity *= 2;
+            }
+            (*slices)[(*nslices)++] = (WordSlice){ line, 0, symbol };
+        }
+        line = newline != NULL ? end + 1 : size;
+        (*slices)[*nslices - 1].end = line;
+    }
+    return true;
+}
+
+/* Function: build_shard
+ * ---------------------
+ * Thread body of a ShardBuilder: folds the shard's own slices in place a slice at a time (see
+ * fold_block) and loads their lines, which slice_words has already checked for length.
+ */
+static void* build_shard(void* arg) {
+    ShardBuilder* shard = arg;
+    shard->successful = true;
+    for(size_t i = 0; i < shard->nslices && shard->successful; i++) {
+        const WordSlice* slice = &shard->slices[i];
+        if(shard->shard_of[slice->symbol] != shard->shard) continue;
+        uint8_t* end = shard->file + slice->end;
+        uint8_t* line = shard->file + slice->start;
+        bool nuls = fold_block(line, end - line);
+        while(shard->successful && line < end) {
+            uint8_t* newline = memchr(line, '\n', end - line);
+            if(newline == NULL) newline = end;
+            size_t len = newline - line;
+            if(line[len - 1] == '\r') len--;
+            shard->successful = !(nuls && memchr(line, '\0', len) != NULL) && loader_add_word(&shard->loader, line, len);
+            line = newline + 1;
+        }
+    }
+    loader_flush(&shard->loader, -1);
+    return NULL;
+}
+
+/* Function: builder_register
+ * --------------------------
+ * Writes the open node at depth to the register and returns its index there. Its children are
+ * all registered by now, so its word count is its own word plus theirs.
+ */
+static uint32_t builder_register(DawgBuilder* builder, int depth) {
+    const OpenNode* open = &builder->open[depth];
+    uint32_t header[2] = { open->info, (open->info & NODE_WORD) ? 1 : 0 };
+    for(int i = 0; i < open->nchildren; i++) {
+        header[1] += builder->reg.words[open->children[i] + 1];
+    }
+    uint32_t node[MAX_NODE_WORDS];
+    write_node(node, header, open->symbols, open->children, open->nchildren);
+    return register_node(builder->lex, &builder->reg, node);
+}
+
+/* Function: builder_close
+ * -----------------------
+ * Writes the builder's open nodes deeper than depth to the register, deepest first, filling
+ * each one in as the pending last child of the node above it. After this the nodes above
+ * depth are the only ones still open.
+ */
+static void builder_close(DawgBuilder* builder, int depth) {
+    for(int d = builder->wordlen; d > depth; d--) {
+        uint32_t index = builder_register(builder, d);
+        OpenNode* parent = &builder->open[d - 1];
+        parent->children[parent->nchildren - 1] = index;
+    }
+}
+
+/* Function: builder_add_word
+ * --------------------------
+ * WordHandler for clex_add_from_sorted_file. Every node below the prefix the word shares with
+ * the previous word is complete, since sorted input never returns to it, so those nodes are
+ * registered before new open nodes are started for the rest of the word. Returns false if the
+ * word sorts before the previous one; repeated words are skipped.
+ */
+static bool builder_add_word(void* state, const uint8_t* word, int len) {
+    DawgBuilder* builder = state;
+    int common = common_prefix(builder->word, builder->wordlen, word, len);
+    if(common == len) return common == builder->wordlen;
+    if(common < builder->wordlen && word[common] < builder->word[common]) return false;
+
+    builder_close(builder, common);
+    for(int d = common; d < len; d++) {
+        OpenNode* open = &builder->open[d];
+        open->symbols[open->nchildren++] = word[d];
+        builder->open[d + 1].info = 0;
+        builder->open[d + 1].nchildren = 0;
+    }
+    builder->open[len].info |= NODE_WORD;
+    memcpy(builder->word + common, word + common, len - common);
+    builder->wordlen = len;
+    builder->lex->wordcount++;
+    return true;
+}
+
+/* Function: clex_contains_helper
+ * ------------------------------
+ * Helper method for contains that takes as an argument whether to search for prefix or word.
+ */
+static inline bool clex_contains_helper(CLexicon* lex, const char* word, size_t len, bool isPrefix) {
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    size_t wordlen;
+    Cursor cur = find_cursor(lex, word, len, &wordlen);
+    bool found = false;
+    //The root always exists, so the empty prefix is only contained by a non-empty lexicon.
+    if(cur.node != 0 && isPrefix && wordlen == 0) found = load_wordcount(lex) > 0;
+    //Otherwise a prefix is found if its place is, and a word only if that place is a word.
+    else if(cur.node != 0) found = isPrefix || cursor_is_word(lex, cur);
+    reader_exit(reader, parity);
+    return found;
+}
+
+/* Function: count_lookup
+ * -----------------------
+ * Counts a client's lookup and whether it was found (see COUNT), and returns found. Writers look
+ * words up through clex_contains_helper too, without being counted.
+ */
+static inline bool count_lookup(CLexicon* lex, bool found) {
+    COUNT(lex, COUNT_LOOKUPS, 1);
+    COUNT(lex, found ? COUNT_HITS : COUNT_MISSES, 1);
+    return found;
+}
+
+/* Function: lane_start
+ * --------------------
+ * Starts a BatchLane on words[word], at the place of its first two letters in the jump table if
+ * it has one there (prefetching it like any other node), and at root otherwise. A word whose
+ * prefix is absent from the table also starts at root, and fails on the lane's first turns.
+ */
+static inline void lane_start(CLexicon* lex, BatchLane* lane, const char** words, size_t word, const LexNode* root) {
+    *lane = (BatchLane){ words[word], root, 0, word };
+    int key = jump_key(words[word]);
+    if(key < 0) return;
+    Cursor cur = jump_place(lex, key);
+    if(cur.node == 0) return;
+    lane->rest += 2;
+    lane->node = node_at(lex, cur.node);
+    lane->offset = cur.offset;
+    __builtin_prefetch(lane->node);
+}
+
+/* Function: clex_contains_batch_helper
+ * ------------------------------------
+ * Helper method for the batch functions. Rather than walking one word at a time, keeps
+ * BATCH_LANES walks in flight and advances each of them by one node in turn. Every child
+ * is prefetched when it is found and only read on the lane's next turn, so the cache misses
+ * of the different walks overlap instead of being paid one after another. A lane whose word
+ * is finished takes the next word of the batch.
+ */
+static void clex_contains_batch_helper(CLexicon* lex, const char** words, size_t n, bool* out, bool isPrefix) {
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    BatchLane lanes[BATCH_LANES];
+    const LexNode* root = node_at(lex, load_slot(&lex->root));
+    size_t next_word = 0;
+    int nlanes = 0;
+    while(nlanes < BATCH_LANES && next_word < n) {
+        lane_start(lex, &lanes[nlanes], words, next_word, root);
+        nlanes++;
+        next_word++;
+    }
+
+    while(nlanes > 0) {
+        for(int l = 0; l < nlanes; l++) {
+            BatchLane* lane = &lanes[l];
+            uint8_t ch = *lane->rest;
+            bool finished = true;
+            bool found = false;
+            if(ch == '\0') {
+                //The root always exists, so the empty prefix is only contained by a non-empty lexicon.
+                if(lane->rest == words[lane->word]) found = isPrefix ? load_wordcount(lex) > 0 : (load_info(lane->node) & NODE_WORD);
+                else found = isPrefix || (lane->offset == 0 && (load_info(lane->node) & NODE_WORD));
+            } else {
+                uint32_t info = load_info(lane->node);
+                uint32_t child = 0;
+                if(!is_chain(info)) {
+                    child = child_of(lane->node, fold_case[ch]);
+                    lane->rest++;
+                } else {
+                    //The label is in cache by now, so the lane walks as much of it as the word follows at once.
+                    const uint8_t* label = chain_label(lane->node, info);
+                    uint32_t length = chain_length(info);
+                    uint32_t k = lane->offset;
+                    while(k < length && fold_case[(uint8_t)*lane->rest] == label[k]) {
+                        k++;
+                        lane->rest++;
+                    }
+                    lane->offset = k;
+                    if(k == length) child = load_slot(child_slots(lane->node, info));
+                    //A word that ends inside the label is finished on the lane's next turn.
+                    else if(*lane->rest == '\0') finished = false;
+                }
+                COUNT(lex, COUNT_NODES, 1);
+                if(child != 0) {
+                    lane->node = node_at(lex, child);
+                    lane->offset = 0;
+                    __builtin_prefetch(lane->node);
+                    finished = false;
+                }
+            }
+            if(!finished) continue;
+
+            out[lane->word] = count_lookup(lex, found);
+            if(next_word < n) {
+                lane_start(lex, lane, words, next_word, root);
+                next_word++;
+            } else {
+                //Moves the last lane into this one, and revisits this position.
+                *lane = lanes[--nlanes];
+                l--;
+            }
+        }
+    }
+    reader_exit(reader, parity);
+}
+
+
+/* Functions: pool_range, take_chunk, steal_chunks
+ * -----------------------------------------------
+ * Work-stealing over the chunks of a CLexPool's job (see PoolWorker). take_chunk takes the
+ * first chunk left in a worker's own range. steal_chunks, called once that range is empty,
+ * moves the back half of another worker's range (all of it, if only one chunk is left) into
+ * this one, and returns false if every worker has run out.
+ */
+static inline uint64_t pool_range(uint32_t begin, uint32_t end) {
+    return (uint64_t)end << 32 | begin;
+}
+
+static bool take_chunk(PoolWorker* worker, uint32_t* chunk) {
+    uint64_t range = __atomic_load_n(&worker->range, __ATOMIC_RELAXED);
+    while(true) {
+        uint32_t begin = (uint32_t)range;
+        uint32_t end = range >> 32;
+        if(begin >= end) return false;
+        if(__atomic_compare_exchange_n(&worker->range, &range, pool_range(begin + 1, end), true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *chunk = begin;
+            return true;
+        }
+    }
+}
+
+static bool steal_chunks(CLexPool* pool, PoolWorker* thief) {
+    for(int i = 1; i < pool->nthreads; i++) {
+        PoolWorker* victim = &pool->workers[(thief->index + i) % pool->nthreads];
+        uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_RELAXED);
+        while(true) {
+            uint32_t begin = (uint32_t)range;
+            uint32_t end = range >> 32;
+            if(begin >= end) break;
+            uint32_t middle = end - (end - begin + 1) / 2;
+            if(__atomic_compare_exchange_n(&victim->range, &range, pool_range(begin, middle), true,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&thief->range, pool_range(middle, end), __ATOMIC_RELAXED);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Function: pool_worker
+ * ---------------------
+ * The body of each thread of a CLexPool. Waits for a job, then looks up chunks of it with
+ * clex_contains_batch_helper until there are none left to take or steal, and waits again.
+ */
+static void* pool_worker(void* arg) {
+    PoolWorker* worker = arg;
+    CLexPool* pool = worker->pool;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    while(true) {
+        while(!pool->stopping && pool->generation == seen) pthread_cond_wait(&pool->job_ready, &pool->lock);
+        if(pool->stopping) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        uint32_t chunk;
+        while(true) {
+            if(!take_chunk(worker, &chunk)) {
+                //Whatever was stolen may in turn be stolen before it is taken, so this retries.
+                if(steal_chunks(pool, worker)) continue;
+                break;
+            }
+            size_t first = (size_t)chunk * POOL_CHUNK_WORDS;
+            size_t count = pool->n - first < POOL_CHUNK_WORDS ? pool->n - first : POOL_CHUNK_WORDS;
+            clex_contains_batch_helper(pool->lex, pool->words + first, count, pool->out + first, false);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->busy == 0) pthread_cond_broadcast(&pool->job_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Function: pool_create
+ * ---------------------
+ * Starts a CLexPool of up to nthreads workers whose memory comes from allocator. A pool whose
+ * threads could not be started has none, and looks its jobs up on the thread submitting them.
+ */
+static CLexPool* pool_create(const CLexAllocator* allocator, int nthreads) {
+    if(nthreads < 0) nthreads = 0;
+    CLexPool* pool = allocator->alloc(allocator->context, sizeof(CLexPool));
+    pool->allocator = *allocator;
+    pool->workers = nthreads == 0 ? NULL : allocator->alloc(allocator->context, nthreads * sizeof(PoolWorker));
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->stopping = false;
+    pool->n = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+    pool->nthreads = 0;
+    pool->capacity = nthreads;
+    for(int t = 0; t < nthreads; t++) {
+        PoolWorker* worker = &pool->workers[pool->nthreads];
+        worker->range = 0;
+        worker->pool = pool;
+        worker->index = pool->nthreads;
+        if(pthread_create(&worker->thread, NULL, pool_worker, worker) != 0) break;
+        pool->nthreads++;
+    }
+    return pool;
+}
+
+
+/* Function: find_branch
+ * ----------------------
+ * Walks the len bytes of word, which must already have been checked with word_length, and
+ * returns the index of the node they lead to, or 0 if the tree ends first. Along the way it
+ * remembers the deepest node above that one which must outlive the end node's subtree: the root,
+ * a node with the word flag, or a node with another child. The slot holding that node is stored
+ * in keep_slot and the next symbol on the path in keep_symbol. Every node below it on the path
+ * has a single child and no word flag, so cutting the branch there leaves no dead nodes behind.
+ */
+static uint32_t find_branch(CLexicon* lex, const char* word, long len, uint32_t** keep_slot, int* keep_symbol) {
+    uint32_t* slot = &lex->root;
+    for(long i = 0; i < len; i++) {
+        LexNode* node = node_at(lex, *slot);
+        int c = fold_case[(uint8_t)word[i]];
+        if(i == 0 || (node->info & NODE_WORD) || child_count(node, node->info) > 1) {
+            *keep_slot = slot;
+            *keep_symbol = c;
+        }
+        slot = find_slot(node, node->info, c);
+        if(slot == NULL) return 0;
+    }
+    return *slot;
+}
+
+/* Function: adjust_counts
+ * -----------------------
+ * Adds delta to the word count of every node on the path of the len bytes of word, from the
+ * root down to the node the path ends at. The path must exist.
+ */
+static void adjust_counts(CLexicon* lex, const char* word, long len, int delta) {
+    LexNode* node = node_at(lex, lex->root);
+    add_count(node, delta);
+    for(long i = 0; i < len; i++) {
+        node = node_at(lex, child_of(node, fold_case[(uint8_t)word[i]]));
+        add_count(node, delta);
+    }
+}
+
+/* Function: cut_branch
+ * --------------------
+ * Unlinks the child under symbol sym from the node at slot and retires the child along with
+ * everything beneath it. The words it held must already have been counted off.
+ */
+static void cut_branch(CLexicon* lex, uint32_t* slot, int sym) {
+    uint32_t branch = child_of(node_at(lex, *slot), sym);
+    publish(slot, remove_child(lex, *slot, sym));
+    retire_subtree(lex, branch);
+}
+
+/* Function: remove_word_helper
+ * ----------------------------
+ * Does the work of clex_remove_n for a word of wordlen bytes, with the writer lock held.
+ * Clearing the word flag is enough while the word's node still has children; otherwise the
+ * branch is cut at the point found by find_branch, so a removal only touches the word's path.
+ */
+static bool remove_word_helper(CLexicon* lex, const char* word, long wordlen) {
+    if(lex->image != NULL) {
+        if(!clex_contains_helper(lex, word, wordlen, false)) return false;
+        thaw(lex);
+    }
+    if(lex->shared_words != 0) {
+        if(!clex_contains_helper(lex, word, wordlen, false)) return false;
+        own_path(lex, word, wordlen);
+    }
+
+    uint32_t* keep_slot = NULL;
+    int keep_symbol = 0;
+    uint32_t index = find_branch(lex, word, wordlen, &keep_slot, &keep_symbol);
+    if(index == 0) return false;
+    LexNode* word_node = node_at(lex, index);
+    if(!(word_node->info & NODE_WORD)) return false;
+    set_info(word_node, word_node->info & ~NODE_WORD);
+    //A word added again later starts out unweighted.
+    if(word_node->info & NODE_WEIGHTED) set_weight(word_node, 0);
+    adjust_counts(lex, word, wordlen, -1);
+    add_words(lex, -1);
+    if(lex->reversed != NULL) reverse_remove(lex, word, wordlen);
+
+    //The root is never released, so the empty word only ever clears its flag.
+    if(!(word_node->info & (LETTER_MASK | EXTRA_MASK)) && wordlen > 0) cut_branch(lex, keep_slot, keep_symbol);
+    refresh_best(lex, word, wordlen);
+    return true;
+}
+
+/* Function: remove_prefix_helper
+ * ------------------------------
+ * Does the work of clex_remove_prefix_n for a prefix of preflen bytes, with the writer lock held.
+ * The prefix node's count says how many words go, so the counts are settled without visiting the
+ * subtree, which is then left for alloc_node to release (see release_dead_node). Nodes above the
+ * prefix that are left without words go with it.
+ */
+static bool remove_prefix_helper(CLexicon* lex, const char* prefix, long preflen) {
+    if(lex->image != NULL) {
+        if(!clex_contains_helper(lex, prefix, preflen, true)) return false;
+        thaw(lex);
+    }
+    if(lex->shared_words != 0) {
+        if(!clex_contains_helper(lex, prefix, preflen, true)) return false;
+        own_path(lex, prefix, preflen);
+    }
+
+    if(preflen == 0) {
+        //The new root is published before the old tree is retired.
+        uint32_t old_root = lex->root;
+        publish(&lex->root, create_node(lex));
+        add_words(lex, -lex->wordcount);
+        retire_subtree(lex, old_root);
+        if(lex->reversed != NULL) clex_clear(lex->reversed);
+        return true;
+    }
+
+    uint32_t* keep_slot = NULL;
+    int keep_symbol = 0;
+    uint32_t index = find_branch(lex, prefix, preflen, &keep_slot, &keep_symbol);
+    if(index == 0) return false;
+    int removed = node_at(lex, index)->count;
+    if(lex->reversed != NULL) {
+        //A prefix found in the tree is no longer than the longest word.
+        char word[MAX_WORD_LEN + 1];
+        memcpy(word, prefix, preflen);
+        reverse_subtree(lex, index, word, preflen);
+    }
+    adjust_counts(lex, prefix, preflen, -removed);
+    add_words(lex, -removed);
+    cut_branch(lex, keep_slot, keep_symbol);
+    refresh_best(lex, prefix, preflen);
+    return true;
+}
+
+
+/* Function: iter_advance
+ * ----------------------
+ * Moves iter on to its next word and returns true, or returns false once the walk is over.
+ * The walk is a preorder traversal with an explicit stack: a node is reported before its
+ * children, and children are visited in byte order, which yields the words alphabetically.
+ */
+static bool iter_advance(CLexIterator* iter) {
+    CLexicon* lex = iter->lex;
+    while(iter->depth >= 0) {
+        int d = iter->depth;
+        Cursor cur = { iter->nodes[d], iter->offsets[d] };
+        if(iter->at_node) {
+            iter->at_node = false;
+            if(cursor_is_word(lex, cur)) return true;
+        }
+        //Descends to the first symbol not yet visited.
+        int sym = iter->next[d];
+        Cursor child = d < MAX_WORD_LEN ? cursor_next(lex, cur, &sym) : (Cursor){ 0, 0 };
+        if(child.node != 0) {
+            iter->next[d] = sym + 1;
+            iter->nodes[d + 1] = child.node;
+            iter->offsets[d + 1] = child.offset;
+            iter->next[d + 1] = 1;
+            iter->word[d] = sym;
+            iter->depth = d + 1;
+            iter->at_node = true;
+        } else {
+            //Climbs back up once every child has been visited, stopping at the prefix.
+            iter->depth = d == iter->base ? -1 : d - 1;
+        }
+    }
+    return false;
+}
+
+/* Function: fuzzy_row
+ * -------------------
+ * Fills in the edit distance row for depth d + 1 from the row for depth d, the new last byte
+ * of the word being c. Returns the smallest distance in the new row: once that exceeds the
+ * budget, no word below can come within it, since distances never shrink as bytes are added.
+ * Only the band of entries within max_edits of the diagonal can be within the budget, so only
+ * those are computed; the entries just outside the band are set over budget, which is all the
+ * next row reads of them.
+ */
+static inline int fuzzy_row(FuzzySearch* search, int d, uint8_t c) {
+    const uint8_t* above = search->rows[d];
+    uint8_t* row = search->rows[d + 1];
+    int over = search->max_edits + 1;
+    int lo = d + 1 - search->max_edits;
+    int hi = d + 1 + search->max_edits;
+    if(hi > search->querylen) hi = search->querylen;
+    else row[hi + 1] = over;
+    row[0] = d + 1;
+    int smallest = row[0];
+    if(lo > 1) row[lo - 1] = over;
+    else lo = 1;
+    for(int j = lo; j <= hi; j++) {
+        int edits = above[j - 1] + (search->query[j - 1] != c);   //substitution, or a match
+        if(above[j] + 1 < edits) edits = above[j] + 1;           //insertion into the query
+        if(row[j - 1] + 1 < edits) edits = row[j - 1] + 1;       //deletion from the query
+        row[j] = edits;
+        if(edits < smallest) smallest = edits;
+    }
+    return smallest;
+}
+
+/* Function: pattern_close
+ * -----------------------
+ * Adds to a state set the positions reached by letting a '*' match nothing. Stars are never
+ * next to each other, so one step is enough.
+ */
+static inline PatternStates pattern_close(const PatternMatcher* matcher, PatternStates states) {
+    return states | ((states & matcher->stars) << 1);
+}
+
+/* Function: pattern_step
+ * ----------------------
+ * Returns the state set reached from states by one more byte c: a position advances past a
+ * symbol that matches c, and stays put on a '*', which can always match one more byte.
+ */
+static inline PatternStates pattern_step(const PatternMatcher* matcher, PatternStates states, int c) {
+    return pattern_close(matcher, ((states & matcher->matches[c]) << 1) | (states & matcher->stars));
+}
+
+/* Function: pattern_compile
+ * -------------------------
+ * Compiles pattern into matcher. Every byte other than '?' and '*' stands for itself, folded
+ * like the words it is matched against. Returns false if the pattern has more than
+ * MAX_PATTERN_SYMBOLS symbols once runs of '*' are merged.
+ */
+static bool pattern_compile(PatternMatcher* matcher, const char* pattern) {
+    memset(matcher, 0, sizeof(*matcher));
+    int n = 0;
+    for(const char* p = pattern; *p != '\0'; p++) {
+        if(*p == '*' && n > 0 && (matcher->stars & ((PatternStates)1 << (n - 1)))) continue;
+        if(n == MAX_PATTERN_SYMBOLS) return false;
+        PatternStates bit = (PatternStates)1 << n;
+        if(*p == '*') {
+            matcher->stars |= bit;
+        } else if(*p == '?') {
+            for(int c = 0; c < NUM_SYMBOLS; c++) matcher->matches[c] |= bit;
+        } else {
+            matcher->matches[fold_case[(uint8_t)*p]] |= bit;
+        }
+        n++;
+    }
+    matcher->final = (PatternStates)1 << n;
+    return true;
+}
+
+/* Function: ranked_before
+ * -----------------------
+ * Returns true if entry a ranks above entry b: a greater weight first, and among equal weights
+ * the alphabetically earlier bytes. Every word under a node entry weighs no more than the
+ * entry and sorts no earlier, so a node entry never ranks below any word it leads to.
+ */
+static inline bool ranked_before(const RankedEntry* a, const RankedEntry* b) {
+    if(a->weight != b->weight) return a->weight > b->weight;
+    int order = memcmp(a->word, b->word, a->len < b->len ? a->len : b->len);
+    if(order != 0) return order < 0;
+    if(a->len != b->len) return a->len < b->len;
+    return a->is_word && !b->is_word;
+}
+
+/* Function: ranked_enter
+ * ----------------------
+ * Points entry at the place cur, with all of it left to search: ranked by the best weight below
+ * it, with its own word and every one of its children still to visit.
+ */
+static inline void ranked_enter(CLexicon* lex, RankedEntry* entry, Cursor cur) {
+    uint32_t info = load_info(node_at(lex, cur.node));
+    entry->node = cur.node;
+    entry->offset = cur.offset;
+    entry->weight = load_best(cursor_node(lex, cur));
+    if(!is_chain(info)) entry->letters = info & (LETTER_MASK | NODE_WORD | EXTRA_MASK);
+    else entry->letters = (cur.offset == 0 ? info & NODE_WORD : 0) | EXTRA_MASK;
+}
+
+/* Function: ranked_push
+ * ---------------------
+ * Adds a copy of entry to the queue, doubling its array when it is full.
+ */
+static void ranked_push(CLexicon* lex, RankedQueue* queue, const RankedEntry* entry) {
+    if(queue->count == queue->capacity) {
+        size_t capacity = queue->capacity * 2;
+        RankedEntry* entries = lex->allocator.alloc(lex->allocator.context, capacity * sizeof(RankedEntry));
+        memcpy(entries, queue->entries, queue->count * sizeof(RankedEntry));
+        if(queue->entries != queue->initial) lex->allocator.free(lex->allocator.context, queue->entries, queue->capacity * sizeof(RankedEntry));
+        queue->entries = entries;
+        queue->capacity = capacity;
+    }
+    //Sifts the new entry up from the bottom of the heap.
+    size_t i = queue->count++;
+    while(i > 0 && ranked_before(entry, &queue->entries[(i - 1) / 2])) {
+        queue->entries[i] = queue->entries[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue->entries[i] = *entry;
+}
+
+/* Function: ranked_pop
+ * --------------------
+ * Moves the best-ranked entry of the queue into entry. Returns false if the queue is empty.
+ */
+static bool ranked_pop(RankedQueue* queue, RankedEntry* entry) {
+    if(queue->count == 0) return false;
+    *entry = queue->entries[0];
+    RankedEntry* last = &queue->entries[--queue->count];
+    //Sifts the last entry down from the top of the heap.
+    size_t i = 0;
+    for(;;) {
+        size_t child = 2 * i + 1;
+        if(child >= queue->count) break;
+        if(child + 1 < queue->count && ranked_before(&queue->entries[child + 1], &queue->entries[child])) child++;
+        if(!ranked_before(&queue->entries[child], last)) break;
+        queue->entries[i] = queue->entries[child];
+        i = child;
+    }
+    queue->entries[i] = *last;
+    return true;
+}
+
+/* Function: count_places
+ * ----------------------
+ * Returns the number of places in the tree (see Cursor), the root included: one for every
+ * distinct prefix of the words in it. Walks the tree in preorder with a stack like
+ * clex_match_pattern's.
+ */
+static uint32_t count_places(CLexicon* lex) {
+    Cursor nodes[MAX_WORD_LEN + 1];
+    uint16_t next[MAX_WORD_LEN + 1];
+    nodes[0] = (Cursor){ load_slot(&lex->root), 0 };
+    next[0] = 1;
+    uint32_t count = 1;
+    int d = 0;
+    while(d >= 0) {
+        int c = next[d];
+        Cursor child = d < MAX_WORD_LEN ? cursor_next(lex, nodes[d], &c) : (Cursor){ 0, 0 };
+        if(child.node == 0) {
+            d--;
+            continue;
+        }
+        next[d] = c + 1;
+        count++;
+        d++;
+        nodes[d] = child;
+        next[d] = 1;
+    }
+    return count;
+}
+
+/* Function: scan_step
+ * -------------------
+ * Returns the state a CLexScanner moves to from state on reading the symbol sym: the state's
+ * edge for sym if it has one, and otherwise that of the first state along its fail links that
+ * does, ending at the root, whose edges cover every byte through root_next.
+ */
+static inline uint32_t scan_step(const CLexScanner* scanner, uint32_t state, int sym) {
+    while(state != 0) {
+        const ScanState* at = &scanner->states[state];
+        for(uint32_t e = at->first; e < at[1].first && scanner->symbols[e] <= sym; e++) {
+            if(scanner->symbols[e] == sym) return scanner->targets[e];
+        }
+        state = at->fail;
+    }
+    return scanner->root_next[sym];
+}
+
+/* Function: scanner_build
+ * -----------------------
+ * Fills in the states of a scanner with room for capacity of them from the tree of lex, numbering
+ * them breadth first with places as the queue. Every state's fail link leads to a shallower state,
+ * which breadth-first order has already given its edges, so each link is found as its state is
+ * numbered. Places beyond capacity, added by another thread since they were counted, are left out.
+ */
+static void scanner_build(CLexScanner* scanner, CLexicon* lex, Cursor* places, uint32_t capacity) {
+    ScanState* states = scanner->states;
+    places[0] = (Cursor){ load_slot(&lex->root), 0 };
+    states[0] = (ScanState){ 0, 0, 0, 0, 0 };
+    memset(scanner->root_next, 0, sizeof(scanner->root_next));
+    uint32_t nstates = 1, nedges = 0;
+    for(uint32_t s = 0; s < nstates; s++) {
+        states[s].first = nedges;
+        for(int sym = 1; sym < NUM_SYMBOLS && nstates < capacity; sym++) {
+            Cursor child = cursor_next(lex, places[s], &sym);
+            if(child.node == 0) break;
+            uint32_t t = nstates++;
+            places[t] = child;
+            scanner->symbols[nedges] = sym;
+            scanner->targets[nedges++] = t;
+            uint32_t fail = s == 0 ? 0 : scan_step(scanner, states[s].fail, sym);
+            states[t].fail = fail;
+            states[t].output = states[fail].is_word ? fail : states[fail].output;
+            states[t].depth = states[s].depth + 1;
+            states[t].is_word = cursor_is_word(lex, child);
+            if(s == 0) scanner->root_next[sym] = t;
+        }
+    }
+    states[nstates].first = nedges;
+    scanner->nstates = nstates;
+}
+
+/* Function: count_subtree
+ * -----------------------
+ * Returns the number of nodes in the subtree at index, which may have been unlinked from the tree
+ * but not yet released (see release_subtree).
+ */
+static size_t count_subtree(CLexicon* lex, uint32_t index) {
+    const LexNode* node = node_at(lex, index);
+    const uint32_t* children = child_slots(node, node->info);
+    size_t count = 1;
+    for(int i = child_count(node, node->info) - 1; i >= 0; i--) count += count_subtree(lex, children[i]);
+    return count;
+}
+
+static size_t count_retired(CLexicon* lex, const RetireList* list) {
+    size_t count = 0;
+    for(uint32_t i = 0; i < list->count; i++) {
+        count += list->nodes[i] == 0 ? count_subtree(lex, list->nodes[++i]) : 1;
+    }
+    return count;
+}
+
+/* Function: stats_walk
+ * --------------------
+ * Walks every place in the tree in preorder, with a stack like clex_match_pattern's, counting it
+ * by depth and by number of children in out. In a mutable lexicon every place is a node, so the
+ * nodes and their size are counted on the way too. A place inside a chain node, or a chain node
+ * itself, has the one child its label goes on to.
+ */
+static void stats_walk(CLexicon* lex, CLexStats* out, bool count_nodes) {
+    Cursor nodes[MAX_WORD_LEN + 1];
+    uint16_t next[MAX_WORD_LEN + 1];
+    nodes[0] = (Cursor){ load_slot(&lex->root), 0 };
+    next[0] = 1;
+    size_t total_depth = 0;
+    int d = 0;
+    bool entered = true;
+    while(d >= 0) {
+        if(entered) {
+            const LexNode* node = node_at(lex, nodes[d].node);
+            uint32_t info = load_info(node);
+            int nchildren = is_chain(info) ? 1 : child_count(node, info);
+            bool is_word = cursor_is_word(lex, nodes[d]);
+            out->places++;
+            out->places_per_depth[d]++;
+            out->fanout[nchildren < CLEX_STATS_MAX_FANOUT ? nchildren : CLEX_STATS_MAX_FANOUT]++;
+            if(d > 0 && nchildren == 0 && !is_word) out->dead_nodes++;
+            if(is_word) {
+                total_depth += d;
+                if(d > out->max_depth) out->max_depth = d;
+            }
+            if(count_nodes) {
+                out->nodes++;
+                out->bytes_in_nodes += node_words(node) * sizeof(uint32_t);
+            }
+            entered = false;
+        }
+        int c = next[d];
+        Cursor child = d < MAX_WORD_LEN ? cursor_next(lex, nodes[d], &c) : (Cursor){ 0, 0 };
+        if(child.node == 0) {
+            d--;
+            continue;
+        }
+        next[d] = c + 1;
+        d++;
+        nodes[d] = child;
+        next[d] = 1;
+        entered = true;
+    }
+    out->average_depth = out->words == 0 ? 0 : (double)total_depth / out->words;
+}
+
+/* Function: release_snapshot
+ * --------------------------
+ * Takes a snapshot out of its origin's list of snapshots, with the origin's writer lock held if
+ * the origin still exists. The nodes it deferred and the blocks it kept may still be visited
+ * by the next older snapshot, which takes them over; if there is none, the nodes are retired in
+ * the origin after all and the blocks freed. Once the last snapshot goes, the origin reuses
+ * released nodes again.
+ */
+static void release_snapshot(CLexicon* snap) {
+    CLexicon* origin = snap->origin;
+    CLexicon* older = snap->older;
+    if(older != NULL) {
+        for(uint32_t i = 0; i < snap->deferred.count; i++) {
+            retire_push(older, &older->deferred, snap->deferred.nodes[i]);
+        }
+        for(uint32_t i = 0; i < snap->nkept; i++) {
+            keep_block(older, snap->kept[i].memory, snap->kept[i].size, snap->kept[i].mapped);
+        }
+    } else {
+        if(origin != NULL && origin->concurrent) {
+            for(uint32_t i = 0; i < snap->deferred.count; i++) {
+                retire_push(origin, &origin->retired, snap->deferred.nodes[i]);
+            }
+        } else if(origin != NULL) {
+            release_retired(origin, &snap->deferred);
+        }
+        for(uint32_t i = 0; i < snap->nkept; i++) {
+            if(snap->kept[i].mapped) munmap(snap->kept[i].memory, snap->kept[i].size);
+            else snap->allocator.free(snap->allocator.context, snap->kept[i].memory, snap->kept[i].size);
+        }
+    }
+    if(snap->newer != NULL) snap->newer->older = older;
+    else if(origin != NULL) origin->snapshots = older;
+    if(older != NULL) older->newer = snap->newer;
+    if(origin != NULL && origin->snapshots == NULL) origin->shared_words = 0;
+}
+
+
+            /* * * Client Functions Listed in the Header File * * */
+
+
+/* Function: clex_create
+ * ---------------------
+ * Creates a new CLexicon* which is initialized and returned. The client only accesses
+ * a pointer to the CLexicon and should never need to interact with the actual struct.
+ */
+CLexicon* clex_create() {
+    return clex_create_with_allocator(&default_allocator);
+}
+
+/* Function: clex_create_with_allocator
+ * ------------------------------------
+ * Creates a new CLexicon* whose struct and slabs all come from the given allocator.
+ * The allocator is copied, so the client's struct does not need to outlive the call.
+ */
+CLexicon* clex_create_with_allocator(const CLexAllocator* allocator) {
+    CLexicon* lex = allocator->alloc(allocator->context, sizeof(CLexicon));
+    lex->allocator = *allocator;
+    lex->slabs = NULL;
+    lex->nslabs = 0;
+    lex->slab_capacity = 0;
+    lex->slab_used = 0;
+    memset(lex->freelists, 0, sizeof(lex->freelists));
+    lex->dead = 0;
+    lex->image = NULL;
+    lex->image_words = 0;
+    lex->image_capacity = 0;
+    lex->mapping = NULL;
+    lex->mapping_size = 0;
+    lex->concurrent = false;
+    lex->epoch = 0;
+    lex->readers = NULL;
+    lex->retired = (RetireList){ NULL, 0, 0 };
+    lex->waiting = (RetireList){ NULL, 0, 0 };
+    lex->nold_tables = 0;
+    pthread_mutex_init(&lex->writer_lock, NULL);
+    lex->reversed = NULL;
+    lex->snapshots = NULL;
+    lex->shared_words = 0;
+    lex->is_snapshot = false;
+#ifdef CLEX_COUNTERS
+    memset(lex->counters, 0, sizeof(lex->counters));
+#endif
+    lex->root = create_node(lex);
+    lex->wordcount = 0;
+    memset(lex->jump, 0, sizeof(lex->jump));
+    return lex;
+}
+
+/* Function: clex_delete
+ * ---------------------
+ * Frees all memory associated with a CLexicon*. The tree is never walked; every slab is
+ * handed back to the allocator, followed by the slabs table and the struct itself. The slabs
+ * of a lexicon with snapshots go to them instead, and a snapshot passes on what it kept or
+ * deferred (see release_snapshot).
+ */
+void clex_delete(CLexicon* lex) {
+   CLexAllocator allocator = lex->allocator;
+   if(lex->reversed != NULL) clex_delete(lex->reversed);
+   if(lex->is_snapshot) {
+       CLexicon* origin = lex->origin;
+       if(origin != NULL) writer_lock(origin);
+       release_snapshot(lex);
+       if(origin != NULL) writer_unlock(origin);
+       free_retire_list(lex, &lex->deferred);
+       if(lex->kept != NULL) allocator.free(allocator.context, lex->kept, lex->kept_capacity * sizeof(KeptBlock));
+   } else {
+       clex_set_concurrent(lex, false);
+       free_slabs(lex);
+       //The snapshots have kept the storage they need, and outlive the lexicon.
+       for(CLexicon* snap = lex->snapshots; snap != NULL; snap = snap->older) {
+           snap->origin = NULL;
+       }
+   }
+   pthread_mutex_destroy(&lex->writer_lock);
+   allocator.free(allocator.context, lex->slabs, lex->slab_capacity * sizeof(uint32_t*));
+   allocator.free(allocator.context, lex, sizeof(CLexicon));
+}
+
+/* Function: clex_snapshot
+ * -----------------------
+ * Returns a read-only CLexicon* holding the words lex holds now. The snapshot gets its own copy
+ * of the slabs table and the jump table but shares every node with lex, which from then on
+ * copies the nodes on the path of each word it changes before changing them (see own_path) and
+ * defers releasing the nodes it unlinks. Functions that rework the whole tree move lex to new
+ * storage instead, and leave the old storage to the snapshots (see free_block). While lex has
+ * snapshots it releases no nodes for reuse. Snapshots of snapshots are not supported.
+ */
+CLexicon* clex_snapshot(CLexicon* lex) {
+    if(lex->is_snapshot) return NULL;
+    writer_lock(lex);
+    CLexicon* snap = lex->allocator.alloc(lex->allocator.context, sizeof(CLexicon));
+    memset(snap, 0, sizeof(CLexicon));
+    snap->allocator = lex->allocator;
+    pthread_mutex_init(&snap->writer_lock, NULL);
+    snap->root = lex->root;
+    snap->wordcount = lex->wordcount;
+    snap->slabs = lex->allocator.alloc(lex->allocator.context, lex->nslabs * sizeof(uint32_t*));
+    memcpy(snap->slabs, lex->slabs, lex->nslabs * sizeof(uint32_t*));
+    snap->nslabs = lex->nslabs;
+    snap->slab_capacity = lex->nslabs;
+    snap->slab_used = lex->slab_used;
+    //The image itself stays with lex; the snapshot only needs it to save it and report it frozen.
+    snap->image = lex->image;
+    snap->image_words = lex->image_words;
+    memcpy(snap->jump, lex->jump, sizeof(lex->jump));
+    snap->reversed = lex->reversed != NULL ? clex_snapshot(lex->reversed) : NULL;
+    snap->is_snapshot = true;
+    snap->origin = lex;
+    snap->older = lex->snapshots;
+    if(lex->snapshots != NULL) lex->snapshots->newer = snap;
+    lex->snapshots = snap;
+    //A frozen lexicon is thawed before it changes, so all of it is shared until then.
+    if(lex->image != NULL) lex->shared_words = UINT32_MAX;
+    else lex->shared_words = ((lex->nslabs - 1) << SLAB_SHIFT) | lex->slab_used;
+    writer_unlock(lex);
+    return snap;
+}
+
+/* Function: clex_add
+ * ------------------
+ * Adds the given word to the CLexicon, folding it to lower case on the way down the tree.
+ */
+bool clex_add(CLexicon* lex, char* word) {
+    return clex_add_n(lex, word, NUL_TERMINATED);
+}
+
+/* Function: clex_add_n
+ * --------------------
+ * Adds the first len bytes of word to the CLexicon. The word is checked before the tree is
+ * touched, so a word containing a '\0' within len bytes, or longer than MAX_WORD_LEN,
+ * leaves the lexicon unchanged (see word_length). Every path in the tree is therefore at most MAX_WORD_LEN long,
+ * which lets the iterators keep their stack in a fixed array.
+ */
+bool clex_add_n(CLexicon* lex, const char* word, size_t len) {
+    if(lex->is_snapshot) return false;
+    long wordlen = word_length(word, len);
+    if(wordlen < 0 || wordlen > MAX_WORD_LEN) return false;
+    writer_lock(lex);
+    if(lex->image != NULL) thaw(lex);
+
+    //simple_add is a helper function that adds the word and increments the wordcount.
+    clex_simple_add(lex, word, wordlen);
+    jump_update(lex, word, wordlen);
+    writer_unlock(lex);
+    return true;
+}
+
+/* Function: clex_add_weighted
+ * ----------------------------
+ * Adds word as clex_add does and sets its weight, which replaces any weight it had before
+ * (see weigh_word). The words that clex_top_k ranks highest are those with the greatest weights.
+ */
+bool clex_add_weighted(CLexicon* lex, const char* word, uint32_t weight) {
+    if(lex->is_snapshot) return false;
+    long wordlen = word_length(word, NUL_TERMINATED);
+    if(wordlen < 0 || wordlen > MAX_WORD_LEN) return false;
+    writer_lock(lex);
+    if(lex->image != NULL) thaw(lex);
+    weigh_word(lex, word, wordlen, weight);
+    jump_update(lex, word, wordlen);
+    writer_unlock(lex);
+    return true;
+}
+
+/* Function: clex_add_from_file
+ * ----------------------------
+ * This function fills a lexicon with entires from a text file where each line
+ * holds a single word of any bytes but '\0'. If the file cannot be opened or a bad
+ * line of text is reached, the function returns false to indicate a failure in
+ * reading; words on earlier lines stay added. The file is read and split into lines by
+ * read_word_file, which folds it to lower case a block at a time, and each line is added
+ * by loader_add_word. Since folding is done by table lookup either way, "is_lower_case"
+ * no longer changes how the words are added.
+ */
+bool clex_add_from_file(CLexicon* lex, char* filename, bool is_lower_case) {
+    if(lex->is_snapshot) return false;
+    FILE* lex_file = fopen(filename, "rb");
+    if(lex_file == NULL) {
+        return false;
+    }
+    writer_lock(lex);
+    if(lex->image != NULL) thaw(lex);
+    //The loader changes nodes all over the tree, so it first moves away from any snapshot's.
+    if(lex->shared_words != 0) unshare_tree(lex);
+
+    WordLoader loader;
+    loader.lex = lex;
+    loader.wordlen = 0;
+    loader.slots[0] = &lex->root;
+    memset(loader.pending, 0, sizeof(loader.pending));
+    bool successful = read_word_file(lex, lex_file, loader_add_word, &loader);
+    loader_flush(&loader, -1);
+    jump_rebuild(lex);
+    reverse_rebuild(lex);
+    writer_unlock(lex);
+
+    fclose(lex_file);
+    return successful;
+}
+
+/* Function: clex_add_from_file_parallel
+ * -------------------------------------
+ * Reads the whole file into memory and cuts it into slices by first byte (see slice_words), then
+ * hands the bytes out to nthreads shards (see assign_shards). Each shard folds and loads its own
+ * slices on a thread of its own (the first on the calling thread) into a private lexicon, so the
+ * threads share nothing. No two shards hold words with the same first byte, so their slabs are
+ * then appended to lex's (see graft_shards) and their root children linked below lex's root,
+ * with no node copied. Only a first byte lex already has a child for is merged into that child
+ * node by node (see merge_node). Nothing is changed if the file is unreadable or malformed.
+ */
+bool clex_add_from_file_parallel(CLexicon* lex, char* filename, int nthreads) {
+    if(lex->is_snapshot) return false;
+    FILE* lex_file = fopen(filename, "rb");
+    if(lex_file == NULL) {
+        return false;
+    }
+    size_t size, file_capacity;
+    uint8_t* file = read_whole_file(lex, lex_file, &size, &file_capacity);
+    fclose(lex_file);
+    if(file == NULL) return false;
+    uint64_t counts[NUM_SYMBOLS] = { 0 };
+    WordSlice* slices;
+    size_t nslices, slice_capacity;
+    bool successful = slice_words(lex, file, size, counts, &slices, &nslices, &slice_capacity);
+    if(!successful) {
+        lex->allocator.free(lex->allocator.context, slices, slice_capacity * sizeof(WordSlice));
+        lex->allocator.free(lex->allocator.context, file, file_capacity);
+        return false;
+    }
+
+    uint8_t shard_of[NUM_SYMBOLS];
+    nthreads = assign_shards(counts, nthreads, shard_of);
+    ShardBuilder* shards = lex->allocator.alloc(lex->allocator.context, nthreads * sizeof(ShardBuilder));
+    for(int t = 0; t < nthreads; t++) {
+        ShardBuilder* shard = &shards[t];
+        shard->file = file;
+        shard->slices = slices;
+        shard->nslices = nslices;
+        shard->shard_of = shard_of;
+        shard->shard = t;
+        shard->loader.lex = clex_create_with_allocator(&lex->allocator);
+        shard->loader.wordlen = 0;
+        shard->loader.slots[0] = &shard->loader.lex->root;
+        memset(shard->loader.pending, 0, sizeof(shard->loader.pending));
+    }
+    run_builders(shards, sizeof(ShardBuilder), nthreads, build_shard);
+    for(int t = 0; t < nthreads; t++) {
+        if(!shards[t].successful) successful = false;
+    }
+    lex->allocator.free(lex->allocator.context, slices, slice_capacity * sizeof(WordSlice));
+    lex->allocator.free(lex->allocator.context, file, file_capacity);
+    if(!successful) {
+        for(int t = 0; t < nthreads; t++) clex_delete(shards[t].loader.lex);
+        lex->allocator.free(lex->allocator.context, shards, nthreads * sizeof(ShardBuilder));
+        return false;
+    }
+
+    writer_lock(lex);
+    if(lex->image != NULL) thaw(lex);
+    if(lex->shared_words != 0) unshare_tree(lex);
+    //Children lex already has are merged before grafting, while the shards' indices are their own.
+    int added = 0;
+    bool merged[NUM_SYMBOLS] = { false };
+    Graft grafts[MAX_BUILD_THREADS];
+    for(int t = 0; t < nthreads; t++) {
+        CLexicon* shard = shards[t].loader.lex;
+        for(int sym = 1; ; sym++) {
+            Cursor child = cursor_next(shard, (Cursor){ shard->root, 0 }, &sym);
+            if(child.node == 0) break;
+            LexNode* root = node_at(lex, lex->root);
+            uint32_t* slot = find_slot(root, root->info, sym);
+            if(slot == NULL) continue;
+            int merged_words = merge_node(lex, slot, shard, child);
+            add_count(node_at(lex, lex->root), merged_words);
+            added += merged_words;
+            merged[sym] = true;
+        }
+        grafts[t] = (Graft){ shard, shard->root, 0 };
+    }
+    lex->allocator.free(lex->allocator.context, shards, nthreads * sizeof(ShardBuilder));
+    uint32_t child_of_symbol[NUM_SYMBOLS] = { 0 };
+    graft_shards(lex, grafts, nthreads, child_of_symbol);
+    for(int sym = 1; sym < NUM_SYMBOLS; sym++) {
+        uint32_t child = child_of_symbol[sym];
+        if(child == 0) continue;
+        if(merged[sym]) {
+            release_subtree(lex, child);
+            continue;
+        }
+        int count = node_at(lex, child)->count;
+        publish(&lex->root, insert_child(lex, lex->root, sym, child));
+        add_count(node_at(lex, lex->root), count);
+        added += count;
+    }
+    add_words(lex, added);
+    jump_rebuild(lex);
+    reverse_rebuild(lex);
+    writer_unlock(lex);
+    return true;
+}
+
+/* Function: clex_add_from_sorted_file
+ * -----------------------------------
+ * Builds a frozen lexicon straight from a sorted word file (see builder_add_word), so the
+ * full tree is never held in memory; peak memory is the minimized graph plus its register,
+ * and at the end the copies of it with compressed chains (see compress_image) and laid out for
+ * lookups (see layout_image).
+ * Nothing is changed if the file is unreadable, malformed or unsorted. A lexicon that already
+ * holds words cannot be built this way, so the file is built into a lexicon of its own, which
+ * checks its order just the same, and that is merged in before the lexicon is frozen.
+ */
+bool clex_add_from_sorted_file(CLexicon* lex, char* filename) {
+    if(lex->is_snapshot) return false;
+    if(load_wordcount(lex) > 0) {
+        CLexicon* words = clex_create_with_allocator(&lex->allocator);
+        bool successful = clex_add_from_sorted_file(words, filename);
+        if(successful) {
+            clex_merge(lex, words);
+            clex_freeze(lex);
+        }
+        clex_delete(words);
+        return successful;
+    }
+    FILE* lex_file = fopen(filename, "rb");
+    if(lex_file == NULL) {
+        return false;
+    }
+    writer_lock(lex);
+
+    //The open nodes can each hold a child for every byte, too much to keep on the stack.
+    DawgBuilder* builder = lex->allocator.alloc(lex->allocator.context, sizeof(DawgBuilder));
+    builder->lex = lex;
+    builder->wordlen = 0;
+    builder->open[0].info = 0;
+    builder->open[0].nchildren = 0;
+    register_init(lex, &builder->reg);
+    bool successful = read_word_file(lex, lex_file, builder_add_word, builder);
+    fclose(lex_file);
+
+    NodeRegister* reg = &builder->reg;
+    if(successful) {
+        builder_close(builder, 0);
+        uint32_t root = compress_image(lex, reg, builder_register(builder, 0));
+        //The laid out copy is also trimmed to size, leaving the output's growth room behind.
+        uint32_t nwords;
+        uint32_t* image = layout_image(lex, reg->words, reg->nwords, &root, &nwords);
+        adopt_image(lex, image, nwords, reg->nwords, root);
+        lex->allocator.free(lex->allocator.context, reg->words, reg->capacity * sizeof(uint32_t));
+        reverse_rebuild(lex);
+    } else {
+        lex->wordcount = 0;
+        lex->allocator.free(lex->allocator.context, reg->words, reg->capacity * sizeof(uint32_t));
+    }
+    lex->allocator.free(lex->allocator.context, reg->buckets, reg->nbuckets * sizeof(uint32_t));
+    lex->allocator.free(lex->allocator.context, builder, sizeof(DawgBuilder));
+    writer_unlock(lex);
+    return successful;
+}
+
+/* Function: clex_merge
+ * --------------------
+ * Merges src into dst below the root (see merge_node). Both lexicons are locked for the merge,
+ * always in the same order, so that merges between the same two lexicons in opposite directions
+ * cannot deadlock. Merging a lexicon into itself changes nothing.
+ */
+int clex_merge(CLexicon* dst, CLexicon* src) {
+    if(dst == src || dst->is_snapshot) return 0;
+    CLexicon* first = dst < src ? dst : src;
+    CLexicon* second = dst < src ? src : dst;
+    writer_lock(first);
+    writer_lock(second);
+    if(dst->image != NULL) thaw(dst);
+    if(dst->shared_words != 0) unshare_tree(dst);
+    int added = merge_node(dst, &dst->root, src, (Cursor){ src->root, 0 });
+    add_words(dst, added);
+    jump_rebuild(dst);
+    reverse_rebuild(dst);
+    writer_unlock(second);
+    writer_unlock(first);
+    return added;
+}
+
+/* Function: clex_union
+ * --------------------
+ * Returns a new lexicon of the words in a or b (see combine_lexicons).
+ */
+CLexicon* clex_union(CLexicon* a, CLexicon* b, int nthreads) {
+    return combine_lexicons(a, b, SET_UNION, nthreads);
+}
+
+/* Function: clex_intersect
+ * ------------------------
+ * Returns a new lexicon of the words in both a and b (see combine_lexicons).
+ */
+CLexicon* clex_intersect(CLexicon* a, CLexicon* b, int nthreads) {
+    return combine_lexicons(a, b, SET_INTERSECT, nthreads);
+}
+
+/* Function: clex_difference
+ * -------------------------
+ * Returns a new lexicon of the words in a but not in b (see combine_lexicons).
+ */
+CLexicon* clex_difference(CLexicon* a, CLexicon* b, int nthreads) {
+    return combine_lexicons(a, b, SET_DIFFERENCE, nthreads);
+}
+
+/* Function: clex_clear
+ * --------------------
+ * Deletes all entires from the CLexicon by releasing its slabs, initializes a new root
+ * node, and sets the word count to zero.
+ */
+void clex_clear(CLexicon* lex) {
+    if(lex->is_snapshot) return;
+    writer_lock(lex);
+    free_slabs(lex);
+    lex->root = create_node(lex);
+    lex->wordcount = 0;
+    jump_rebuild(lex);
+    if(lex->reversed != NULL) clex_clear(lex->reversed);
+    writer_unlock(lex);
+}
+
+/* Function: clex_contains
+ * -----------------------
+ * Traverses the tree from the root until it reaches the node that corresponds
+ * to the given word. Returns that node's word flag, indicating whether word
+ * is a member of the CLexicon.
+ */
+bool clex_contains(CLexicon* lex, char* word) {
+    //Calls the helper function with the "isPrefix" field set to false.
+    return count_lookup(lex, clex_contains_helper(lex, word, NUL_TERMINATED, false));
+}
+
+/* Function: clex_contains_n
+ * -------------------------
+ * As clex_contains, but reads exactly len bytes of word, which need not be NUL-terminated.
+ */
+bool clex_contains_n(CLexicon* lex, const char* word, size_t len) {
+    return count_lookup(lex, clex_contains_helper(lex, word, len, false));
+}
+
+/* Function: clex_contains_prefix
+ * ------------------------------
+ * Returns true if the lexicon contains any intermediate nodes corresponding to the given
+ * prefix, regardless of whether their word flag is set. Returns false if a missing child
+ * is reached while searching for the prefix.
+ */
+bool clex_contains_prefix(CLexicon* lex, char* prefix) {
+    //Calls the helper function with the "isPrefix" field set to true.
+    return count_lookup(lex, clex_contains_helper(lex, prefix, NUL_TERMINATED, true));
+}
+
+/* Function: clex_contains_prefix_n
+ * --------------------------------
+ * As clex_contains_prefix, but reads exactly len bytes of prefix.
+ */
+bool clex_contains_prefix_n(CLexicon* lex, const char* prefix, size_t len) {
+    return count_lookup(lex, clex_contains_helper(lex, prefix, len, true));
+}
+
+/* Function: clex_count_prefix
+ * ---------------------------
+ * Returns the number of words beginning with prefix, read from the count kept in the prefix's node.
+ */
+int clex_count_prefix(CLexicon* lex, char* prefix) {
+    return clex_count_prefix_n(lex, prefix, NUL_TERMINATED);
+}
+
+/* Function: clex_count_prefix_n
+ * -----------------------------
+ * As clex_count_prefix, but reads exactly len bytes of prefix.
+ */
+int clex_count_prefix_n(CLexicon* lex, const char* prefix, size_t len) {
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    size_t preflen;
+    Cursor cur = find_cursor(lex, prefix, len, &preflen);
+    int count = cur.node == 0 ? 0 : load_count(cursor_node(lex, cur));
+    reader_exit(reader, parity);
+    return count;
+}
+
+/* Function: clex_iter_prefix
+ * --------------------------
+ * Walks to the prefix's node and makes it the bottom of iter's stack. A prefix that is not in the
+ * lexicon, or is too long to begin a word, leaves iter with nothing to return.
+ */
+void clex_iter_prefix(CLexicon* lex, CLexIterator* iter, const char* prefix) {
+    iter->lex = lex;
+    iter->depth = -1;
+    iter->at_node = true;
+    size_t preflen;
+    Cursor cur = find_cursor(lex, prefix, NUL_TERMINATED, &preflen);
+    if(cur.node == 0 || preflen > MAX_WORD_LEN) return;
+    for(size_t i = 0; i < preflen; i++) {
+        iter->word[i] = fold_case[(uint8_t)prefix[i]];
+    }
+    iter->base = preflen;
+    iter->depth = preflen;
+    iter->nodes[preflen] = cur.node;
+    iter->offsets[preflen] = cur.offset;
+    iter->next[preflen] = 1;
+}
 
-#define ALPHA_SIZE 26
-#define MAX_WORD_LEN 45
+/* Function: clex_iter_next
+ * ------------------------
+ * Advances iter (see iter_advance) and copies out the word it stops at.
+ */
+bool clex_iter_next(CLexIterator* iter, char* word) {
+    if(!iter_advance(iter)) return false;
+    memcpy(word, iter->word, iter->depth);
+    word[iter->depth] = '\0';
+    return true;
+}
 
+/* Function: clex_visit_prefix
+ * ---------------------------
+ * Runs an iterator on the stack inside a single reader section, handing each word to visit
+ * straight from the iterator's own buffer.
+ */
+void clex_visit_prefix(CLexicon* lex, const char* prefix, CLexVisitor visit, void* context) {
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    CLexIterator iter;
+    clex_iter_prefix(lex, &iter, prefix);
+    while(iter_advance(&iter)) {
+        iter.word[iter.depth] = '\0';
+        if(!visit(context, iter.word, iter.depth)) break;
+    }
+    reader_exit(reader, parity);
+}
 
-            /* * * Struct Definitions * * */
+/* Function: unreverse_word
+ * -------------------------
+ * CLexVisitor for clex_visit_suffix with a suffix index: spells each word of the index backwards
+ * and hands it to the client's visitor.
+ */
+static bool unreverse_word(void* context, const char* word, size_t len) {
+    SuffixSearch* search = context;
+    for(size_t i = 0; i < len; i++) search->word[i] = word[len - 1 - i];
+    search->word[len] = '\0';
+    search->found = true;
+    return search->visit == NULL || search->visit(search->context, search->word, len);
+}
 
+/* Function: match_suffix
+ * ----------------------
+ * CLexVisitor for the suffix functions without a suffix index, called with every word of the
+ * lexicon. A search with no visitor only wants to know if there is a match, and stops at the first.
+ */
+static bool match_suffix(void* context, const char* word, size_t len) {
+    SuffixSearch* search = context;
+    if(len < search->len || memcmp(word + len - search->len, search->suffix, search->len) != 0) return true;
+    search->found = true;
+    return search->visit != NULL && search->visit(search->context, word, len);
+}
 
-struct LexNode {
-    bool is_word;
-    LexNode* children[ALPHA_SIZE];
-};
+/* Function: search_suffix
+ * -----------------------
+ * Does the work of clex_contains_suffix and clex_visit_suffix, which are told apart by whether
+ * search->visit is set. Through the suffix index, the words ending in suffix are those beginning
+ * with it spelled backwards there; without one, every word is checked.
+ */
+static void search_suffix(CLexicon* lex, const char* suffix, SuffixSearch* search) {
+    size_t len = strlen(suffix);
+    if(len > MAX_WORD_LEN) return;
+    char symbols[MAX_WORD_LEN + 1];
+    if(lex->reversed != NULL) {
+        for(size_t i = 0; i < len; i++) symbols[i] = suffix[len - 1 - i];
+        symbols[len] = '\0';
+        if(search->visit == NULL) search->found = clex_contains_prefix_n(lex->reversed, symbols, len);
+        else clex_visit_prefix(lex->reversed, symbols, unreverse_word, search);
+        return;
+    }
+    for(size_t i = 0; i < len; i++) symbols[i] = fold_case[(uint8_t)suffix[i]];
+    search->suffix = symbols;
+    search->len = len;
+    clex_visit_prefix(lex, "", match_suffix, search);
+}
 
-struct CLexiconImplementation {
-    LexNode* root;
-    int wordcount;
-};
+/* Function: clex_contains_suffix
+ * ------------------------------
+ * Returns true if any word of the lexicon ends in suffix (see search_suffix).
+ */
+bool clex_contains_suffix(CLexicon* lex, const char* suffix) {
+    SuffixSearch search = { NULL, 0, NULL, NULL, false, "" };
+    search_suffix(lex, suffix, &search);
+    return search.found;
+}
 
+/* Function: clex_visit_suffix
+ * ---------------------------
+ * Hands every word of the lexicon that ends in suffix to visit (see search_suffix).
+ */
+void clex_visit_suffix(CLexicon* lex, const char* suffix, CLexVisitor visit, void* context) {
+    SuffixSearch search = { NULL, 0, visit, context, false, "" };
+    search_suffix(lex, suffix, &search);
+}
 
-            /* * * Local Helper Functions * * */
+/* Function: clex_weight
+ * ----------------------
+ * Returns the weight stored in word's node, or 0 if the lexicon does not contain word.
+ */
+uint32_t clex_weight(CLexicon* lex, const char* word) {
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    size_t wordlen;
+    Cursor cur = find_cursor(lex, word, NUL_TERMINATED, &wordlen);
+    uint32_t weight = cur.node != 0 && cursor_is_word(lex, cur) ? load_weight(node_at(lex, cur.node)) : 0;
+    reader_exit(reader, parity);
+    return weight;
+}
 
+/* Function: clex_top_k
+ * --------------------
+ * Runs a best-first search below the prefix's node. Taking the part of a subtree still to be
+ * searched off the queue puts back three things: the node's own word, the child with the best
+ * weight, and the node's other children, ranked by the best weight among them. Nothing ranks
+ * above the entry it came from, so words come off the queue in exactly the order they are
+ * returned, and the search stops after the k-th. Each step adds at most three entries however
+ * many children a node has, and subtrees whose best weight is too small to rank are never opened.
+ */
+size_t clex_top_k(CLexicon* lex, const char* prefix, size_t k, CLexCompletion* out) {
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    size_t found = 0;
+    size_t preflen;
+    Cursor cur = find_cursor(lex, prefix, NUL_TERMINATED, &preflen);
+    if(cur.node != 0 && preflen <= MAX_WORD_LEN && k > 0) {
+        RankedQueue queue;
+        queue.entries = queue.initial;
+        queue.count = 0;
+        queue.capacity = RANKED_STACK_ENTRIES;
 
-/* Function: create_node
- * -----------------------
- * Creates a new LexNode, initializes all of its children pointers to NULL,
- * and sets its word status to false. Returns a pointer.
- */ 
-static inline LexNode* create_node() {
-    LexNode* node  = malloc(sizeof(LexNode));
-    //Loop overhead amortization to improve efficiency; create_node is called very often.
-    for(int i = 0; i < ALPHA_SIZE - 2; i+= 4) {
-        node->children[i] = NULL; node->children[i+1] = NULL; node->children[i+2] = NULL; node->children[i+3] = NULL;
-    }
-    //Finishes the loop's job of initializing the node's child nodes.
-    node->children[ALPHA_SIZE - 2] = NULL; node->children[ALPHA_SIZE - 1] = NULL;
-    node->is_word = false;
-    return node;
-}
-
-/* Function: delete_node_helper
- * ----------------------------
- * Helper function for delete_node. Passes LexNode pointers-to-pointers so that
- * the actual tree can be recursively deleted. Edits the lex's wordcount.
- */ 
-static void delete_node_helper(CLexicon* lex, LexNode** nodeptr) {
-    if(*nodeptr == NULL) return;
+        RankedEntry entry;
+        ranked_enter(lex, &entry, cur);
+        entry.is_word = false;
+        entry.len = preflen;
+        for(size_t i = 0; i < preflen; i++) {
+            entry.word[i] = fold_case[(uint8_t)prefix[i]];
+        }
+        ranked_push(lex, &queue, &entry);
+
+        while(found < k && ranked_pop(&queue, &entry)) {
+            if(entry.is_word) {
+                memcpy(out[found].word, entry.word, entry.len);
+                out[found].word[entry.len] = '\0';
+                out[found].weight = entry.weight;
+                found++;
+                continue;
+            }
+            const LexNode* node = node_at(lex, entry.node);
+            if(entry.letters & NODE_WORD) {
+                RankedEntry word = entry;
+                word.weight = load_weight(node);
+                word.is_word = true;
+                ranked_push(lex, &queue, &word);
+            }
+            if(entry.len == MAX_WORD_LEN) continue;
+            //Children for bytes other than letters are rare, so each is simply queued on its own,
+            //as is the one child of a place along a chain node.
+            if(entry.letters & EXTRA_MASK) {
+                uint32_t info = load_info(node);
+                if(is_chain(info)) {
+                    int sym = 1;
+                    RankedEntry next = entry;
+                    ranked_enter(lex, &next, cursor_next(lex, (Cursor){ entry.node, entry.offset }, &sym));
+                    next.word[next.len++] = sym;
+                    ranked_push(lex, &queue, &next);
+                    continue;
+                }
+                for(int sym = next_extra(node, info, 1); sym < NUM_SYMBOLS; sym = next_extra(node, info, sym + 1)) {
+                    RankedEntry extra = entry;
+                    ranked_enter(lex, &extra, (Cursor){ load_slot(&child_slots(node, info)[symbol_rank(node, info, sym)]), 0 });
+                    extra.word[extra.len++] = sym;
+                    ranked_push(lex, &queue, &extra);
+                }
+            }
+            uint32_t letters = entry.letters & LETTER_MASK;
+            if(letters == 0) continue;
 
-    //Loop overhead amortization to improve efficiency; delete_node_helper is called very often.
-    for(int i = 0; i < ALPHA_SIZE; i+= 2) {
-        delete_node_helper(lex, &(*nodeptr)->children[i]);   delete_node_helper(lex, &(*nodeptr)->children[i+1]);
+            //Finds the best child, the earliest letter among equals, and the best weight of the rest.
+            int best_letter = -1;
+            uint32_t best_child = 0, best = 0, runner_up = 0;
+            for(uint32_t mask = letters; mask != 0; mask &= mask - 1) {
+                int c = __builtin_ctz(mask);
+                uint32_t child = child_of(node, 'a' + c);
+                uint32_t weight = load_best(node_at(lex, child));
+                if(best_letter < 0 || weight > best) {
+                    if(best_letter >= 0 && best > runner_up) runner_up = best;
+                    best_letter = c;
+                    best_child = child;
+                    best = weight;
+                } else if(weight > runner_up) {
+                    runner_up = weight;
+                }
+            }
+            letters &= ~(1u << best_letter);
+            if(letters != 0) {
+                RankedEntry rest = entry;
+                rest.weight = runner_up;
+                rest.letters = letters;
+                ranked_push(lex, &queue, &rest);
+            }
+            ranked_enter(lex, &entry, (Cursor){ best_child, 0 });
+            entry.word[entry.len++] = 'a' + best_letter;
+            ranked_push(lex, &queue, &entry);
+        }
+        if(queue.entries != queue.initial) lex->allocator.free(lex->allocator.context, queue.entries, queue.capacity * sizeof(RankedEntry));
     }
-    if((*nodeptr)->is_word) lex->wordcount--;
-    free(*nodeptr);
-    *nodeptr = NULL;
+    reader_exit(reader, parity);
+    return found;
 }
 
-/* Function: delete_node
- * ---------------------
- * Deletes a node and all of its children nodes and frees all memory associated with them.
- */ 
-static inline void delete_node(CLexicon* lex, LexNode* node) {
-    if(node == NULL) return;
+/* Function: clex_fuzzy_search
+ * ---------------------------
+ * Walks the tree once from the root in a preorder traversal, computing one row of the edit
+ * distance table per node from the row of its parent (see fuzzy_row), so words sharing a prefix
+ * share the work for it. A subtree is skipped as soon as every entry of its row is over the
+ * budget. The whole search runs in one reader section, visitor calls included.
+ */
+void clex_fuzzy_search(CLexicon* lex, const char* word, int max_edits, CLexFuzzyVisitor visit, void* context) {
+    long wordlen = word_length(word, NUL_TERMINATED);
+    if(wordlen < 0 || wordlen > MAX_WORD_LEN || max_edits < 0) return;
+    //No two words of at most MAX_WORD_LEN letters are further apart than that.
+    if(max_edits > MAX_WORD_LEN) max_edits = MAX_WORD_LEN;
+
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    FuzzySearch search;
+    search.querylen = wordlen;
+    search.max_edits = max_edits;
+    for(long j = 0; j < wordlen; j++) {
+        search.query[j] = fold_case[(uint8_t)word[j]];
+    }
+    for(int j = 0; j <= wordlen && j <= max_edits + 1; j++) {
+        search.rows[0][j] = j;
+    }
+    search.nodes[0] = (Cursor){ load_slot(&lex->root), 0 };
+    search.next[0] = 1;
+
+    //The empty word is reported here, so every node on the stack has been reported already.
+    bool stopped = false;
+    if(cursor_is_word(lex, search.nodes[0]) && wordlen <= max_edits) {
+        search.word[0] = '\0';
+        stopped = !visit(context, search.word, 0, wordlen);
+    }
+    int d = 0;
+    while(!stopped && d >= 0) {
+        int c = search.next[d];
+        Cursor child = d < MAX_WORD_LEN ? cursor_next(lex, search.nodes[d], &c) : (Cursor){ 0, 0 };
+        if(child.node == 0) {
+            d--;
+            continue;
+        }
+        search.next[d] = c + 1;
+        if(fuzzy_row(&search, d, c) > max_edits) continue;
 
-    for(int i = 0; i < ALPHA_SIZE; i++) {
-        delete_node_helper(lex, &node->children[i]);
+        search.word[d] = c;
+        d++;
+        search.nodes[d] = child;
+        search.next[d] = 1;
+        //The last entry of the row is only filled in once it is inside the band.
+        int edits = d + max_edits >= wordlen ? search.rows[d][wordlen] : max_edits + 1;
+        if(edits <= max_edits && cursor_is_word(lex, child)) {
+            search.word[d] = '\0';
+            stopped = !visit(context, search.word, d, edits);
+        }
     }
-    free(node);
-    node = NULL;
+    reader_exit(reader, parity);
 }
 
-/* Function: branch_contains_words
- * -------------------------------
- * Returns true if node at nodeptr represents a word or if any of its children contain a branch with
- * a node representing a word. Otherwise, returns false.
- */ 
-static bool branch_contains_words(CLexicon* lex, LexNode** nodeptr) {
-    if(*nodeptr == NULL) return false;
+/* Function: clex_match_pattern
+ * ----------------------------
+ * Walks the tree in preorder while running the compiled pattern (see PatternMatcher) along each
+ * path, one state set per depth. A child whose state set would come out empty can lead to no
+ * match and is never visited. The whole walk runs in one reader section, visitor calls included.
+ */
+void clex_match_pattern(CLexicon* lex, const char* pattern, CLexVisitor visit, void* context) {
+    PatternMatcher matcher;
+    if(!pattern_compile(&matcher, pattern)) return;
+
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    Cursor nodes[MAX_WORD_LEN + 1];
+    uint16_t next[MAX_WORD_LEN + 1];
+    PatternStates states[MAX_WORD_LEN + 1];
+    char word[MAX_WORD_LEN + 1];
+    nodes[0] = (Cursor){ load_slot(&lex->root), 0 };
+    next[0] = 1;
+    states[0] = pattern_close(&matcher, 1);
 
-    bool words_in_branch = false;
-    for(int i = 0; i < ALPHA_SIZE; i++) {
-        words_in_branch = words_in_branch || branch_contains_words(lex, &(*nodeptr)->children[i]);
+    //The empty word is reported here, so every node on the stack has been reported already.
+    bool stopped = false;
+    if(cursor_is_word(lex, nodes[0]) && (states[0] & matcher.final)) {
+        word[0] = '\0';
+        stopped = !visit(context, word, 0);
     }
+    int d = 0;
+    while(!stopped && d >= 0) {
+        int c = next[d];
+        Cursor child = d < MAX_WORD_LEN ? cursor_next(lex, nodes[d], &c) : (Cursor){ 0, 0 };
+        if(child.node == 0) {
+            d--;
+            continue;
+        }
+        next[d] = c + 1;
+        PatternStates reached = pattern_step(&matcher, states[d], c);
+        if(reached == 0) continue;
 
-    return words_in_branch || (*nodeptr)->is_word;
+        word[d] = c;
+        d++;
+        nodes[d] = child;
+        next[d] = 1;
+        states[d] = reached;
+        if((reached & matcher.final) && cursor_is_word(lex, child)) {
+            word[d] = '\0';
+            stopped = !visit(context, word, d);
+        }
+    }
+    reader_exit(reader, parity);
 }
 
-/* Function: clean_empty_branches
- * ------------------------------
- * Removes all nodes from the tree beginning at node that have no children representing words.
- * Effectively "cleans up" branches of the tree that are no longer in use. Called during
- * the remove function to ensure the contains_prefix functionality is as-intended.
- */ 
-static void scrub_empty_branches(CLexicon* lex, LexNode** nodeptr) {
-    //If the node at nodeptr is NULL, does nothing.
-    if(*nodeptr == NULL) return;
-
-    bool words_in_branch = branch_contains_words(lex, nodeptr);
-    //If there are words in this branch, go down a level and check for empty branches in children.
-    if((*nodeptr)->is_word || words_in_branch) {
-        for(int i = 0; i < ALPHA_SIZE; i++) {
-            scrub_empty_branches(lex, &(*nodeptr)->children[i]);
-        }
-    //Else, delete all of node's children and then delete node.
-    } else {
-        delete_node(lex, *nodeptr);
-        *nodeptr = NULL;
+/* Function: clex_match_letters
+ * ----------------------------
+ * Walks the tree in preorder, spending one tile from letters on every byte of the path: the
+ * byte's own tile while one is left, and otherwise a blank. A child with no tile left to spend
+ * on it is never visited, and neither is anything below the depth at which the tiles run out.
+ * tiles_used[d] remembers which tile the byte at depth d took, so climbing back gives it back.
+ */
+void clex_match_letters(CLexicon* lex, const char* letters, bool use_all, CLexVisitor visit, void* context) {
+    int tiles[NUM_SYMBOLS + 1] = { 0 };    //tiles[NUM_SYMBOLS] counts the blanks
+    int ntiles = 0;
+    for(const char* p = letters; *p != '\0'; p++, ntiles++) {
+        if(*p == '?') tiles[NUM_SYMBOLS]++;
+        else tiles[fold_case[(uint8_t)*p]]++;
+    }
+
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    Cursor nodes[MAX_WORD_LEN + 1];
+    uint16_t next[MAX_WORD_LEN + 1];
+    uint16_t tiles_used[MAX_WORD_LEN];
+    char word[MAX_WORD_LEN + 1];
+    nodes[0] = (Cursor){ load_slot(&lex->root), 0 };
+    next[0] = 1;
+
+    //The empty word is reported here, so every node on the stack has been reported already.
+    bool stopped = false;
+    if(cursor_is_word(lex, nodes[0]) && (!use_all || ntiles == 0)) {
+        word[0] = '\0';
+        stopped = !visit(context, word, 0);
     }
+    int d = 0;
+    while(!stopped) {
+        int c = next[d];
+        Cursor child = d < ntiles && d < MAX_WORD_LEN ? cursor_next(lex, nodes[d], &c) : (Cursor){ 0, 0 };
+        if(child.node == 0) {
+            if(d == 0) break;
+            d--;
+            tiles[tiles_used[d]]++;
+            continue;
+        }
+        next[d] = c + 1;
+        int tile = tiles[c] > 0 ? c : NUM_SYMBOLS;
+        if(tiles[tile] == 0) continue;
+
+        tiles[tile]--;
+        tiles_used[d] = tile;
+        word[d] = c;
+        d++;
+        nodes[d] = child;
+        next[d] = 1;
+        if((!use_all || d == ntiles) && cursor_is_word(lex, child)) {
+            word[d] = '\0';
+            stopped = !visit(context, word, d);
+        }
+    }
+    reader_exit(reader, parity);
 }
 
-/* Function: to_lower_case
- * -----------------------
- * Creates a lower-case copy of word with length wordlen and stores it in word_lower.
- */ 
-static inline void to_lower_case(char word_lower[], int wordlen, char* word) {
-    for(int i = 0; i < wordlen; i++) {
-        word_lower[i] = tolower(word[i]);
+/* Function: clex_longest_prefix
+ * -----------------------------
+ * Walks text from the root one byte at a time, remembering the last place that was a word, and
+ * stops where the tree ends, which is at most CLEX_MAX_WORD_LEN bytes in.
+ */
+size_t clex_longest_prefix(CLexicon* lex, const char* text, size_t len) {
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    Cursor cur = { load_slot(&lex->root), 0 };
+    size_t longest = 0;
+    if(len > MAX_WORD_LEN) len = MAX_WORD_LEN;
+    for(size_t i = 0; i < len; i++) {
+        int c = fold_case[(uint8_t)text[i]];
+        if(c == 0) break;
+        cur = cursor_child(lex, cur, c);
+        if(cur.node == 0) break;
+        if(cursor_is_word(lex, cur)) longest = i + 1;
     }
-    word_lower[wordlen] = '\0';
+    reader_exit(reader, parity);
+    return longest;
 }
 
-/* Fuction: clex_simple_add
- * ------------------------
- * Adds a word in all lower-case with length wordlen to the lexicon. Avoids checking the
- * case of the word. Retains the "clex" prefix because it could theoretically be listed
- * in the header file and considered available for client use. Remains hidden now for the
- * sake of simplicity of presentation.
- */ 
-static inline void clex_simple_add(CLexicon* lex, char* word_lower, int wordlen) {
-    //For every character in the word, accesses (or creates) subnodes.
-    LexNode* last_node = lex->root;
-    for(int i = 0; i < wordlen; i++) {
-        char ith = word_lower[i];
-        LexNode** next_node = &last_node->children[ith - 'a'];
-        if(*next_node == NULL) {
-            *next_node = create_node();
-        }
-        last_node = *next_node;
-    }
-    //Indicates that the final node, representing the string word, is added to the lexicon.
-    last_node->is_word = true;
-    lex->wordcount++;
+/* Function: clex_scanner_create
+ * -----------------------------
+ * Counts the places in the tree, allocates a state for each from the lexicon's allocator and
+ * builds the automaton over them with scanner_build, all in one reader section.
+ */
+CLexScanner* clex_scanner_create(CLexicon* lex) {
+    CLexAllocator allocator = lex->allocator;
+    CLexScanner* scanner = allocator.alloc(allocator.context, sizeof(CLexScanner));
+    scanner->allocator = allocator;
+    int parity;
+    ReaderSlot* reader = reader_enter(lex, &parity);
+    uint32_t capacity = count_places(lex);
+    scanner->capacity = capacity;
+    scanner->states = allocator.alloc(allocator.context, (capacity + 1) * sizeof(ScanState));
+    scanner->symbols = allocator.alloc(allocator.context, capacity * sizeof(uint8_t));
+    scanner->targets = allocator.alloc(allocator.context, capacity * sizeof(uint32_t));
+    Cursor* places = allocator.alloc(allocator.context, capacity * sizeof(Cursor));
+    scanner_build(scanner, lex, places, capacity);
+    reader_exit(reader, parity);
+    allocator.free(allocator.context, places, capacity * sizeof(Cursor));
+    return scanner;
 }
 
-/* Function: clex_contains_helper
- * ------------------------------
- * Helper method for contains that takes as an argument whether to search for prefix or word.
- */ 
-static inline bool clex_contains_helper(CLexicon* lex, char* word, bool isPrefix) {
-    //Creates a lower-case copy of the word.
-    int wordlen = strlen(word);
-    char word_lower[wordlen+1];
-    to_lower_case(word_lower, wordlen, word);
+/* Function: clex_scanner_delete
+ * -----------------------------
+ * Frees the scanner's arrays and the scanner itself through the allocator they came from.
+ */
+void clex_scanner_delete(CLexScanner* scanner) {
+    CLexAllocator allocator = scanner->allocator;
+    allocator.free(allocator.context, scanner->targets, scanner->capacity * sizeof(uint32_t));
+    allocator.free(allocator.context, scanner->symbols, scanner->capacity * sizeof(uint8_t));
+    allocator.free(allocator.context, scanner->states, (scanner->capacity + 1) * sizeof(ScanState));
+    allocator.free(allocator.context, scanner, sizeof(CLexScanner));
+}
 
-    //Traverses the tree from the root until it reaches the target node.
-    LexNode* curr_node = lex->root;
-    for(int i = 0; i < wordlen; i++) {
-        //If the tree ends before target node is reached, simply returns false.
-        if(curr_node == NULL) return false;
-        char ith = word_lower[i];
-        curr_node = curr_node->children[ith - 'a'];
+/* Function: clex_scanner_scan
+ * ---------------------------
+ * Steps the automaton once per byte of text, folding case through fold_case. A '\0' has no edge
+ * anywhere and returns the scanner to the root. After each byte, the words ending there are the
+ * state itself if it is a word and then every state along its output links.
+ */
+void clex_scanner_scan(const CLexScanner* scanner, const char* text, size_t len, CLexMatchVisitor visit, void* context) {
+    const ScanState* states = scanner->states;
+    uint32_t state = 0;
+    for(size_t i = 0; i < len; i++) {
+        state = scan_step(scanner, state, fold_case[(uint8_t)text[i]]);
+        uint32_t match = states[state].is_word ? state : states[state].output;
+        for(; match != 0; match = states[match].output) {
+            size_t matchlen = states[match].depth;
+            if(!visit(context, i + 1 - matchlen, matchlen)) return;
+        }
     }
-    if(curr_node == NULL) return false;
-
-    //Returns true if searching for a prefix, otherwise returns the node's is_word field.
-    return isPrefix || curr_node->is_word;
 }
 
+/* Function: gather_word
+ * ---------------------
+ * CLexVisitor for clex_infix_create, which appends each word to the text of the index.
+ */
+static bool gather_word(void* context, const char* word, size_t len) {
+    CLexInfix* index = context;
+    if(index->text_bytes + len + 1 > index->text_capacity) {
+        uint32_t capacity = index->text_capacity * 2 + len + 1;
+        uint8_t* text = index->allocator.alloc(index->allocator.context, capacity);
+        memcpy(text, index->text, index->text_bytes);
+        index->allocator.free(index->allocator.context, index->text, index->text_capacity);
+        index->text = text;
+        index->text_capacity = capacity;
+    }
+    memcpy(index->text + index->text_bytes, word, len + 1);
+    index->text_bytes += len + 1;
+    index->nwords++;
+    return true;
+}
 
-            /* * * Client Functions Listed in the Header File * * */
-
+/* Function: sort_suffixes
+ * -----------------------
+ * Sorts the n suffixes at offsets in text, which agree on their first depth bytes, by the bytes
+ * after those, with a multikey quicksort: the suffixes are split three ways by their next byte,
+ * and those that share it go on to be sorted by the byte after, so no byte is compared twice.
+ * Suffixes that are equal up to the '\0' ending them end up in no particular order.
+ */
+static void sort_suffixes(const uint8_t* text, uint32_t* offsets, size_t n, uint32_t depth) {
+    while(n > 1) {
+        if(n < 8) {
+            for(size_t i = 1; i < n; i++) {
+                uint32_t offset = offsets[i];
+                size_t j = i;
+                for(; j > 0 && strcmp((const char*)text + offsets[j - 1] + depth, (const char*)text + offset + depth) > 0; j--) {
+                    offsets[j] = offsets[j - 1];
+                }
+                offsets[j] = offset;
+            }
+            return;
+        }
+        //The pivot is the median of the first, middle and last suffixes' next bytes.
+        uint8_t x = text[offsets[0] + depth], y = text[offsets[n / 2] + depth], z = text[offsets[n - 1] + depth];
+        uint8_t pivot = x < y ? (y < z ? y : x < z ? z : x) : (x < z ? x : y < z ? z : y);
+        size_t lt = 0, i = 0, gt = n;
+        while(i < gt) {
+            uint8_t c = text[offsets[i] + depth];
+            uint32_t swap = offsets[i];
+            if(c < pivot) {
+                offsets[i++] = offsets[lt];
+                offsets[lt++] = swap;
+            } else if(c > pivot) {
+                offsets[i] = offsets[--gt];
+                offsets[gt] = swap;
+            } else {
+                i++;
+            }
+        }
+        sort_suffixes(text, offsets, lt, depth);
+        sort_suffixes(text, offsets + gt, n - gt, depth);
+        if(pivot == 0) return;
+        offsets += lt;
+        n = gt - lt;
+        depth++;
+    }
+}
 
-/* Function: clex_create
- * ---------------------
- * Creates a new CLexicon* which is initialized and returned. The client only accesses
- * a pointer to the CLexicon and should never need to interact with the actual struct.
+/* Function: compare_words
+ * -----------------------
+ * qsort comparator for word numbers, which are in the order of the words.
  */
-CLexicon* clex_create() {
-    CLexicon* lex = malloc(sizeof(CLexicon));
-    lex->root = create_node();
-    lex->wordcount = 0;
-    return lex;
+static int compare_words(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
 }
 
-/* Function: clex_delete
- * ---------------------
- * Frees all memory associated with a CLexicon*.
- */ 
-void clex_delete(CLexicon* lex) {
-   delete_node(lex, lex->root);
-   free(lex);
+/* Function: clex_infix_create
+ * ---------------------------
+ * Copies the words into the index's text in one reader section (see clex_visit_prefix), notes
+ * where each begins, and sorts the offsets of every suffix with sort_suffixes.
+ */
+CLexInfix* clex_infix_create(CLexicon* lex) {
+    CLexAllocator allocator = lex->allocator;
+    CLexInfix* index = allocator.alloc(allocator.context, sizeof(CLexInfix));
+    index->allocator = allocator;
+    index->text_capacity = 4096;
+    index->text = allocator.alloc(allocator.context, index->text_capacity);
+    index->text_bytes = 0;
+    index->nwords = 0;
+    clex_visit_prefix(lex, "", gather_word, index);
+
+    index->starts = allocator.alloc(allocator.context, (index->nwords + 1) * sizeof(uint32_t));
+    index->nsuffixes = index->text_bytes - index->nwords;
+    index->suffixes = allocator.alloc(allocator.context, (index->nsuffixes + 1) * sizeof(uint32_t));
+    uint32_t word = 0, nsuffixes = 0;
+    for(uint32_t i = 0; i < index->text_bytes; i++) {
+        if(i == 0 || index->text[i - 1] == '\0') index->starts[word++] = i;
+        if(index->text[i] != '\0') index->suffixes[nsuffixes++] = i;
+    }
+    index->starts[word] = index->text_bytes;
+    sort_suffixes(index->text, index->suffixes, nsuffixes, 0);
+    return index;
 }
 
-/* Function: clex_add
- * ------------------
- * Adds the given word to the CLexicon after converting it to lower case.
- */ 
-void clex_add(CLexicon* lex, char* word) {
-    //Creates a lower-case copy of the word.
-    int wordlen = strlen(word);
-    char word_lower[wordlen+1];
-    to_lower_case(word_lower, wordlen, word);
-    
-    //simple_add is a helper function that adds the word and increments the wordcount.
-    clex_simple_add(lex, word_lower, wordlen);
+/* Function: clex_infix_delete
+ * ---------------------------
+ * Frees the index's arrays and the index itself through the allocator they came from.
+ */
+void clex_infix_delete(CLexInfix* index) {
+    CLexAllocator allocator = index->allocator;
+    allocator.free(allocator.context, index->suffixes, (index->nsuffixes + 1) * sizeof(uint32_t));
+    allocator.free(allocator.context, index->starts, (index->nwords + 1) * sizeof(uint32_t));
+    allocator.free(allocator.context, index->text, index->text_capacity);
+    allocator.free(allocator.context, index, sizeof(CLexInfix));
 }
 
-/* Function: clex_add_from_file
- * ----------------------------
- * This function fills a lexicon with entires from a text file where each line
- * contains a single string of text with letters a-z or A-Z. If the file cannot
- * be opened or a bad line of text is reached, the function returns false to indicate
- * a failure in reading. If "is_lower_case" is true, uses clex_simple_add to add each
- * line, which does not check case. If it is false, uses clex_add, which is more expensive.
- */ 
-bool clex_add_from_file(CLexicon* lex, char* filename, bool is_lower_case) {
-    FILE* lex_file = fopen(filename, "r");
-    if(lex_file == NULL) {
-        return false;
+/* Function: clex_infix_visit
+ * --------------------------
+ * Finds the run of suffixes beginning with the folded infix by binary search, turns each into the
+ * number of the word it lies in, again by binary search over starts, and hands the words to visit
+ * in order, once each however often they contain the infix. The empty infix is in every word.
+ */
+void clex_infix_visit(const CLexInfix* index, const char* infix, CLexVisitor visit, void* context) {
+    size_t len = strlen(infix);
+    if(len > MAX_WORD_LEN) return;
+    if(len == 0) {
+        for(uint32_t w = 0; w < index->nwords; w++) {
+            uint32_t start = index->starts[w];
+            if(!visit(context, (const char*)index->text + start, index->starts[w + 1] - start - 1)) return;
+        }
+        return;
     }
+    char symbols[MAX_WORD_LEN + 1];
+    for(size_t i = 0; i < len; i++) symbols[i] = fold_case[(uint8_t)infix[i]];
+    symbols[len] = '\0';
 
-    char line[MAX_WORD_LEN+1];
-    //Reads lines from the file, adding them to the lexicon one by one.
-    while(fgets(line, sizeof(line), lex_file)) {
-        //Scans the line to make sure that it was processed correctly. 45 is MAX_WORD_LEN.
-        char word[MAX_WORD_LEN+1];
-        int nscanned = sscanf(line, "%45[ a-zA-Z]", word);
-        if(nscanned != 1) {
-            fclose(lex_file);
-            return false;
+    size_t lo = 0, hi = index->nsuffixes;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(strncmp((const char*)index->text + index->suffixes[mid], symbols, len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t first = lo;
+    hi = index->nsuffixes;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(strncmp((const char*)index->text + index->suffixes[mid], symbols, len) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t nmatches = lo - first;
+    if(nmatches == 0) return;
+
+    CLexAllocator allocator = index->allocator;
+    uint32_t* words = allocator.alloc(allocator.context, nmatches * sizeof(uint32_t));
+    for(size_t i = 0; i < nmatches; i++) {
+        uint32_t offset = index->suffixes[first + i];
+        uint32_t a = 0, b = index->nwords;
+        while(b - a > 1) {
+            uint32_t mid = a + (b - a) / 2;
+            if(index->starts[mid] <= offset) a = mid;
+            else b = mid;
         }
+        words[i] = a;
+    }
+    qsort(words, nmatches, sizeof(uint32_t), compare_words);
+    for(size_t i = 0; i < nmatches; i++) {
+        if(i > 0 && words[i] == words[i - 1]) continue;
+        uint32_t start = index->starts[words[i]];
+        if(!visit(context, (const char*)index->text + start, index->starts[words[i] + 1] - start - 1)) break;
+    }
+    allocator.free(allocator.context, words, nmatches * sizeof(uint32_t));
+}
+
+/* Function: clex_contains_batch
+ * -----------------------------
+ * Sets out[i] to whether the lexicon contains words[i], for every i below n.
+ */
+void clex_contains_batch(CLexicon* lex, const char** words, size_t n, bool* out) {
+    clex_contains_batch_helper(lex, words, n, out, false);
+}
+
+/* Function: clex_contains_prefix_batch
+ * ------------------------------------
+ * Sets out[i] to whether the lexicon contains any word beginning with prefixes[i].
+ */
+void clex_contains_prefix_batch(CLexicon* lex, const char** prefixes, size_t n, bool* out) {
+    clex_contains_batch_helper(lex, prefixes, n, out, true);
+}
 
-        //Adds the word depending on whether it is guarunteed to be lower case or not.
-        is_lower_case ? clex_simple_add(lex, word, strlen(word)) : clex_add(lex, word);
+/* Function: clex_contains_parallel
+ * --------------------------------
+ * Looks up the n words on nthreads threads, each running clex_contains_batch over chunks of
+ * the words, and stealing chunks from the others once its own share is done (see CLexPool).
+ * Batches too small to be worth starting threads for are looked up on the calling thread.
+ */
+void clex_contains_parallel(CLexicon* lex, const char** words, size_t n, bool* out, int nthreads) {
+    if(nthreads <= 1 || n <= POOL_CHUNK_WORDS) {
+        clex_contains_batch_helper(lex, words, n, out, false);
+        return;
     }
+    CLexPool* pool = pool_create(&lex->allocator, nthreads);
+    clex_pool_contains(pool, lex, words, n, out);
+    clex_pool_delete(pool);
+}
 
-    fclose(lex_file);
-    return true; 
+/* Function: clex_pool_create
+ * --------------------------
+ * Starts a pool of nthreads threads that wait for batches of lookups.
+ */
+CLexPool* clex_pool_create(int nthreads) {
+    return pool_create(&default_allocator, nthreads);
 }
 
-/* Function: clex_clear
- * --------------------
- * Deletes all entires from the CLexicon, initializes a new root node, and sets
- * the word count to zero.
- */ 
-void clex_clear(CLexicon* lex) {
-    delete_node(lex, lex->root);
-    lex->root = create_node();
-    lex->wordcount = 0;
+/* Function: clex_pool_delete
+ * --------------------------
+ * Waits for the pool's current batch, then stops its threads and frees it.
+ */
+void clex_pool_delete(CLexPool* pool) {
+    clex_pool_wait(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for(int t = 0; t < pool->nthreads; t++) {
+        pthread_join(pool->workers[t].thread, NULL);
+    }
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_mutex_destroy(&pool->lock);
+    CLexAllocator allocator = pool->allocator;
+    if(pool->workers != NULL) allocator.free(allocator.context, pool->workers, pool->capacity * sizeof(PoolWorker));
+    allocator.free(allocator.context, pool, sizeof(CLexPool));
 }
 
-/* Function: clex_contains
- * -----------------------
- * Traverses the tree from the root until it reaches the node that corresponds
- * to the given word. Returns that node's is_word field, indicating whether word
- * is a member of the CLexicon.
- */ 
-bool clex_contains(CLexicon* lex, char* word) {
-    //Calls the helper function with the "isPrefix" field set to false.
-    return clex_contains_helper(lex, word, false);
+/* Function: clex_pool_submit
+ * --------------------------
+ * Waits for the pool's previous batch, then splits this one into chunks of POOL_CHUNK_WORDS
+ * words, deals them out evenly to the workers and wakes them. Returns without waiting for the
+ * lookups, which the workers balance between themselves by stealing chunks.
+ */
+void clex_pool_submit(CLexPool* pool, CLexicon* lex, const char** words, size_t n, bool* out) {
+    if(pool->nthreads == 0) {
+        clex_contains_batch_helper(lex, words, n, out, false);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while(pool->busy > 0) pthread_cond_wait(&pool->job_done, &pool->lock);
+    if(n > 0) {
+        pool->lex = lex;
+        pool->words = words;
+        pool->n = n;
+        pool->out = out;
+        uint64_t nchunks = (n + POOL_CHUNK_WORDS - 1) / POOL_CHUNK_WORDS;
+        for(int t = 0; t < pool->nthreads; t++) {
+            uint32_t begin = nchunks * t / pool->nthreads;
+            uint32_t end = nchunks * (t + 1) / pool->nthreads;
+            __atomic_store_n(&pool->workers[t].range, pool_range(begin, end), __ATOMIC_RELAXED);
+        }
+        pool->busy = pool->nthreads;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->job_ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
 }
 
-/* Function: clex_contains_prefix
- * ------------------------------
- * Returns true if the lexicon contains any intermediate nodes corresponding to the given
- * prefix, regardless of whether their is_word field is true. Returns false if a NULL node
- * is reached while searching for the prefix.
- */ 
-bool clex_contains_prefix(CLexicon* lex, char* prefix) {
-    //Calls the helper function with the "isPrefix" field set to true.
-    return clex_contains_helper(lex, prefix, true);
+/* Function: clex_pool_wait
+ * ------------------------
+ * Blocks until the workers have finished the pool's current batch.
+ */
+void clex_pool_wait(CLexPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    while(pool->busy > 0) pthread_cond_wait(&pool->job_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Function: clex_pool_contains
+ * ----------------------------
+ * Submits the batch to the pool and waits for it.
+ */
+void clex_pool_contains(CLexPool* pool, CLexicon* lex, const char** words, size_t n, bool* out) {
+    clex_pool_submit(pool, lex, words, n, out);
+    clex_pool_wait(pool);
 }
 
 /* Function: clex_isEmpty
@@ -292,76 +4914,392 @@ bool clex_contains_prefix(CLexicon* lex, char* prefix) {
  * Returns true if the CLexicon is empty, false otherwise.
  * Named in lowerCamelCase because every isEmpty function I've ever encountered
  * has looked that way, and it just seems to fit better than is_empty.
- */ 
+ */
 bool clex_isEmpty(CLexicon* lex) {
-    return lex->wordcount == 0;
+    return load_wordcount(lex) == 0;
 }
 
 /* Function: clex_remove
  * ---------------------
  * Removes the target word from the CLexicon by traversing the tree until it reaches
- * the node corresponding to word, then changing its is_word field to false. If there
- * are no nodes beneath the word node, deletes the node from the tree and sets its
- * parent's pointer to it to NULL. Returns false if the word is not a member of the CLexicon.
- */ 
+ * the node corresponding to word, then clearing its word flag. The part of the word's
+ * path left without any words is then released (see remove_word_helper). Returns false
+ * if the word is not a member of the CLexicon.
+ */
 bool clex_remove(CLexicon* lex, char* word) {
-    //Creates a lower-case copy of word.
-    int wordlen = strlen(word);
-    char word_lower[wordlen+1];
-    to_lower_case(word_lower, wordlen, word);
-
-    //Iterates through the letters, descending down the tree to the penultimate letter.
-    LexNode** curr_node = &lex->root;
-    for(int i = 0; i < wordlen - 1; i++) {
-        if(*curr_node == NULL) return false;
-        char ith = word_lower[i];
-        curr_node = &((*curr_node)->children[ith - 'a']);
-    }
-    LexNode** word_node = &(*curr_node)->children[word_lower[wordlen - 1] - 'a'];
-    if(*word_node == NULL) return false;
-    (*word_node)->is_word = false;
-    lex->wordcount--;
-
-    //Checks to see if word_node has children. If not, deletes the node and points word_node to NULL.
-    for(int i = 0; i < ALPHA_SIZE; i++) {
-        if((*word_node)->children[i] != NULL) return true;
-    }
-    free(*word_node);
-    *word_node = NULL;
-    //Ensures that prefix functionality is maintained correctly by removing unused branches from tree.
-    scrub_empty_branches(lex, &lex->root);
-    return true;
+    return clex_remove_n(lex, word, NUL_TERMINATED);
+}
+
+/* Function: clex_remove_n
+ * -----------------------
+ * As clex_remove, but reads exactly len bytes of word.
+ */
+bool clex_remove_n(CLexicon* lex, const char* word, size_t len) {
+    long wordlen = word_length(word, len);
+    if(wordlen < 0 || lex->is_snapshot) return false;
+    writer_lock(lex);
+    bool removed = remove_word_helper(lex, word, wordlen);
+    if(removed) jump_update(lex, word, wordlen);
+    writer_unlock(lex);
+    return removed;
+}
+
+/* Function: clex_remove_batch
+ * ---------------------------
+ * Removes every word in words, taking the writer lock and releasing retired nodes once for the
+ * whole batch rather than once per word. A frozen lexicon is thawed at most once.
+ */
+void clex_remove_batch(CLexicon* lex, const char** words, size_t n, bool* out) {
+    if(lex->is_snapshot) {
+        if(out != NULL) memset(out, 0, n * sizeof(bool));
+        return;
+    }
+    writer_lock(lex);
+    for(size_t i = 0; i < n; i++) {
+        long wordlen = word_length(words[i], NUL_TERMINATED);
+        bool removed = wordlen >= 0 && remove_word_helper(lex, words[i], wordlen);
+        if(removed) jump_update(lex, words[i], wordlen);
+        if(out != NULL) out[i] = removed;
+    }
+    writer_unlock(lex);
 }
 
 /* Function: clex_remove_prefix
  * ----------------------------
  * Removes all words with the given prefix from the lexicon by traversing the tree to get to
- * the prefix node (if it exists) and then recursively descending down each of its child trees,
- * removing all nodes below it (uses the "delete_node_helper" method). Returns true if the
- * prefix and its subtree has been removed, false if the tree never contained the prefix.
+ * the prefix node (if it exists) and cutting it off along with its whole subtree, which is
+ * released lazily (see remove_prefix_helper). Ancestors of the prefix node that no longer lead
+ * to any word go with it. Returns true if the prefix and its subtree has been removed, false
+ * if the tree never contained the prefix.
+ * The empty prefix removes every word but keeps the root.
  */
 bool clex_remove_prefix(CLexicon* lex, char* prefix) {
-    int preflen = strlen(prefix);
-    char pref_lower[preflen+1];
-    to_lower_case(pref_lower, preflen, prefix);
-
-    LexNode** curr_node = &lex->root;
-    for(int i = 0; i < preflen; i++) {
-        if(*curr_node == NULL) return false;
-        char ith = pref_lower[i];
-        curr_node = &((*curr_node)->children[ith - 'a']);
-    }
-    if(*curr_node == NULL) return false;
-    //Deletes the prefix node and its entire subtree.
-    delete_node_helper(lex, curr_node);
-    *curr_node = NULL;
-    return true;
+    return clex_remove_prefix_n(lex, prefix, NUL_TERMINATED);
+}
+
+/* Function: clex_remove_prefix_n
+ * ------------------------------
+ * As clex_remove_prefix, but reads exactly len bytes of prefix.
+ */
+bool clex_remove_prefix_n(CLexicon* lex, const char* prefix, size_t len) {
+    long preflen = word_length(prefix, len);
+    if(preflen < 0 || lex->is_snapshot) return false;
+    writer_lock(lex);
+    bool removed = remove_prefix_helper(lex, prefix, preflen);
+    //A prefix shorter than two bytes may take a whole row of the jump table with it.
+    if(removed && preflen < 2) jump_rebuild(lex);
+    else if(removed) jump_update(lex, prefix, preflen);
+    writer_unlock(lex);
+    return removed;
+}
+
+/* Function: clex_freeze
+ * ---------------------
+ * Minimizes the tree into a directed acyclic word graph by registering every node bottom-up
+ * (see freeze_node), so that identical suffix subtrees such as those under "-ing" or "-ness"
+ * are stored once. The result is copied into one block of exactly the right size, in the order
+ * lookups visit it (see layout_image), and the old slabs are released.
+ */
+void clex_freeze(CLexicon* lex) {
+    if(lex->is_snapshot) return;
+    writer_lock(lex);
+    if(lex->image == NULL) {
+        NodeRegister reg;
+        uint32_t root = build_image(lex, &reg);
+        adopt_image(lex, reg.words, reg.nwords, reg.capacity, root);
+    }
+    if(lex->reversed != NULL) clex_freeze(lex->reversed);
+    writer_unlock(lex);
+}
+
+/* Function: clex_isFrozen
+ * -----------------------
+ * Returns true if the CLexicon is currently frozen. Named to match clex_isEmpty.
+ */
+bool clex_isFrozen(CLexicon* lex) {
+    return lex->image != NULL;
+}
+
+/* Function: clex_optimize_layout
+ * ------------------------------
+ * Copies the tree of a lexicon that is not frozen into a new arena in the order lookups visit it
+ * (see relayout_node), and releases the old one, nodes unlinked but not yet reused included. A
+ * frozen image is laid out that way already when it is built (see layout_image), and is left
+ * as it is.
+ */
+void clex_optimize_layout(CLexicon* lex) {
+    if(lex->is_snapshot) return;
+    writer_lock(lex);
+    if(lex->image == NULL) relayout_arena(lex);
+    if(lex->reversed != NULL) clex_optimize_layout(lex->reversed);
+    writer_unlock(lex);
+}
+
+/* Function: clex_save_binary
+ * --------------------------
+ * Writes an ImageHeader followed by the frozen image of the lexicon. A frozen lexicon's image
+ * is written as it is; any other lexicon is minimized into a temporary image first, leaving
+ * the lexicon itself untouched. The data goes to a temporary file that is then renamed over
+ * filename, so processes that have the old file mapped (including lex itself) keep a valid
+ * copy. Returns false if the file cannot be written.
+ */
+bool clex_save_binary(CLexicon* lex, const char* filename) {
+    //Holding the writer lock keeps the tree still while it is minimized and written.
+    writer_lock(lex);
+    NodeRegister reg = { NULL, 0, 0, NULL, 0, 0 };
+    const uint32_t* image = lex->image;
+    ImageHeader header = { IMAGE_MAGIC, IMAGE_VERSION, IMAGE_BYTE_ORDER, lex->wordcount, lex->root, lex->image_words };
+    if(image == NULL) {
+        header.root = build_image(lex, &reg);
+        header.nwords = reg.nwords;
+        image = reg.words;
+    }
+
+    size_t namelen = strlen(filename);
+    char tmpname[namelen + sizeof(".tmp")];
+    memcpy(tmpname, filename, namelen);
+    memcpy(tmpname + namelen, ".tmp", sizeof(".tmp"));
+
+    FILE* out = fopen(tmpname, "wb");
+    bool written = out != NULL
+                && fwrite(&header, sizeof(header), 1, out) == 1
+                && fwrite(image, sizeof(uint32_t), header.nwords, out) == header.nwords;
+    if(out != NULL && fclose(out) != 0) written = false;
+    if(written) written = rename(tmpname, filename) == 0;
+    if(!written && out != NULL) remove(tmpname);
+
+    if(reg.words != NULL) lex->allocator.free(lex->allocator.context, reg.words, reg.capacity * sizeof(uint32_t));
+    writer_unlock(lex);
+    return written;
+}
+
+/* Function: image_node_fits
+ * -------------------------
+ * Returns true if the node of a mapped image at index has a layout this build can read and
+ * fits in the nwords words of the image, so that node_words and the child helpers stay inside
+ * it. A bitmap node's child count must agree with its bitmap, since lookups rank by the bitmap.
+ */
+static bool image_node_fits(const uint32_t* image, uint32_t nwords, uint32_t index) {
+    if((uint64_t)index + 2 > nwords) return false;
+    uint32_t info = image[index];
+    uint32_t extras = info >> EXTRA_SHIFT;
+    if(extras > MAX_EXTRA_KEYS && extras != EXTRA_CHAIN && extras != EXTRA_BITMAP) return false;
+    if(extras == EXTRA_CHAIN && (chain_length(info) == 0 || chain_length(info) > MAX_WORD_LEN)) return false;
+    uint64_t before_children = (uint64_t)index + header_words(info) + extra_words(info);
+    if(before_children > nwords) return false;
+    const LexNode* node = (const LexNode*)&image[index];
+    if(extras == EXTRA_BITMAP) {
+        const uint32_t* extra = extra_slots(node, info);
+        uint32_t bits = 0;
+        for(int w = 0; w < NUM_SYMBOLS / 32; w++) bits += __builtin_popcount(extra[1 + w]);
+        if(extra[0] != bits || bits > MAX_CHILDREN) return false;
+    }
+    return before_children + child_count(node, info) <= nwords;
+}
+
+/* Function: image_is_valid
+ * ------------------------
+ * Checks the nwords words of a mapped image before it is adopted, in time linear in its size:
+ * every node must fit (see image_node_fits), every child index and the root must be the start
+ * of a node, and the nodes must form a graph without cycles in which no path spells more than
+ * MAX_WORD_LEN bytes. The last two are checked by taking the nodes in topological order, each
+ * one once the nodes above it are done, keeping the longest path to it in depths.
+ */
+static bool image_is_valid(CLexicon* lex, const uint32_t* image, uint32_t nwords, uint32_t root) {
+    size_t bytes = (size_t)nwords * sizeof(uint32_t);
+    uint32_t* depths = lex->allocator.alloc(lex->allocator.context, bytes);
+    uint32_t* parents = lex->allocator.alloc(lex->allocator.context, bytes);
+    uint32_t* ready = lex->allocator.alloc(lex->allocator.context, bytes);
+    memset(depths, 0, bytes);
+    memset(parents, 0, bytes);
+
+    //depths marks the start of every node with 1 until the topological pass, which stores 1 + depth.
+    bool valid = true;
+    uint32_t nnodes = 0;
+    for(uint32_t at = 1; at < nwords; at += node_words((const LexNode*)&image[at])) {
+        if(!image_node_fits(image, nwords, at)) {
+            valid = false;
+            break;
+        }
+        depths[at] = 1;
+        nnodes++;
+    }
+    valid = valid && root != 0 && root < nwords && depths[root] != 0;
+    for(uint32_t at = 1; at < nwords && valid; at += node_words((const LexNode*)&image[at])) {
+        const LexNode* node = (const LexNode*)&image[at];
+        uint32_t info = node->info;
+        const uint32_t* children = child_slots(node, info);
+        for(int i = 0; i < child_count(node, info) && valid; i++) {
+            valid = children[i] != 0 && children[i] < nwords && depths[children[i]] != 0;
+            if(valid) parents[children[i]]++;
+        }
+    }
+
+    uint32_t nready = 0, ndone = 0;
+    for(uint32_t at = 1; at < nwords && valid; at += node_words((const LexNode*)&image[at])) {
+        if(parents[at] == 0) ready[nready++] = at;
+    }
+    while(valid && nready > 0) {
+        uint32_t at = ready[--nready];
+        ndone++;
+        const LexNode* node = (const LexNode*)&image[at];
+        uint32_t info = node->info;
+        uint32_t depth = depths[at] + (is_chain(info) ? chain_length(info) : 1);
+        valid = depth <= MAX_WORD_LEN + 1;
+        const uint32_t* children = child_slots(node, info);
+        for(int i = 0; i < child_count(node, info) && valid; i++) {
+            if(depths[children[i]] < depth) depths[children[i]] = depth;
+            if(--parents[children[i]] == 0) ready[nready++] = children[i];
+        }
+    }
+    //A node left over lies on a cycle or below one.
+    valid = valid && ndone == nnodes;
+
+    lex->allocator.free(lex->allocator.context, ready, bytes);
+    lex->allocator.free(lex->allocator.context, parents, bytes);
+    lex->allocator.free(lex->allocator.context, depths, bytes);
+    return valid;
+}
+
+/* Function: clex_open_mapped
+ * --------------------------
+ * Maps a file written by clex_save_binary read-only and shares its pages with every other
+ * process mapping the same file. The header is checked against this build, and the image
+ * itself with image_is_valid, before it is adopted as a frozen lexicon.
+ * Returns NULL if the file cannot be opened or was not written by a compatible build.
+ */
+CLexicon* clex_open_mapped(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return NULL;
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ImageHeader)) {
+        mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if(mapping == MAP_FAILED) return NULL;
+
+    const ImageHeader* header = mapping;
+    if(header->magic != IMAGE_MAGIC || header->version != IMAGE_VERSION
+       || header->byte_order != IMAGE_BYTE_ORDER || header->nwords < 2 || header->root >= header->nwords
+       || (size_t)st.st_size != sizeof(ImageHeader) + (size_t)header->nwords * sizeof(uint32_t)) {
+        munmap(mapping, st.st_size);
+        return NULL;
+    }
+
+    CLexicon* lex = clex_create();
+    if(!image_is_valid(lex, (const uint32_t*)(header + 1), header->nwords, header->root)) {
+        clex_delete(lex);
+        munmap(mapping, st.st_size);
+        return NULL;
+    }
+    adopt_image(lex, (uint32_t*)(header + 1), header->nwords, 0, header->root);
+    lex->mapping = mapping;
+    lex->mapping_size = st.st_size;
+    lex->wordcount = header->wordcount;
+    return lex;
 }
 
 /* Function: clex_wordcount
  * ------------------------
  * Returns the number of entries in the CLexicon.
- */ 
+ */
 int clex_wordcount(CLexicon* lex) {
-    return lex->wordcount;
+    return load_wordcount(lex);
+}
+
+/* Function: clex_stats
+ * --------------------
+ * Adds up the memory held by the lexicon from what it allocated, then walks the places with
+ * stats_walk. The nodes of a frozen image are read in the order they were laid out instead,
+ * since the walk would count a shared node once for every place it stands for. Released nodes
+ * are found on the freelists, and unlinked ones on the dead list and the retire lists.
+ */
+void clex_stats(CLexicon* lex, CLexStats* out) {
+    writer_lock(lex);
+    memset(out, 0, sizeof(CLexStats));
+    out->words = lex->wordcount;
+    out->bytes_allocated = sizeof(CLexicon) + lex->slab_capacity * sizeof(uint32_t*);
+    for(uint32_t i = 0; i < lex->nold_tables; i++) out->bytes_allocated += lex->old_capacities[i] * sizeof(uint32_t*);
+    if(lex->readers != NULL) out->bytes_allocated += READER_SLOTS * sizeof(ReaderSlot);
+    out->bytes_allocated += (lex->retired.capacity + lex->waiting.capacity) * sizeof(uint32_t);
+
+    if(lex->image != NULL) {
+        //A mapped image and the image a snapshot reads are not the lexicon's to fill, and record no capacity.
+        size_t capacity = lex->image_capacity > lex->image_words ? lex->image_capacity : lex->image_words;
+        out->bytes_allocated += lex->mapping != NULL ? lex->mapping_size : capacity * sizeof(uint32_t);
+        out->bytes_free = (capacity - lex->image_words) * sizeof(uint32_t);
+        for(uint32_t at = 1; at < lex->image_words; at += node_words(node_at(lex, at))) out->nodes++;
+        out->bytes_in_nodes = (lex->image_words - 1) * sizeof(uint32_t);
+    } else {
+        out->bytes_allocated += (size_t)lex->nslabs * SLAB_WORDS * sizeof(uint32_t);
+        if(lex->nslabs > 0) out->bytes_free = (SLAB_WORDS - lex->slab_used) * sizeof(uint32_t);
+        for(uint32_t nwords = 0; nwords <= MAX_NODE_WORDS; nwords++) {
+            for(uint32_t index = lex->freelists[nwords]; index != 0; index = node_at(lex, index)->info) {
+                out->bytes_free += nwords * sizeof(uint32_t);
+            }
+        }
+        for(uint32_t index = lex->dead; index != 0; index = node_at(lex, index)->count) {
+            out->unlinked_nodes += count_subtree(lex, index);
+        }
+        out->unlinked_nodes += count_retired(lex, &lex->retired) + count_retired(lex, &lex->waiting);
+    }
+    stats_walk(lex, out, lex->image == NULL);
+#ifdef CLEX_COUNTERS
+    out->lookups = __atomic_load_n(&lex->counters[COUNT_LOOKUPS], __ATOMIC_RELAXED);
+    out->hits = __atomic_load_n(&lex->counters[COUNT_HITS], __ATOMIC_RELAXED);
+    out->misses = __atomic_load_n(&lex->counters[COUNT_MISSES], __ATOMIC_RELAXED);
+    out->nodes_visited = __atomic_load_n(&lex->counters[COUNT_NODES], __ATOMIC_RELAXED);
+#endif
+    writer_unlock(lex);
+}
+
+/* Function: clex_set_suffix_index
+ * --------------------------------
+ * Gives the lexicon a suffix index, a second lexicon of its words spelled backwards that has the
+ * same allocator and concurrent mode, filled from the words it holds now; or deletes the index.
+ * From then on changes of single words are made to both (see clex_simple_add and the remove
+ * helpers), and the index is rebuilt after bulk changes (see reverse_rebuild).
+ */
+void clex_set_suffix_index(CLexicon* lex, bool enabled) {
+    if(lex->is_snapshot || enabled == (lex->reversed != NULL)) return;
+    writer_lock(lex);
+    if(enabled) {
+        lex->reversed = clex_create_with_allocator(&lex->allocator);
+        clex_set_concurrent(lex->reversed, lex->concurrent);
+        reverse_rebuild(lex);
+    } else {
+        clex_delete(lex->reversed);
+        lex->reversed = NULL;
+    }
+    writer_unlock(lex);
+}
+
+/* Function: clex_set_concurrent
+ * -----------------------------
+ * Switches concurrent mode on or off. Turning it on gives the lexicon its reader slots;
+ * turning it off releases every retired node at once, along with the replaced slabs tables
+ * and the slots, which is safe because no reader may be running.
+ */
+void clex_set_concurrent(CLexicon* lex, bool concurrent) {
+    if(concurrent == lex->concurrent) return;
+    if(lex->reversed != NULL) clex_set_concurrent(lex->reversed, concurrent);
+    if(concurrent) {
+        lex->readers = lex->allocator.alloc(lex->allocator.context, READER_SLOTS * sizeof(ReaderSlot));
+        memset(lex->readers, 0, READER_SLOTS * sizeof(ReaderSlot));
+        lex->epoch = 0;
+        lex->concurrent = true;
+        return;
+    }
+    release_retired(lex, &lex->waiting);
+    release_retired(lex, &lex->retired);
+    free_retire_list(lex, &lex->waiting);
+    free_retire_list(lex, &lex->retired);
+    for(uint32_t i = 0; i < lex->nold_tables; i++) {
+        lex->allocator.free(lex->allocator.context, lex->old_tables[i], lex->old_capacities[i] * sizeof(uint32_t*));
+    }
+    lex->nold_tables = 0;
+    lex->allocator.free(lex->allocator.context, lex->readers, READER_SLOTS * sizeof(ReaderSlot));
+    lex->readers = NULL;
+    lex->concurrent = false;
 }
@@ -5,6 +5,11 @@
  * and retrieval of words (strings). It is equivalent to a set but
  * is internally optimized to process strings very efficiently.
  *
+ * A word is any string of bytes other than '\0', so words may hold digits,
+ * punctuation or UTF-8 text. The letters a-z are case-insensitive and are
+ * always returned in lower case; every other byte is kept exactly as given,
+ * and words are ordered byte by byte.
+ *
  * Modeled after "Lexicon" from the Stanford C++ Libraries.
  */
 
@@ -12,6 +17,23 @@
 #define _CLexicon_h
 
 #include <stdbool.h>    //defines the bool type
+#include <stddef.h>     //defines the size_t type
+#include <stdint.h>     //defines the uint32_t type
+
+/* Constant: CLEX_MAX_WORD_LEN
+ * ---------------------------
+ * The length in bytes of the longest word a CLexicon accepts: that of the longest English word
+ * included in a major dictionary (pneumonoultramicroscopicsilicovolcanoconiosis). A buffer of
+ * CLEX_MAX_WORD_LEN + 1 chars holds any word along with its terminating '\0'.
+ */
+#define CLEX_MAX_WORD_LEN 45
+
+/* Constant: CLEX_STATS_MAX_FANOUT
+ * -------------------------------
+ * The number of children from which on places are counted together in the fanout histogram of
+ * a CLexStats.
+ */
+#define CLEX_STATS_MAX_FANOUT 32
 
 
             /*** struct partial definitions ***/
@@ -32,6 +54,119 @@ typedef struct LexNode LexNode;
  */ 
 typedef struct CLexiconImplementation CLexicon;
 
+/* Struct: CLexPoolImplementation
+ * ------------------------------
+ * Incomplete declaration of struct CLexPoolImplementation, a pool of threads that look up
+ * batches of words (see clex_pool_create).
+ */
+typedef struct CLexPoolImplementation CLexPool;
+
+/* Struct: CLexScannerImplementation
+ * ---------------------------------
+ * Incomplete declaration of struct CLexScannerImplementation, an automaton that finds the words
+ * of a CLexicon inside a text (see clex_scanner_create).
+ */
+typedef struct CLexScannerImplementation CLexScanner;
+
+/* Struct: CLexInfixImplementation
+ * -------------------------------
+ * Incomplete declaration of struct CLexInfixImplementation, a suffix array over the words of a
+ * CLexicon for finding those that contain given bytes (see clex_infix_create).
+ */
+typedef struct CLexInfixImplementation CLexInfix;
+
+/* Struct: CLexAllocator
+ * ---------------------
+ * A client-supplied allocator for embedding the CLexicon in programs that manage their own memory.
+ * The CLexicon requests its nodes in large slabs, so alloc is called rarely and with big sizes.
+ * free receives the pointer along with the size originally requested for it. The context pointer
+ * is passed through untouched to both functions.
+ */
+typedef struct CLexAllocator {
+    void* (*alloc)(void* context, size_t size);
+    void (*free)(void* context, void* ptr, size_t size);
+    void* context;
+} CLexAllocator;
+
+/* Struct: CLexIterator
+ * --------------------
+ * The state of a walk over the words beginning with a prefix (see clex_iter_prefix). It is
+ * declared here only so that clients can keep one on the stack without allocating; its fields
+ * are private to the CLexicon. The walk keeps one node per byte of the current word, so it
+ * never recurses and never allocates.
+ */
+typedef struct CLexIterator {
+    CLexicon* lex;
+    int depth;              //length of the current word, or -1 once the walk is over
+    int base;               //length of the prefix, where the walk stops climbing
+    bool at_node;           //whether the node at depth has yet to be reported
+    uint32_t nodes[CLEX_MAX_WORD_LEN + 1];
+    uint8_t offsets[CLEX_MAX_WORD_LEN + 1];    //how far along the label of a frozen chain node each is
+    uint16_t next[CLEX_MAX_WORD_LEN + 1];      //smallest byte not yet visited below each node
+    char word[CLEX_MAX_WORD_LEN + 1];
+} CLexIterator;
+
+/* Type: CLexVisitor
+ * -----------------
+ * A function called by clex_visit_prefix with each word, NUL-terminated, and its length. The context
+ * pointer is passed through untouched. Returning false stops the walk.
+ */
+typedef bool (*CLexVisitor)(void* context, const char* word, size_t len);
+
+/* Type: CLexFuzzyVisitor
+ * ----------------------
+ * A function called by clex_fuzzy_search with each word found, NUL-terminated, its length, and
+ * the number of edits it is away from the word searched for. Returning false stops the search.
+ */
+typedef bool (*CLexFuzzyVisitor)(void* context, const char* word, size_t len, int edits);
+
+/* Type: CLexMatchVisitor
+ * ----------------------
+ * A function called by clex_scanner_scan with each word found in a text, given as the offset of
+ * its first byte and its length. Returning false stops the scan.
+ */
+typedef bool (*CLexMatchVisitor)(void* context, size_t start, size_t len);
+
+/* Struct: CLexCompletion
+ * ----------------------
+ * One word returned by clex_top_k, with its letters in lower case and NUL-terminated, along with
+ * its weight.
+ */
+typedef struct CLexCompletion {
+    char word[CLEX_MAX_WORD_LEN + 1];
+    uint32_t weight;
+} CLexCompletion;
+
+
+/* Struct: CLexStats
+ * ------------------
+ * What a CLexicon holds and what it costs, as filled in by clex_stats. A place is a prefix of
+ * some word, the empty prefix included. A mutable CLexicon has one node per place, while a frozen
+ * one shares nodes between places with equal subtrees, so most counts are of places, which are
+ * the same for the same words however they are stored.
+ * The lookup counters are only kept when CLexicon.c is compiled with CLEX_COUNTERS defined, and
+ * are 0 otherwise. They count calls to clex_contains and clex_contains_prefix, their _n and
+ * _batch variants and the parallel lookups, and the nodes those lookups stepped to.
+ */
+typedef struct CLexStats {
+    size_t words;
+    size_t nodes;               //nodes stored, which once frozen is fewer than places
+    size_t places;
+    size_t bytes_allocated;     //memory held from the allocator or mapped from a file, the CLexicon itself included
+    size_t bytes_in_nodes;      //the part of bytes_allocated holding the nodes in the tree
+    size_t bytes_free;          //the part holding released nodes and slab space not yet handed out
+    size_t unlinked_nodes;      //nodes cut from the tree but not yet released (see clex_remove_prefix)
+    size_t dead_nodes;          //places other than the root with no word and no children
+    size_t places_per_depth[CLEX_MAX_WORD_LEN + 1];
+    size_t fanout[CLEX_STATS_MAX_FANOUT + 1];   //places by number of children, the last entry counting every place with more
+    double average_depth;       //mean length of the words, or 0 if there are none
+    int max_depth;              //length of the longest word
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t nodes_visited;
+} CLexStats;
+
 
             /*** "public" methods intended for client use ***/
 
@@ -47,41 +182,152 @@ typedef struct CLexiconImplementation CLexicon;
 CLexicon* clex_create();
 
 
+/* Function: clex_create_with_allocator
+ * ------------------------------------
+ * Creates a CLexicon exactly like clex_create, except that the CLexicon and all of its nodes
+ * are allocated through the given allocator instead of malloc and free.
+ * Runs in constant time.
+ */
+CLexicon* clex_create_with_allocator(const CLexAllocator* allocator);
+
+
 /* Function: clex_delete
  * ---------------------
- * Deletes the CLexicon and frees all memory associated with it.
- * Runs in linear time (scaling with the size of the lexicon).
+ * Deletes the CLexicon and frees all memory associated with it. Nodes live in large slabs,
+ * so the tree is released slab by slab rather than node by node.
+ * Runs in linear time (scaling with the number of slabs, not the number of words).
  */ 
 void clex_delete(CLexicon* lex);
 
 
+/* Function: clex_snapshot
+ * -----------------------
+ * Returns a read-only CLexicon holding exactly the words lex holds at the time of the call, or
+ * NULL if lex is itself a snapshot. Lookups on the snapshot see that version however lex changes
+ * afterwards, while lex copies only the nodes on the paths of the words it adds and removes;
+ * functions that rework the whole lexicon (loading a file, merging, freezing, clearing and
+ * optimizing the layout) move it to new storage instead and leave the old one to the
+ * snapshots. In concurrent mode loading a file and merging copy the tree next to the old one
+ * instead, which is retired like any removed nodes, so lookups may go on meanwhile. Functions
+ * that change a lexicon leave a snapshot as it is, returning false or 0 where they return
+ * anything. A snapshot is freed with clex_delete, and may outlive lex. While lex has snapshots,
+ * the nodes it releases are not reused until the last of them is deleted.
+ * Runs in linear time (scaling with the number of slabs, not the number of words).
+ */
+CLexicon* clex_snapshot(CLexicon* lex);
+
+
 /* Function: clex_add
  * ------------------
  * Adds the given string word to the CLexicon. This operation begins (relatively) slowly
  * when the first words are being added and increases in efficiency as the lexicon grows larger.
  * This is possible because the lexicon is structured specifically to work with strings.
+ * Letters of either case are accepted and stored in lower case, and any other byte is stored as
+ * it is. Returns false, leaving the lexicon unchanged, if word is longer than CLEX_MAX_WORD_LEN
+ * bytes.
  * Runs in linear time (scaling with the length of word).
  */
-void clex_add(CLexicon* lex, char* word);
+bool clex_add(CLexicon* lex, char* word);
+
+
+/* Function: clex_add_n
+ * --------------------
+ * Adds the first len bytes of word to the CLexicon, as clex_add does. word need not be
+ * NUL-terminated, so a word can be added straight out of a larger buffer without a copy, but
+ * it must not contain a '\0' within len bytes.
+ * Runs in linear time (scaling with len).
+ */
+bool clex_add_n(CLexicon* lex, const char* word, size_t len);
+
+
+/* Function: clex_add_weighted
+ * ---------------------------
+ * Adds word to the CLexicon as clex_add does, and gives it a weight, such as how often it is
+ * used, that clex_top_k ranks it by. A word that is already in the CLexicon keeps its place and
+ * takes the new weight. Words added any other way weigh 0, and a CLexicon that never has a weight
+ * set pays nothing for the feature. Returns false, leaving the lexicon unchanged, for any word
+ * clex_add would refuse.
+ * Runs in linear time (scaling with the length of word).
+ */
+bool clex_add_weighted(CLexicon* lex, const char* word, uint32_t weight);
 
 
 /* Function: clex_add_from_file
  * ----------------------------
  * Adds words from a file with the given name to the CLexicon. The file must be formatted such that
- * a single word appears on each line. Words should not exceed the maxmimum length of the longest
- * English word included in a major dictionary (pneumonoultramicroscopicsilicovalcanoconiosis).
+ * a single word appears on each line (Windows line endings are fine). Words must not
+ * exceed the maxmimum length of the longest English word included in a major dictionary
+ * (pneumonoultramicroscopicsilicovolcanoconiosis). Returns false if the file cannot be read or a
+ * line breaks these rules; the words before that line remain in the lexicon.
  * The final boolean argument indicates whether the words read from the file are guaranteed to be
- * in lower case. If this is true, the operation for adding each word will be more efficient.
- * Runs in quadratic time (scaling with file size and lengths of words).
+ * in lower case. It is kept for compatibility: words of either case are now read equally fast.
+ * Files sorted in alphabetical order load fastest, because each word picks up where the
+ * previous one branched off instead of starting again at the root.
+ * Runs in linear time (scaling with file size).
  */ 
 bool clex_add_from_file(CLexicon* lex, char* filename, bool is_lower_case);
 
 
+/* Function: clex_add_from_file_parallel
+ * -------------------------------------
+ * Adds words from a file formatted as for clex_add_from_file, using up to nthreads threads. The
+ * file is read into memory once and its words are split between the threads by their first
+ * byte, and each thread builds its part of the lexicon on its own. The parts are then taken into
+ * lex as they are, without copying their nodes, except where lex already holds words with the
+ * same first byte, which are merged as by clex_merge. The threads allocate through lex's
+ * allocator, which must therefore be safe to call from several threads at once. Returns false,
+ * leaving the lexicon unchanged, if the file cannot be read or a line is not a valid word.
+ * Runs in linear time (scaling with file size), divided between the threads.
+ */
+bool clex_add_from_file_parallel(CLexicon* lex, char* filename, int nthreads);
+
+
+/* Function: clex_add_from_sorted_file
+ * -----------------------------------
+ * Adds words from a file formatted as for clex_add_from_file, whose words must additionally be
+ * in order byte by byte (ignoring the case of letters), as sort does with LC_ALL=C. The lexicon
+ * is built directly in its frozen form (see clex_freeze) as the file is read, so the
+ * unminimized tree is never held in memory. This needs far less memory than clex_add_from_file
+ * followed by clex_freeze for large word lists. If the lexicon already contains words, the file
+ * is built this way on its own and then merged in (see clex_merge), and the lexicon is frozen.
+ * Returns false, leaving the lexicon unchanged, if the file cannot be read, a line is not a
+ * valid word, or the words are out of order.
+ * Runs in linear time (scaling with file size).
+ */
+bool clex_add_from_sorted_file(CLexicon* lex, char* filename);
+
+
+/* Function: clex_merge
+ * --------------------
+ * Adds every word of src to dst, with its weight if it has one other than 0; a word already in
+ * dst keeps its own weight otherwise. Parts of src that dst has nothing in are copied over whole
+ * rather than word by word. src is left unchanged and may be frozen. Returns the number of words
+ * of src that were not yet in dst.
+ * Runs in time proportional to the size of src.
+ */
+int clex_merge(CLexicon* dst, CLexicon* src);
+
+
+/* Functions: clex_union, clex_intersect, clex_difference
+ * -------------------------------------------------------
+ * Return a new lexicon, using the allocator of a, holding the words that are in a or b, in both,
+ * or in a but not in b. Neither a nor b is changed, and either may be frozen or a snapshot. The
+ * two are walked together node by node and each node of the result is written once, whole parts
+ * that only one side has being copied over node for node. A word keeps its weight in a, or in b
+ * if it has none in a. With nthreads above 1, the children of the root are split between up to
+ * nthreads threads, which build their parts apart before they are put together.
+ * Run in linear time (scaling with the size of a and b).
+ */
+CLexicon* clex_union(CLexicon* a, CLexicon* b, int nthreads);
+CLexicon* clex_intersect(CLexicon* a, CLexicon* b, int nthreads);
+CLexicon* clex_difference(CLexicon* a, CLexicon* b, int nthreads);
+
+
 /* Function: clex_clear
  * --------------------
- * Clears all elements from the CLexicon. Distinct from clex_delete in that it does not
- * free the memory associated with the data structure, and leaves it able to be used for further
- * adding, searching, and removing operations.
+ * Clears all elements from the CLexicon. Distinct from clex_delete in that it leaves the
+ * data structure able to be used for further adding, searching, and removing operations.
+ * Runs in linear time (scaling with the number of slabs, not the number of words).
  */ 
 void clex_clear(CLexicon* lex);
 
@@ -96,6 +342,15 @@ void clex_clear(CLexicon* lex);
 bool clex_contains(CLexicon* lex, char* word);
 
 
+/* Function: clex_contains_n
+ * -------------------------
+ * Returns true if the first len bytes of word form a word in the CLexicon. word need not be
+ * NUL-terminated, and a '\0' within len bytes makes the answer false.
+ * Runs in linear time (scaling with len).
+ */
+bool clex_contains_n(CLexicon* lex, const char* word, size_t len);
+
+
 /* Function: clex_contains_prefix
  * ------------------------------
  * Returns true if the given lexicon contains any words beginning with the given prefix, or
@@ -104,6 +359,356 @@ bool clex_contains(CLexicon* lex, char* word);
 bool clex_contains_prefix(CLexicon* lex, char* prefix);
 
 
+/* Function: clex_contains_prefix_n
+ * --------------------------------
+ * Returns true if the CLexicon contains any word beginning with the first len bytes of prefix.
+ * Runs in linear time (scaling with len).
+ */
+bool clex_contains_prefix_n(CLexicon* lex, const char* prefix, size_t len);
+
+
+/* Function: clex_freeze
+ * ---------------------
+ * Compacts the CLexicon for fast, read-only use. Identical suffix subtrees are merged, turning
+ * the tree into a directed acyclic word graph stored in one contiguous block, which needs far
+ * fewer nodes for a natural-language word list. Runs of bytes that only one word continues
+ * through are then stored as a single labelled node, so lookups take fewer steps along them.
+ * clex_contains and clex_contains_prefix work on a frozen lexicon exactly as before. Any
+ * function that changes the lexicon first thaws it back into an ordinary tree, which costs as
+ * much as rebuilding it, so freeze only once all words have been added. Freezing a frozen
+ * lexicon does nothing.
+ * Runs in linear time (scaling with the size of the lexicon).
+ */
+void clex_freeze(CLexicon* lex);
+
+
+/* Function: clex_isFrozen
+ * -----------------------
+ * Returns true if the CLexicon is frozen, false otherwise.
+ * Runs in constant time.
+ */
+bool clex_isFrozen(CLexicon* lex);
+
+
+/* Function: clex_optimize_layout
+ * ------------------------------
+ * Renumbers the nodes of a lexicon that has been built up by many adds and removes, so that each
+ * node is stored next to the child most lookups continue to rather than wherever memory came
+ * free when it was added. Lookups then touch fewer cache lines and pages. Nodes freed by removals
+ * are returned to the allocator. clex_freeze and clex_save_binary lay out the images they build
+ * this way on their own, with the top levels of the tree packed together as well, so a frozen
+ * lexicon is left unchanged.
+ * Runs in linear time (scaling with the number of nodes), and briefly holds both copies.
+ */
+void clex_optimize_layout(CLexicon* lex);
+
+
+/* Function: clex_save_binary
+ * --------------------------
+ * Writes the CLexicon to the file with the given name in a compact binary form that
+ * clex_open_mapped can load without parsing. The frozen form of the lexicon is written (see
+ * clex_freeze), but the lexicon itself is left as it is. The file is only readable on machines
+ * with the same byte order. Returns true if the file was written successfully.
+ * Runs in linear time (scaling with the size of the lexicon).
+ */
+bool clex_save_binary(CLexicon* lex, const char* filename);
+
+
+/* Function: clex_open_mapped
+ * --------------------------
+ * Creates a frozen CLexicon that answers queries directly from a file written by
+ * clex_save_binary, which is mapped into memory rather than read. No words are parsed and no
+ * nodes are allocated, and processes that open the same file share one copy of it in memory.
+ * Changing the lexicon copies it out of the file first, as with any frozen lexicon; the file
+ * itself is never modified. The lexicon is released with clex_delete as usual. Returns NULL if
+ * the file cannot be mapped, was not written by clex_save_binary, or has been damaged so that
+ * its nodes do not fit in it or do not form a word graph.
+ * Runs in linear time (scaling with the size of the file), reading it once to check it, and
+ * briefly uses three words of memory per word of the file.
+ */
+CLexicon* clex_open_mapped(const char* filename);
+
+
+/* Function: clex_count_prefix
+ * ---------------------------
+ * Returns the number of words in the CLexicon that begin with the given prefix, counting the prefix
+ * itself if it is a word. Every node keeps the number of words beneath it, so the subtree is never
+ * walked. The empty prefix counts every word.
+ * Runs in linear time (scaling with the length of the prefix).
+ */
+int clex_count_prefix(CLexicon* lex, char* prefix);
+
+
+/* Function: clex_count_prefix_n
+ * -----------------------------
+ * As clex_count_prefix, but counts the words beginning with the first len bytes of prefix.
+ */
+int clex_count_prefix_n(CLexicon* lex, const char* prefix, size_t len);
+
+
+/* Function: clex_iter_prefix
+ * --------------------------
+ * Starts iter on a walk over every word in the CLexicon that begins with prefix, in alphabetical
+ * order; the empty prefix walks the whole CLexicon. Words are then fetched with clex_iter_next.
+ * The CLexicon must not be changed while the walk is in progress, even in concurrent mode; use
+ * clex_visit_prefix to walk a concurrent CLexicon that is being changed.
+ * Runs in linear time (scaling with the length of the prefix).
+ */
+void clex_iter_prefix(CLexicon* lex, CLexIterator* iter, const char* prefix);
+
+
+/* Function: clex_iter_next
+ * ------------------------
+ * Copies the next word of iter's walk, NUL-terminated, into word, which must have
+ * room for CLEX_MAX_WORD_LEN + 1 chars. Returns false, leaving word untouched, once every word has
+ * been returned.
+ * Runs in amortized constant time per letter of the words walked over.
+ */
+bool clex_iter_next(CLexIterator* iter, char* word);
+
+
+/* Function: clex_visit_prefix
+ * ---------------------------
+ * Calls visit with every word in the CLexicon that begins with prefix, in alphabetical order, until
+ * visit returns false. On a concurrent CLexicon the walk is safe while other threads change it, though
+ * words added or removed during the walk may or may not be seen, and removed nodes are not reused
+ * until it ends.
+ * Runs in linear time (scaling with the number of nodes below the prefix).
+ */
+void clex_visit_prefix(CLexicon* lex, const char* prefix, CLexVisitor visit, void* context);
+
+
+/* Function: clex_contains_suffix
+ * ------------------------------
+ * Returns true if any word in the CLexicon ends in suffix. The empty suffix ends every word.
+ * Runs in linear time (scaling with the length of suffix) with a suffix index (see
+ * clex_set_suffix_index), and in linear time scaling with the number of nodes without one.
+ */
+bool clex_contains_suffix(CLexicon* lex, const char* suffix);
+
+
+/* Function: clex_visit_suffix
+ * ---------------------------
+ * Calls visit with every word in the CLexicon that ends in suffix, until visit returns false.
+ * With a suffix index the words come in alphabetical order of their spellings backwards, so
+ * words ending in the same letters come together; without one they come in alphabetical order.
+ * Runs in linear time scaling with the number of nodes of the index below the suffix with a
+ * suffix index, or with the number of nodes of the CLexicon without one.
+ */
+void clex_visit_suffix(CLexicon* lex, const char* suffix, CLexVisitor visit, void* context);
+
+
+/* Function: clex_weight
+ * ---------------------
+ * Returns the weight of word as set by clex_add_weighted, or 0 if the word has none or is not in
+ * the CLexicon.
+ * Runs in linear time (scaling with the length of word).
+ */
+uint32_t clex_weight(CLexicon* lex, const char* word);
+
+
+/* Function: clex_top_k
+ * --------------------
+ * Fills out with the (up to) k heaviest words in the CLexicon that begin with prefix, heaviest
+ * first, and returns how many were found. Words of equal weight come in alphabetical order, so on
+ * a CLexicon without weights this returns the first k words. Only the parts of the tree that can
+ * hold a winning word are searched. Safe to call on a concurrent CLexicon.
+ * Runs in time scaling with k times the length of the words found, not with the number of words
+ * beginning with prefix.
+ */
+size_t clex_top_k(CLexicon* lex, const char* prefix, size_t k, CLexCompletion* out);
+
+
+/* Function: clex_fuzzy_search
+ * ---------------------------
+ * Calls visit with every word in the CLexicon that is at most max_edits edits away from word,
+ * in alphabetical order, where an edit inserts, deletes or replaces a single byte (Levenshtein
+ * distance over bytes, so a UTF-8 character outside ASCII may take more than one edit). Case is
+ * ignored as elsewhere. This takes one pass over the tree instead of one lookup per misspelling,
+ * and parts of the tree that cannot come within max_edits are never visited. Nothing is found if
+ * word is longer than CLEX_MAX_WORD_LEN. Safe to call on a concurrent CLexicon.
+ * Runs in time scaling with the length of word times the number of nodes within max_edits of
+ * one of its prefixes.
+ */
+void clex_fuzzy_search(CLexicon* lex, const char* word, int max_edits, CLexFuzzyVisitor visit, void* context);
+
+
+/* Function: clex_match_pattern
+ * ----------------------------
+ * Calls visit with every word in the CLexicon that matches pattern, in alphabetical order, until
+ * visit returns false. In a pattern '?' stands for any one byte, '*' for any run of bytes,
+ * the empty run included, and any other byte for itself, letters in either case, so "c?t*"
+ * matches "cat", "cute" and "citadel". The pattern is checked as the tree is walked, so branches
+ * that cannot match are never entered. Nothing is found if pattern has more than 127 symbols
+ * once runs of '*' are merged. Safe to call on a concurrent CLexicon.
+ * Runs in time scaling with the number of nodes whose bytes match the start of pattern.
+ */
+void clex_match_pattern(CLexicon* lex, const char* pattern, CLexVisitor visit, void* context);
+
+
+/* Function: clex_match_letters
+ * ----------------------------
+ * Calls visit with every word in the CLexicon that can be spelled with the tiles in letters, in
+ * alphabetical order, until visit returns false. Each byte of letters is a tile that can be used
+ * once, and each '?' is a blank tile that stands for any byte. If use_all is true only words
+ * that use every tile are found (anagrams); otherwise any word that uses some of them is. Safe to
+ * call on a concurrent CLexicon.
+ * Runs in time scaling with the number of nodes that can be spelled with the tiles.
+ */
+void clex_match_letters(CLexicon* lex, const char* letters, bool use_all, CLexVisitor visit, void* context);
+
+
+/* Function: clex_longest_prefix
+ * -----------------------------
+ * Returns the length of the longest word in the CLexicon that the first len bytes of text begin
+ * with, or 0 if they begin with none. text need not be NUL-terminated and may run on well past
+ * the word, so segmenting text takes one call per word instead of one lookup per length tried.
+ * Safe to call on a concurrent CLexicon.
+ * Runs in linear time (scaling with the length of the word found, at most CLEX_MAX_WORD_LEN).
+ */
+size_t clex_longest_prefix(CLexicon* lex, const char* text, size_t len);
+
+
+/* Function: clex_scanner_create
+ * -----------------------------
+ * Builds a CLexScanner, an Aho-Corasick automaton over the words of the CLexicon, for finding
+ * every occurrence of them inside texts with clex_scanner_scan. The scanner is a copy: later
+ * changes to the CLexicon are not seen by it, and it may outlive the CLexicon. Its memory comes
+ * from the CLexicon's allocator. Safe to call on a concurrent CLexicon, though words added or
+ * removed meanwhile may or may not be included.
+ * Runs in linear time (scaling with the number of nodes), using about 20 bytes per node.
+ */
+CLexScanner* clex_scanner_create(CLexicon* lex);
+
+
+/* Function: clex_scanner_delete
+ * -----------------------------
+ * Frees the memory used by the scanner.
+ */
+void clex_scanner_delete(CLexScanner* scanner);
+
+
+/* Function: clex_scanner_scan
+ * ---------------------------
+ * Calls visit with every occurrence inside the first len bytes of text of a word the scanner was
+ * built from, until visit returns false. Occurrences may overlap; they come in order of where
+ * they end, the longest first among those ending at the same byte. Case is ignored as elsewhere,
+ * and the empty word is never reported. Any number of threads may scan with one scanner at once.
+ * Runs in linear time (scaling with len plus the number of occurrences found), however many
+ * words the scanner holds.
+ */
+void clex_scanner_scan(const CLexScanner* scanner, const char* text, size_t len, CLexMatchVisitor visit, void* context);
+
+
+/* Function: clex_infix_create
+ * ---------------------------
+ * Builds a CLexInfix, a suffix array over the words of the CLexicon, for finding the words that
+ * contain given bytes anywhere with clex_infix_visit. Like a CLexScanner the index is a copy: later
+ * changes to the CLexicon are not seen by it, and it may outlive the CLexicon. Its memory comes
+ * from the CLexicon's allocator. Safe to call on a concurrent CLexicon, though words added or
+ * removed meanwhile may or may not be included.
+ * Runs in time scaling with the total length of the words times the log of their number, using
+ * about 5 bytes per byte of the words.
+ */
+CLexInfix* clex_infix_create(CLexicon* lex);
+
+
+/* Function: clex_infix_delete
+ * ---------------------------
+ * Frees the memory used by the index.
+ */
+void clex_infix_delete(CLexInfix* index);
+
+
+/* Function: clex_infix_visit
+ * --------------------------
+ * Calls visit with every word the index was built from that contains infix, in alphabetical
+ * order, until visit returns false. Each word is reported once, however often it contains infix,
+ * and the empty infix is in every word. Case is ignored as elsewhere. Any number of threads may
+ * search one index at once.
+ * Runs in time scaling with the length of infix times the log of the total length of the words,
+ * plus the number of occurrences found times its log.
+ */
+void clex_infix_visit(const CLexInfix* index, const char* infix, CLexVisitor visit, void* context);
+
+
+/* Function: clex_contains_batch
+ * -----------------------------
+ * Looks up n words at once, setting out[i] to whether the CLexicon contains words[i]. Gives the
+ * same answers as calling clex_contains on each word, but several lookups are interleaved so
+ * that the time each one spends waiting on memory overlaps with the others, which is
+ * considerably faster for large batches.
+ * Runs in linear time (scaling with the total length of the words).
+ */
+void clex_contains_batch(CLexicon* lex, const char** words, size_t n, bool* out);
+
+
+/* Function: clex_contains_prefix_batch
+ * ------------------------------------
+ * Looks up n prefixes at once, setting out[i] to whether the CLexicon contains any words
+ * beginning with prefixes[i]. The batch counterpart of clex_contains_prefix (see
+ * clex_contains_batch).
+ * Runs in linear time (scaling with the total length of the prefixes).
+ */
+void clex_contains_prefix_batch(CLexicon* lex, const char** prefixes, size_t n, bool* out);
+
+
+/* Function: clex_contains_parallel
+ * --------------------------------
+ * Looks up n words on nthreads threads, setting out[i] to whether the CLexicon contains
+ * words[i], with the same answers as clex_contains_batch. The threads share the lexicon and
+ * take no locks to read it, and ones that finish their share early take over work from the
+ * others, so uneven words still keep every thread busy. The lexicon must not change during the
+ * call unless it is in concurrent mode (see clex_set_concurrent); a frozen one never does.
+ * Starts and stops its threads on every call, so a stream of batches is better served by a
+ * CLexPool.
+ * Runs in linear time (scaling with the total length of the words), divided among the threads.
+ */
+void clex_contains_parallel(CLexicon* lex, const char** words, size_t n, bool* out, int nthreads);
+
+
+/* Function: clex_pool_create
+ * --------------------------
+ * Starts a pool of nthreads threads for looking up batches of words with clex_pool_submit,
+ * kept running between batches. If threads cannot be started the pool has fewer, or none at
+ * all, in which case each batch is looked up on the thread submitting it.
+ */
+CLexPool* clex_pool_create(int nthreads);
+
+
+/* Function: clex_pool_delete
+ * --------------------------
+ * Waits for the pool's current batch, stops its threads and frees it.
+ */
+void clex_pool_delete(CLexPool* pool);
+
+
+/* Function: clex_pool_submit
+ * --------------------------
+ * Starts looking up n words in lex on the pool's threads, setting out[i] to whether the
+ * CLexicon contains words[i], and returns without waiting for the answers, so the caller can
+ * prepare the next batch meanwhile. The words and out must stay valid, and lex unchanged (as
+ * for clex_contains_parallel), until clex_pool_wait returns. A pool works on one batch at a
+ * time: submitting while one is in progress first waits for it. A pool should be driven by
+ * one thread at a time.
+ */
+void clex_pool_submit(CLexPool* pool, CLexicon* lex, const char** words, size_t n, bool* out);
+
+
+/* Function: clex_pool_wait
+ * ------------------------
+ * Blocks until the batch last submitted to the pool has been looked up.
+ */
+void clex_pool_wait(CLexPool* pool);
+
+
+/* Function: clex_pool_contains
+ * ----------------------------
+ * Looks up n words on the pool's threads, as clex_pool_submit followed by clex_pool_wait.
+ */
+void clex_pool_contains(CLexPool* pool, CLexicon* lex, const char** words, size_t n, bool* out);
+
+
 /* Function: clex_isEmpty
  * ----------------------
  * Returns true if the given CLexicon is empty, false otherwise.
@@ -121,15 +726,40 @@ bool clex_isEmpty(CLexicon* lex);
 bool clex_remove(CLexicon* lex, char* word);
 
 
+/* Function: clex_remove_n
+ * -----------------------
+ * Removes the word made of the first len bytes of word, as clex_remove does.
+ */
+bool clex_remove_n(CLexicon* lex, const char* word, size_t len);
+
+
+/* Function: clex_remove_batch
+ * ---------------------------
+ * Removes each of the n words in words from the CLexicon. If out is not NULL, out[i] is set to
+ * whether words[i] was removed. Cheaper than calling clex_remove on each word, mostly for a
+ * concurrent lexicon, where the writer lock is taken once for the whole batch.
+ * Runs in linear time (scaling with the total length of the words).
+ */
+void clex_remove_batch(CLexicon* lex, const char** words, size_t n, bool* out);
+
+
 /* Function: clex_remove_prefix
  * ----------------------------
  * Removes all words beginning with the given prefix from the CLexicon, returning true if the prefix
  * and all words beginning with the prefix were removed, false if the prefix was not found in the tree.
- * Runs in quadratic time (scaling with the number of words with the prefix and their lengths).
+ * Runs in linear time (scaling with the length of the prefix); the removed nodes are released later,
+ * a few at a time, as the CLexicon needs new ones.
  */
 bool clex_remove_prefix(CLexicon* lex, char* prefix);
 
 
+/* Function: clex_remove_prefix_n
+ * ------------------------------
+ * Removes all words beginning with the first len bytes of prefix, as clex_remove_prefix does.
+ */
+bool clex_remove_prefix_n(CLexicon* lex, const char* prefix, size_t len);
+
+
 /* Function: clex_word_count
  * -------------------------
  * Returns the number of elements currently stored in the CLexicon.
@@ -137,4 +767,43 @@ bool clex_remove_prefix(CLexicon* lex, char* prefix);
  */ 
 int clex_wordcount(CLexicon* lex);
 
+
+/* Function: clex_stats
+ * --------------------
+ * Fills out with the statistics of the CLexicon (see CLexStats). In concurrent mode it holds the
+ * writer lock, so the numbers describe a single state of the lexicon, while lookups go on.
+ * Runs in linear time (scaling with the number of places).
+ */
+void clex_stats(CLexicon* lex, CLexStats* out);
+
+
+/* Function: clex_set_suffix_index
+ * --------------------------------
+ * Turns the suffix index on or off. The index is a second tree of the words spelled backwards,
+ * kept up to date as words are added and removed and rebuilt after loading files, merging and
+ * clearing, which makes clex_contains_suffix and clex_visit_suffix as fast as the prefix lookups
+ * at the cost of about as much memory again and slower changes. It is not saved by
+ * clex_save_binary, and a snapshot gets a snapshot of the index. Has no effect on a snapshot.
+ * Must not overlap any other call on the CLexicon.
+ * Runs in linear time (scaling with the number of nodes) when turning the index on.
+ */
+void clex_set_suffix_index(CLexicon* lex, bool enabled);
+
+
+/* Function: clex_set_concurrent
+ * -----------------------------
+ * Turns concurrent mode on or off. In concurrent mode any number of threads may call clex_contains,
+ * clex_contains_prefix, their _n and _batch variants, clex_contains_parallel, the CLexPool lookups,
+ * clex_wordcount and clex_isEmpty while other threads add and remove words. Lookups never take a
+ * lock and always see a consistent tree; writers are serialized by a lock inside the lexicon, and
+ * nodes they unlink are only reused once no lookup can still be visiting them. clex_save_binary may
+ * also run alongside lookups.
+ * Freezing and clearing replace all of the lexicon's storage at once, so clex_freeze, clex_clear,
+ * clex_add_from_sorted_file, clex_optimize_layout, the first change to a frozen lexicon,
+ * clex_delete and this function itself must not overlap any lookup.
+ * Runs in constant time when turning concurrent mode on, and in time proportional to the nodes
+ * still waiting to be reused when turning it off.
+ */
+void clex_set_concurrent(CLexicon* lex, bool concurrent);
+
 #endif
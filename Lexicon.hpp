@@ -0,0 +1,447 @@
+/* File: Lexicon.hpp
+ * -----------------
+ * Lexicon<Alphabet> is a header-only C++ counterpart of CLexicon for words drawn from a small,
+ * fixed alphabet. The alphabet is a template parameter, so the number of child slots in a node,
+ * the map from bytes to child slots and the case-folding rule are all settled at compile time: a
+ * Lexicon<Dna> has nodes with room for four children, and no lexicon tests which range a byte
+ * falls in while it walks a word.
+ *
+ * An alphabet is a type with these static constexpr members:
+ *
+ *      size            the number of symbols, from 1 to 255
+ *      index(c)        the symbol for byte c, from 0 to size - 1, or -1 if c is not in the alphabet;
+ *                      mapping several bytes to one symbol folds them together (as case is folded)
+ *      symbol(i)       the byte words are given back with for symbol i
+ *
+ * Lowercase, Dna, Hex and Ascii are defined below. Words are ordered by symbol, so a Lexicon
+ * visits its words in the order of its alphabet.
+ *
+ * A Lexicon is not safe to change from one thread while others use it; unlike CLexicon it has no
+ * concurrent mode, nor weights, freezing or files. Use CLexicon for those.
+ */
+
+#ifndef _Lexicon_hpp
+#define _Lexicon_hpp
+
+#include <array>        //defines std::array, used for the constexpr symbol maps
+#include <cstddef>      //defines std::size_t
+#include <cstdint>      //defines the uint32_t and uint64_t types
+#include <string>       //defines std::string, used to spell out words being visited
+#include <string_view>  //defines std::string_view
+#include <type_traits>  //defines std::conditional_t
+#include <vector>       //defines std::vector, which holds the nodes
+
+namespace clex {
+
+
+            /*** alphabets ***/
+
+
+/* Alphabet: Lowercase
+ * -------------------
+ * The letters a-z, with upper case folded in, as CLexicon folds them, and no other bytes.
+ */
+struct Lowercase {
+    static constexpr int size = 26;
+    static constexpr int index(unsigned char c) {
+        return (c >= 'a' && c <= 'z') ? c - 'a' : (c >= 'A' && c <= 'Z') ? c - 'A' : -1;
+    }
+    static constexpr char symbol(int i) { return (char)('a' + i); }
+};
+
+/* Alphabet: Dna
+ * -------------
+ * The nucleotides A, C, G and T, with lower case folded into upper case.
+ */
+struct Dna {
+    static constexpr int size = 4;
+    static constexpr int index(unsigned char c) {
+        switch(c) {
+            case 'A': case 'a': return 0;
+            case 'C': case 'c': return 1;
+            case 'G': case 'g': return 2;
+            case 'T': case 't': return 3;
+            default: return -1;
+        }
+    }
+    static constexpr char symbol(int i) { return "ACGT"[i]; }
+};
+
+/* Alphabet: Hex
+ * -------------
+ * The hexadecimal digits 0-9 and a-f, with A-F folded into lower case.
+ */
+struct Hex {
+    static constexpr int size = 16;
+    static constexpr int index(unsigned char c) {
+        return (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+               (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+    }
+    static constexpr char symbol(int i) { return "0123456789abcdef"[i]; }
+};
+
+/* Alphabet: Ascii
+ * ---------------
+ * Every 7-bit byte other than '\0', each kept exactly as given.
+ */
+struct Ascii {
+    static constexpr int size = 127;
+    static constexpr int index(unsigned char c) { return (c >= 1 && c <= 127) ? c - 1 : -1; }
+    static constexpr char symbol(int i) { return (char)(i + 1); }
+};
+
+
+            /*** implementation details ***/
+
+
+namespace detail {
+
+/* Struct: SymbolMap
+ * -----------------
+ * The symbol of every byte, worked out from Alphabet::index at compile time. Bytes outside the
+ * alphabet map to Alphabet::size, a child slot no node ever fills, so a walk that meets one simply
+ * finds no child there and needs no test of its own.
+ */
+template <class Alphabet>
+struct SymbolMap {
+    static_assert(Alphabet::size >= 1 && Alphabet::size <= 255, "an alphabet has 1 to 255 symbols");
+
+    static constexpr std::array<uint8_t, 256> build() {
+        std::array<uint8_t, 256> map{};
+        for(int c = 0; c < 256; c++) {
+            int i = Alphabet::index((unsigned char)c);
+            map[c] = (uint8_t)((i < 0 || i >= Alphabet::size) ? Alphabet::size : i);
+        }
+        return map;
+    }
+
+    static constexpr std::array<uint8_t, 256> map = build();
+};
+
+/* Struct: DenseStore
+ * ------------------
+ * Children kept in a slot per symbol, plus the slot no byte fills (see SymbolMap). Finding a child
+ * is a single load, which suits alphabets small enough that the empty slots cost little.
+ * Child 0 means no child: node 0 is the root, which is no node's child.
+ */
+template <int N>
+struct DenseStore {
+    struct Node {
+        uint32_t count;             //words at or below this node
+        uint32_t word;              //whether the path to this node spells a word
+        uint32_t child[N + 1];
+    };
+
+    uint32_t child(const Node& node, int sym) const { return node.child[sym]; }
+    void link(Node& node, int sym, uint32_t child) { node.child[sym] = child; }
+    void unlink(Node& node, int sym) { node.child[sym] = 0; }
+    void release(Node&) {}
+
+    template <class F>
+    bool each(const Node& node, F&& visit) const {
+        for(int sym = 0; sym < N; sym++) {
+            if(node.child[sym] && !visit(sym, node.child[sym])) return false;
+        }
+        return true;
+    }
+};
+
+/* Struct: SparseStore
+ * -------------------
+ * Children kept the way CLexicon keeps them: a bitmask of the symbols a node has children for, and
+ * a block holding only those children, in symbol order, so that the child for sym sits at the
+ * number of bits set below sym. Blocks live in one shared vector and are reused by length once
+ * freed. The mask has a bit for the slot no byte fills (see SymbolMap), which is never set, and
+ * is a single 32-bit word for alphabets as small as Lowercase.
+ */
+template <int N>
+struct SparseStore {
+    using Mask = std::conditional_t<(N + 1 <= 32), uint32_t, uint64_t>;
+    static constexpr int BITS = 8 * sizeof(Mask);
+    static constexpr int WORDS = (N + 1 + BITS - 1) / BITS;
+
+    struct Node {
+        Mask mask[WORDS];
+        uint32_t count;             //words at or below this node
+        uint32_t word;              //whether the path to this node spells a word
+        uint32_t first;             //where the node's block of children starts in kids
+    };
+
+    std::vector<uint32_t> kids;
+    std::vector<uint32_t> spare[N + 1];     //starts of freed blocks, by length
+
+    static bool has(const Node& node, int sym) { return (node.mask[sym / BITS] >> (sym % BITS)) & 1; }
+
+    static int rank(const Node& node, int sym) {
+        int below = 0;
+        for(int w = 0; w < sym / BITS; w++) below += __builtin_popcountll(node.mask[w]);
+        return below + __builtin_popcountll(node.mask[sym / BITS] & (((Mask)1 << (sym % BITS)) - 1));
+    }
+
+    static int degree(const Node& node) {
+        int count = 0;
+        for(int w = 0; w < WORDS; w++) count += __builtin_popcountll(node.mask[w]);
+        return count;
+    }
+
+    uint32_t take(int len) {
+        if(!spare[len].empty()) {
+            uint32_t at = spare[len].back();
+            spare[len].pop_back();
+            return at;
+        }
+        uint32_t at = (uint32_t)kids.size();
+        kids.resize(at + len);
+        return at;
+    }
+
+    void give(uint32_t at, int len) {
+        if(len) spare[len].push_back(at);
+    }
+
+    uint32_t child(const Node& node, int sym) const {
+        return has(node, sym) ? kids[node.first + rank(node, sym)] : 0;
+    }
+
+    //Moves the children into a block one longer, leaving a gap at the new child's rank.
+    void link(Node& node, int sym, uint32_t child) {
+        int len = degree(node), at = rank(node, sym);
+        uint32_t block = take(len + 1);
+        for(int i = 0; i < at; i++) kids[block + i] = kids[node.first + i];
+        kids[block + at] = child;
+        for(int i = at; i < len; i++) kids[block + i + 1] = kids[node.first + i];
+        give(node.first, len);
+        node.first = block;
+        node.mask[sym / BITS] |= (Mask)1 << (sym % BITS);
+    }
+
+    void unlink(Node& node, int sym) {
+        int len = degree(node), at = rank(node, sym);
+        uint32_t block = len > 1 ? take(len - 1) : 0;
+        for(int i = 0; i < at; i++) kids[block + i] = kids[node.first + i];
+        for(int i = at + 1; i < len; i++) kids[block + i - 1] = kids[node.first + i];
+        give(node.first, len);
+        node.first = block;
+        node.mask[sym / BITS] &= ~((Mask)1 << (sym % BITS));
+    }
+
+    void release(Node& node) { give(node.first, degree(node)); }
+
+    template <class F>
+    bool each(const Node& node, F&& visit) const {
+        uint32_t at = node.first;
+        for(int w = 0; w < WORDS; w++) {
+            for(Mask bits = node.mask[w]; bits; bits &= bits - 1) {
+                if(!visit(w * BITS + __builtin_ctzll(bits), kids[at++])) return false;
+            }
+        }
+        return true;
+    }
+};
+
+/* Constant: DENSE_LIMIT
+ * ---------------------
+ * The largest alphabet given a slot per symbol. Past it a node's empty slots outweigh the cost of
+ * counting bits to find a child, and the nodes keep only the children they have.
+ */
+constexpr int DENSE_LIMIT = 16;
+
+} // namespace detail
+
+
+            /*** Lexicon ***/
+
+
+template <class Alphabet>
+class Lexicon {
+    static constexpr int N = Alphabet::size;
+    using Store = std::conditional_t<(N <= detail::DENSE_LIMIT), detail::DenseStore<N>, detail::SparseStore<N>>;
+    using Node = typename Store::Node;
+
+public:
+    /* Constant: dense
+     * ---------------
+     * Whether nodes hold a child slot for every symbol (see DENSE_LIMIT), rather than only the
+     * children they have.
+     */
+    static constexpr bool dense = N <= detail::DENSE_LIMIT;
+
+    /* Constant: node_size
+     * -------------------
+     * The size in bytes of one node of this lexicon, not counting the child blocks of sparse nodes.
+     */
+    static constexpr std::size_t node_size = sizeof(Node);
+
+    Lexicon() : nodes_(1) {}
+
+    /* Function: add
+     * -------------
+     * Adds word to the lexicon, folding it as the alphabet folds. Returns false, leaving the
+     * lexicon unchanged, if word holds a byte outside the alphabet or is in the lexicon already.
+     * Runs in linear time (scaling with the length of word).
+     */
+    bool add(std::string_view word) {
+        for(unsigned char c : word) {
+            if(map()[c] == N) return false;
+        }
+        if(contains(word)) return false;
+        uint32_t node = 0;
+        nodes_[0].count++;
+        for(unsigned char c : word) {
+            int sym = map()[c];
+            uint32_t next = store_.child(nodes_[node], sym);
+            if(!next) {
+                next = new_node();
+                store_.link(nodes_[node], sym, next);
+            }
+            nodes_[next].count++;
+            node = next;
+        }
+        nodes_[node].word = 1;
+        return true;
+    }
+
+    /* Function: contains
+     * ------------------
+     * Returns whether word, folded as the alphabet folds, is in the lexicon.
+     * Runs in linear time (scaling with the length of word).
+     */
+    bool contains(std::string_view word) const {
+        uint32_t node = find(word);
+        return node != NONE && nodes_[node].word;
+    }
+
+    /* Function: contains_prefix
+     * -------------------------
+     * Returns whether any word in the lexicon begins with prefix. Every word begins with "", so
+     * contains_prefix("") is whether the lexicon has any words.
+     * Runs in linear time (scaling with the length of prefix).
+     */
+    bool contains_prefix(std::string_view prefix) const { return count_prefix(prefix) != 0; }
+
+    /* Function: count_prefix
+     * ----------------------
+     * Returns the number of words in the lexicon that begin with prefix.
+     * Runs in linear time (scaling with the length of prefix).
+     */
+    std::size_t count_prefix(std::string_view prefix) const {
+        uint32_t node = find(prefix);
+        return node == NONE ? 0 : nodes_[node].count;
+    }
+
+    /* Function: remove
+     * ----------------
+     * Removes word from the lexicon, releasing the nodes only it used. Returns whether word was in
+     * the lexicon.
+     * Runs in linear time (scaling with the length of word).
+     */
+    bool remove(std::string_view word) {
+        if(!contains(word)) return false;
+        uint32_t node = 0;
+        nodes_[0].count--;
+        for(std::size_t i = 0; i < word.size(); i++) {
+            int sym = map()[(unsigned char)word[i]];
+            uint32_t next = store_.child(nodes_[node], sym);
+            if(nodes_[next].count == 1) {
+                //Only this word passes through next, so it and everything below it go.
+                store_.unlink(nodes_[node], sym);
+                free_chain(next, word.substr(i + 1));
+                return true;
+            }
+            nodes_[next].count--;
+            node = next;
+        }
+        nodes_[node].word = 0;
+        return true;
+    }
+
+    /* Function: visit_prefix
+     * ----------------------
+     * Calls visit with every word that begins with prefix, as a std::string_view, in the order of
+     * the alphabet, until visit returns false. Returns false if visit stopped the walk.
+     * Runs in linear time (scaling with the number of nodes below the prefix).
+     */
+    template <class Visitor>
+    bool visit_prefix(std::string_view prefix, Visitor&& visit) const {
+        uint32_t node = find(prefix);
+        if(node == NONE) return true;
+        std::string word;
+        for(unsigned char c : prefix) word += Alphabet::symbol(map()[c]);
+        return walk(node, word, visit);
+    }
+
+    /* Functions: size, empty
+     * ----------------------
+     * Return the number of words in the lexicon and whether it has none.
+     * Run in constant time.
+     */
+    std::size_t size() const { return nodes_[0].count; }
+    bool empty() const { return nodes_[0].count == 0; }
+
+    /* Function: clear
+     * ---------------
+     * Removes every word from the lexicon and releases its nodes.
+     */
+    void clear() {
+        nodes_.assign(1, Node{});
+        nodes_.shrink_to_fit();
+        free_.clear();
+        store_ = Store{};
+    }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    std::vector<Node> nodes_;       //node 0 is the root
+    std::vector<uint32_t> free_;    //released nodes, for reuse
+    Store store_;
+
+    static constexpr const std::array<uint8_t, 256>& map() { return detail::SymbolMap<Alphabet>::map; }
+
+    //Returns the node word leads to, or NONE. A byte outside the alphabet finds no child.
+    uint32_t find(std::string_view word) const {
+        uint32_t node = 0;
+        for(unsigned char c : word) {
+            node = store_.child(nodes_[node], map()[c]);
+            if(!node) return NONE;
+        }
+        return node;
+    }
+
+    uint32_t new_node() {
+        if(!free_.empty()) {
+            uint32_t node = free_.back();
+            free_.pop_back();
+            nodes_[node] = Node{};
+            return node;
+        }
+        nodes_.emplace_back();
+        return (uint32_t)(nodes_.size() - 1);
+    }
+
+    //Frees node and the nodes below it along rest, which are all the nodes below it.
+    void free_chain(uint32_t node, std::string_view rest) {
+        for(std::size_t i = 0; ; i++) {
+            uint32_t next = i < rest.size() ? store_.child(nodes_[node], map()[(unsigned char)rest[i]]) : 0;
+            store_.release(nodes_[node]);
+            free_.push_back(node);
+            if(!next) return;
+            node = next;
+        }
+    }
+
+    template <class Visitor>
+    bool walk(uint32_t node, std::string& word, Visitor& visit) const {
+        if(nodes_[node].word && !visit(std::string_view(word))) return false;
+        return store_.each(nodes_[node], [&](int sym, uint32_t child) {
+            word.push_back(Alphabet::symbol(sym));
+            bool more = walk(child, word, visit);
+            word.pop_back();
+            return more;
+        });
+    }
+};
+
+} // namespace clex
+
+#endif
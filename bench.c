@@ -0,0 +1,384 @@
+/* File: bench.c
+ * -------------
+ * Benchmark program for CLexicon, run by "make bench". Times loading, lookups, removals,
+ * clearing and deleting on each word file named on the command line (dictionary.txt if none is)
+ * and on two synthetic corpora: random lowercase words, and long keys of digits and slashes
+ * that share most of their bytes. Lookups are timed on hits, misses and an even mix, in file
+ * order and in random order.
+ *
+ * Each line reports the operations per second and percentiles of the time per operation.
+ * Timing every call would mostly measure the clock, so operations are timed in batches of
+ * BATCH_OPS and the percentiles are over the batches' mean times. Memory is counted through a
+ * CLexAllocator, giving the bytes per word of a loaded lexicon, and the peak resident set size
+ * of the whole process is reported at the end.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "CLexicon.h"
+
+#define BATCH_OPS 64
+#define SYNTHETIC_WORDS 200000
+#define MISS_BYTE '#'       //a byte no corpus holds, so a word ending in it is never found
+
+
+            /* * * Corpora * * */
+
+
+/* Struct: Corpus
+ * --------------
+ * A list of words kept in one buffer. sorted holds them in byte order, shuffled in a fixed random
+ * order, and misses copies of them with their last byte replaced by MISS_BYTE. mixed alternates
+ * between hits and misses, in random order.
+ */
+typedef struct {
+    const char* name;
+    char* bytes;
+    size_t nbytes;
+    size_t nwords;
+    char** sorted;
+    char** shuffled;
+    char** misses;
+    char** mixed;
+    char** prefixes;        //the first half of each word, at least one byte of it, in random order
+    char* miss_bytes;       //the buffers misses and prefixes point into
+    char* prefix_bytes;
+} Corpus;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+//xorshift64, seeded the same every run so that every run times the same work.
+static uint64_t next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void shuffle(char** words, size_t n) {
+    for(size_t i = n; i > 1; i--) {
+        size_t j = next_random() % i;
+        char* tmp = words[i - 1];
+        words[i - 1] = words[j];
+        words[j] = tmp;
+    }
+}
+
+static int compare_words(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static char** copy_list(char** words, size_t n) {
+    char** copy = malloc(n * sizeof(char*));
+    memcpy(copy, words, n * sizeof(char*));
+    return copy;
+}
+
+//Copies each word into a new buffer, keeping the first len(word) * num / den bytes, at least one.
+static char** derive_words(char** words, size_t n, int num, int den, bool miss, char** buffer) {
+    size_t total = 0;
+    for(size_t i = 0; i < n; i++) total += strlen(words[i]) + 1;
+    *buffer = malloc(total);
+    char** derived = malloc(n * sizeof(char*));
+    char* at = *buffer;
+    for(size_t i = 0; i < n; i++) {
+        size_t len = strlen(words[i]) * num / den;
+        if(len == 0) len = 1;
+        memcpy(at, words[i], len);
+        if(miss) at[len - 1] = MISS_BYTE;
+        at[len] = '\0';
+        derived[i] = at;
+        at += len + 1;
+    }
+    return derived;
+}
+
+/* Function: corpus_finish
+ * -----------------------
+ * Splits the corpus's buffer into words at its newlines, dropping empty lines and words too long
+ * for a CLexicon, and builds the orders and query lists the benchmarks use.
+ */
+static void corpus_finish(Corpus* corpus) {
+    size_t capacity = 1024;
+    corpus->sorted = malloc(capacity * sizeof(char*));
+    corpus->nwords = 0;
+    char* line = corpus->bytes;
+    for(char* end; line < corpus->bytes + corpus->nbytes; line = end + 1) {
+        end = memchr(line, '\n', corpus->bytes + corpus->nbytes - line);
+        if(end == NULL) end = corpus->bytes + corpus->nbytes;
+        *end = '\0';
+        size_t len = end - line;
+        if(len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+        if(len == 0 || len > CLEX_MAX_WORD_LEN) continue;
+        if(corpus->nwords == capacity) {
+            capacity *= 2;
+            corpus->sorted = realloc(corpus->sorted, capacity * sizeof(char*));
+        }
+        corpus->sorted[corpus->nwords++] = line;
+    }
+    qsort(corpus->sorted, corpus->nwords, sizeof(char*), compare_words);
+    corpus->shuffled = copy_list(corpus->sorted, corpus->nwords);
+    shuffle(corpus->shuffled, corpus->nwords);
+}
+
+static void corpus_queries(Corpus* corpus) {
+    size_t n = corpus->nwords;
+    corpus->misses = derive_words(corpus->shuffled, n, 1, 1, true, &corpus->miss_bytes);
+    corpus->prefixes = derive_words(corpus->shuffled, n, 1, 2, false, &corpus->prefix_bytes);
+    corpus->mixed = malloc(n * sizeof(char*));
+    for(size_t i = 0; i < n; i++) {
+        corpus->mixed[i] = (next_random() & 1) ? corpus->shuffled[i] : corpus->misses[i];
+    }
+}
+
+static bool corpus_read(Corpus* corpus, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL) return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    corpus->name = filename;
+    corpus->bytes = malloc(size + 1);
+    corpus->nbytes = fread(corpus->bytes, 1, size, file);
+    fclose(file);
+    corpus_finish(corpus);
+    return true;
+}
+
+/* Function: corpus_synthesize
+ * ---------------------------
+ * Makes a corpus of SYNTHETIC_WORDS generated words. Random words are 4 to 12 lowercase letters;
+ * keys look like "user/004211/item/0093/v2", so most of their bytes are shared with many others
+ * and few of them are letters.
+ */
+static void corpus_synthesize(Corpus* corpus, bool keys) {
+    corpus->name = keys ? "synthetic keys" : "synthetic words";
+    corpus->bytes = malloc(SYNTHETIC_WORDS * (CLEX_MAX_WORD_LEN + 1));
+    char* at = corpus->bytes;
+    for(int i = 0; i < SYNTHETIC_WORDS; i++) {
+        if(keys) {
+            at += sprintf(at, "user/%06d/item/%04d/v%d\n", (int)(next_random() % 50000),
+                          (int)(next_random() % 10000), (int)(next_random() % 3));
+        } else {
+            int len = 4 + next_random() % 9;
+            for(int j = 0; j < len; j++) *at++ = 'a' + next_random() % 26;
+            *at++ = '\n';
+        }
+    }
+    corpus->nbytes = at - corpus->bytes;
+    corpus_finish(corpus);
+}
+
+//Writes the words of a corpus in sorted order to a temporary file for clex_add_from_file.
+static bool corpus_write(Corpus* corpus, char* filename) {
+    int fd = mkstemp(filename);
+    if(fd < 0) return false;
+    FILE* file = fdopen(fd, "w");
+    for(size_t i = 0; i < corpus->nwords; i++) {
+        fputs(corpus->sorted[i], file);
+        fputc('\n', file);
+    }
+    fclose(file);
+    return true;
+}
+
+static void corpus_free(Corpus* corpus) {
+    free(corpus->bytes);
+    free(corpus->sorted);
+    free(corpus->shuffled);
+    free(corpus->misses);
+    free(corpus->prefixes);
+    free(corpus->mixed);
+    free(corpus->miss_bytes);
+    free(corpus->prefix_bytes);
+}
+
+
+            /* * * Timing * * */
+
+
+typedef bool (*WordOp)(CLexicon* lex, char* word);
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_header(Corpus* corpus) {
+    printf("\n== %s: %zu words ==\n", corpus->name, corpus->nwords);
+    printf("%-42s %12s %9s %9s %9s\n", "operation", "ops/sec", "p50 ns", "p90 ns", "p99 ns");
+}
+
+//Prints a line for ops operations taking seconds in all, without percentiles.
+static void print_total(const char* label, size_t ops, double seconds) {
+    printf("%-42s %12.0f %9s %9s %9s\n", label, ops / seconds, "-", "-", "-");
+}
+
+//Prints a line for a single operation on a lexicon of n words, which took seconds.
+static void print_once(const char* label, size_t n, double seconds) {
+    printf("%-42s %9.3f ms (%.2f ns per word)\n", label, seconds * 1e3, seconds * 1e9 / n);
+}
+
+/* Function: time_words
+ * --------------------
+ * Calls op on each of the n words in batches of BATCH_OPS, timing each batch, and prints the
+ * throughput and the 50th, 90th and 99th percentiles of the batches' time per operation.
+ * Returns how many calls returned true, which keeps the calls from being optimized away.
+ */
+static size_t time_words(const char* label, CLexicon* lex, WordOp op, char** words, size_t n) {
+    size_t nbatches = (n + BATCH_OPS - 1) / BATCH_OPS;
+    double* samples = malloc(nbatches * sizeof(double));
+    size_t found = 0;
+    double total = 0;
+    for(size_t b = 0; b < nbatches; b++) {
+        size_t first = b * BATCH_OPS, last = first + BATCH_OPS < n ? first + BATCH_OPS : n;
+        double start = now();
+        for(size_t i = first; i < last; i++) found += op(lex, words[i]);
+        double elapsed = now() - start;
+        total += elapsed;
+        samples[b] = elapsed * 1e9 / (last - first);
+    }
+    qsort(samples, nbatches, sizeof(double), compare_doubles);
+    printf("%-42s %12.0f %9.1f %9.1f %9.1f\n", label, n / total, samples[nbatches / 2],
+           samples[nbatches * 9 / 10], samples[nbatches * 99 / 100]);
+    free(samples);
+    return found;
+}
+
+
+            /* * * Memory * * */
+
+
+static size_t bytes_in_use;
+
+static void* counting_alloc(void* context, size_t size) {
+    bytes_in_use += size;
+    return malloc(size);
+}
+
+static void counting_free(void* context, void* ptr, size_t size) {
+    bytes_in_use -= size;
+    free(ptr);
+}
+
+static const CLexAllocator counting_allocator = { counting_alloc, counting_free, NULL };
+
+static CLexicon* load_words(char** words, size_t n) {
+    CLexicon* lex = clex_create_with_allocator(&counting_allocator);
+    for(size_t i = 0; i < n; i++) clex_add(lex, words[i]);
+    return lex;
+}
+
+
+            /* * * Benchmarks * * */
+
+
+static bool op_add(CLexicon* lex, char* word) { return clex_add(lex, word); }
+static bool op_contains(CLexicon* lex, char* word) { return clex_contains(lex, word); }
+static bool op_contains_prefix(CLexicon* lex, char* word) { return clex_contains_prefix(lex, word); }
+static bool op_remove(CLexicon* lex, char* word) { return clex_remove(lex, word); }
+static bool op_remove_prefix(CLexicon* lex, char* word) { return clex_remove_prefix(lex, word); }
+
+static void bench_lookups(CLexicon* lex, Corpus* corpus, const char* state) {
+    char label[64];
+    struct { const char* name; char** words; } queries[] = {
+        { "hits, sorted order", corpus->sorted }, { "hits, random order", corpus->shuffled },
+        { "misses, random order", corpus->misses }, { "50% hits, random order", corpus->mixed },
+    };
+    for(size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        snprintf(label, sizeof(label), "contains%s: %s", state, queries[q].name);
+        time_words(label, lex, op_contains, queries[q].words, corpus->nwords);
+    }
+    snprintf(label, sizeof(label), "contains_prefix%s: random order", state);
+    time_words(label, lex, op_contains_prefix, corpus->prefixes, corpus->nwords);
+}
+
+static void bench_corpus(Corpus* corpus) {
+    corpus_queries(corpus);
+    print_header(corpus);
+    size_t n = corpus->nwords;
+
+    char filename[] = "/tmp/clexbenchXXXXXX";
+    if(corpus_write(corpus, filename)) {
+        CLexicon* lex = clex_create();
+        double start = now();
+        clex_add_from_file(lex, filename, true);
+        print_total("load: add_from_file", n, now() - start);
+        clex_delete(lex);
+        lex = clex_create();
+        start = now();
+        clex_add_from_sorted_file(lex, filename);
+        print_total("load: add_from_sorted_file", n, now() - start);
+        clex_delete(lex);
+        unlink(filename);
+    }
+    CLexicon* lex = clex_create_with_allocator(&counting_allocator);
+    time_words("load: add, sorted order", lex, op_add, corpus->sorted, n);
+    clex_delete(lex);
+    lex = clex_create_with_allocator(&counting_allocator);
+    time_words("load: add, random order", lex, op_add, corpus->shuffled, n);
+    size_t mutable_bytes = bytes_in_use;
+
+    bench_lookups(lex, corpus, "");
+    clex_freeze(lex);
+    size_t frozen_bytes = bytes_in_use;
+    bench_lookups(lex, corpus, " (frozen)");
+    clex_delete(lex);
+
+    lex = load_words(corpus->sorted, n);
+    time_words("remove: sorted order", lex, op_remove, corpus->sorted, n);
+    clex_delete(lex);
+    lex = load_words(corpus->sorted, n);
+    time_words("remove: random order", lex, op_remove, corpus->shuffled, n);
+    clex_delete(lex);
+    lex = load_words(corpus->sorted, n);
+    time_words("remove_prefix: random order", lex, op_remove_prefix, corpus->prefixes, n);
+    clex_delete(lex);
+
+    lex = load_words(corpus->sorted, n);
+    double start = now();
+    clex_clear(lex);
+    print_once("clear", n, now() - start);
+    clex_delete(lex);
+    lex = load_words(corpus->sorted, n);
+    start = now();
+    clex_delete(lex);
+    print_once("delete", n, now() - start);
+
+    printf("bytes per word: %.1f, %.1f when frozen\n", (double)mutable_bytes / n, (double)frozen_bytes / n);
+    corpus_free(corpus);
+}
+
+int main(int argc, char *argv[]) {
+    int nfiles = argc > 1 ? argc - 1 : 1;
+    for(int f = 0; f < nfiles; f++) {
+        const char* filename = argc > 1 ? argv[f + 1] : "dictionary.txt";
+        Corpus corpus;
+        if(!corpus_read(&corpus, filename)) {
+            fprintf(stderr, "could not read %s\n", filename);
+            return 1;
+        }
+        bench_corpus(&corpus);
+    }
+    Corpus words, keys;
+    corpus_synthesize(&words, false);
+    bench_corpus(&words);
+    corpus_synthesize(&keys, true);
+    bench_corpus(&keys);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("\npeak resident set size: %.1f MB\n", usage.ru_maxrss / 1024.0);
+    return 0;
+}
@@ -5,6 +5,10 @@
  */ 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 #include "CLexicon.h"
 
 void simple_test() {
@@ -114,6 +118,20 @@ void file_reading_test() {
     printf("contains prefix 'incre'? (expect true) : %s\n", clex_contains_prefix(lex, "incre") ? "true" : "false");
     printf("contains prefix 'flupsz'? (expect false) : %s\n\n", clex_contains_prefix(lex, "flupsz") ? "true" : "false");
 
+    //Words in capitals, longer than a block of sixteen bytes, with Windows line endings.
+    char* other = "capitals.txt";
+    FILE* file = fopen(other, "wb");
+    fprintf(file, "ANTIDISESTABLISHMENTARIANISM\r\nFlupSZ\r\n");
+    fclose(file);
+    printf("adding a file in capitals? (expect true) : %s\n", clex_add_from_file(lex, other, false) ? "true" : "false");
+    printf("contains 'antidisestablishmentarianism'? (expect true) : %s\n", clex_contains(lex, "antidisestablishmentarianism") ? "true" : "false");
+    printf("contains 'flupsz'? (expect true) : %s\n", clex_contains(lex, "flupsz") ? "true" : "false");
+    file = fopen(other, "wb");
+    fwrite("zyzzyva\nnul\0byte\n", 1, 17, file);
+    fclose(file);
+    printf("adding a file with a '\\0' in a word? (expect false) : %s\n\n", clex_add_from_file(lex, other, false) ? "true" : "false");
+    remove(other);
+
     printf("clearing lexicon...\n");
     clex_clear(lex);
     printf("word count (expect 0): %d\n", clex_wordcount(lex));
@@ -124,9 +142,1689 @@ void file_reading_test() {
     printf("done!\n\n");
 }
 
+/* Counting allocator used by allocator_test to check that every block is handed back. */
+typedef struct {
+    int live_blocks;
+    size_t live_bytes;
+} AllocCounter;
+
+static void* counting_alloc(void* context, size_t size) {
+    AllocCounter* counter = context;
+    counter->live_blocks++;
+    counter->live_bytes += size;
+    return malloc(size);
+}
+
+static void counting_free(void* context, void* ptr, size_t size) {
+    AllocCounter* counter = context;
+    counter->live_blocks--;
+    counter->live_bytes -= size;
+    free(ptr);
+}
+
+void allocator_test() {
+    printf("---------- Running Allocator Test ----------\n");
+
+    AllocCounter counter = { 0, 0 };
+    CLexAllocator allocator = { counting_alloc, counting_free, &counter };
+    CLexicon* lex = clex_create_with_allocator(&allocator);
+    int blocks_when_empty = counter.live_blocks;
+
+    printf("adding words from file through a counting allocator...\n");
+    bool successful = clex_add_from_file(lex, "dictionary.txt", true);
+    printf("was file add successful? (expect true) %s\n", successful ? "true" : "false");
+    printf("word count: %d\n", clex_wordcount(lex));
+    printf("live blocks after loading: %d (%zu bytes)\n\n", counter.live_blocks, counter.live_bytes);
+
+    printf("removing prefix 'sub' and adding it back\n");
+    int blocks_before = counter.live_blocks;
+    clex_remove_prefix(lex, "sub");
+    clex_add(lex, "subway");
+    clex_add(lex, "submarine");
+    printf("contains 'subway'? (expect true) : %s\n", clex_contains(lex, "subway") ? "true" : "false");
+    printf("reused freed nodes? (expect true) : %s\n\n", counter.live_blocks == blocks_before ? "true" : "false");
+
+    clex_clear(lex);
+    printf("back to an empty lexicon's blocks after clearing? (expect true) : %s\n",
+           counter.live_blocks == blocks_when_empty ? "true" : "false");
+    clex_delete(lex);
+    printf("live blocks after deleting (expect 0): %d\n\n", counter.live_blocks);
+}
+
+void freeze_test() {
+    printf("---------- Running Freeze Test ----------\n");
+
+    AllocCounter counter = { 0, 0 };
+    CLexAllocator allocator = { counting_alloc, counting_free, &counter };
+    CLexicon* lex = clex_create_with_allocator(&allocator);
+    clex_add_from_file(lex, "dictionary.txt", true);
+    size_t tree_bytes = counter.live_bytes;
+
+    printf("freezing lexicon...\n");
+    clex_freeze(lex);
+    printf("is frozen? (expect true) : %s\n", clex_isFrozen(lex) ? "true" : "false");
+    printf("bytes as a tree: %zu, bytes frozen: %zu\n", tree_bytes, counter.live_bytes);
+    printf("fewer bytes after freezing? (expect true) : %s\n", counter.live_bytes < tree_bytes ? "true" : "false");
+    printf("word count: %d (expect 349900)\n\n", clex_wordcount(lex));
+
+    printf("contains 'hello'? (expect true) : %s\n", clex_contains(lex, "hello") ? "true" : "false");
+    printf("contains 'singing'? (expect true) : %s\n", clex_contains(lex, "singing") ? "true" : "false");
+    printf("contains 'notaword'? (expect false) : %s\n", clex_contains(lex, "notaword") ? "true" : "false");
+    printf("contains prefix 'incre'? (expect true) : %s\n", clex_contains_prefix(lex, "incre") ? "true" : "false");
+    printf("contains prefix 'flupsz'? (expect false) : %s\n\n", clex_contains_prefix(lex, "flupsz") ? "true" : "false");
+
+    printf("adding 'flupsz' thaws the lexicon\n");
+    clex_add(lex, "flupsz");
+    printf("is frozen? (expect false) : %s\n", clex_isFrozen(lex) ? "true" : "false");
+    printf("contains 'flupsz'? (expect true) : %s\n", clex_contains(lex, "flupsz") ? "true" : "false");
+    printf("contains 'singing'? (expect true) : %s\n", clex_contains(lex, "singing") ? "true" : "false");
+    printf("word count: %d (expect 349901)\n\n", clex_wordcount(lex));
+
+    clex_delete(lex);
+    printf("live blocks after deleting (expect 0): %d\n\n", counter.live_blocks);
+}
+
+void batch_test() {
+    printf("---------- Running Batch Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+
+    const char* words[] = { "hello", "notaword", "Apple", "pear", "", "flupsz", "zebra", "zzzzzzzz" };
+    bool expected_words[] = { true, false, true, true, false, false, true, true };
+    bool expected_prefixes[] = { true, false, true, true, true, false, true, true };
+    size_t n = sizeof(words) / sizeof(words[0]);
+    bool found[n];
+
+    clex_contains_batch(lex, words, n, found);
+    for(size_t i = 0; i < n; i++) {
+        printf("batch contains '%s'? (expect %s) : %s\n", words[i], expected_words[i] ? "true" : "false", found[i] ? "true" : "false");
+    }
+    printf("\n");
+    clex_contains_prefix_batch(lex, words, n, found);
+    for(size_t i = 0; i < n; i++) {
+        printf("batch contains prefix '%s'? (expect %s) : %s\n", words[i], expected_prefixes[i] ? "true" : "false", found[i] ? "true" : "false");
+    }
+
+    clex_delete(lex);
+    printf("\n");
+}
+
+static int count_true(const bool* found, size_t n) {
+    int count = 0;
+    for(size_t i = 0; i < n; i++) count += found[i];
+    return count;
+}
+
+static int count_differences(const bool* a, const bool* b, size_t n) {
+    int count = 0;
+    for(size_t i = 0; i < n; i++) count += a[i] != b[i];
+    return count;
+}
+
+void parallel_test() {
+    printf("---------- Running Parallel Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    size_t nwords = clex_wordcount(lex);
+    //Every word of the dictionary, then each of them with a 'q' added, most of which are not words.
+    size_t n = 2 * nwords;
+    char (*text)[CLEX_MAX_WORD_LEN + 2] = malloc(n * sizeof(*text));
+    const char** words = malloc(n * sizeof(char*));
+    bool* expected = malloc(n * sizeof(bool));
+    bool* found = malloc(n * sizeof(bool));
+    CLexIterator iter;
+    clex_iter_prefix(lex, &iter, "");
+    for(size_t i = 0; i < nwords && clex_iter_next(&iter, text[i]); i++) {
+        snprintf(text[nwords + i], sizeof(text[0]), "%sq", text[i]);
+        words[i] = text[i];
+        words[nwords + i] = text[nwords + i];
+    }
+    clex_contains_batch(lex, words, n, expected);
+
+    clex_contains_parallel(lex, words, n, found, 4);
+    printf("words found on 4 threads: %d (expect %d)\n", count_true(found, n), count_true(expected, n));
+    printf("answers differing from clex_contains_batch: %d (expect 0)\n", count_differences(found, expected, n));
+    clex_freeze(lex);
+    memset(found, 0, n * sizeof(bool));
+    clex_contains_parallel(lex, words, n, found, 3);
+    printf("answers differing on 3 threads when frozen: %d (expect 0)\n", count_differences(found, expected, n));
+    memset(found, 0, n * sizeof(bool));
+    clex_contains_parallel(lex, words, n, found, 1);
+    printf("answers differing on 1 thread: %d (expect 0)\n\n", count_differences(found, expected, n));
+
+    CLexPool* pool = clex_pool_create(4);
+    memset(found, 0, n * sizeof(bool));
+    size_t batch = 50000;
+    for(size_t first = 0; first < n; first += batch) {
+        clex_pool_submit(pool, lex, words + first, first + batch < n ? batch : n - first, found + first);
+    }
+    clex_pool_wait(pool);
+    printf("answers differing when streamed through a pool: %d (expect 0)\n", count_differences(found, expected, n));
+    const char* few[] = { "hello", "qzqz", "Zebra" };
+    bool few_found[3];
+    clex_pool_contains(pool, lex, few, 3, few_found);
+    printf("pool batch of three words (expect 1 0 1) : %d %d %d\n\n", few_found[0], few_found[1], few_found[2]);
+    clex_pool_delete(pool);
+
+    free(found);
+    free(expected);
+    free(words);
+    free(text);
+    clex_delete(lex);
+}
+
+void slice_test() {
+    printf("---------- Running Slice Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    const char* text = "Quick brown FOX";
+    printf("add slice 'Quick'? (expect true) : %s\n", clex_add_n(lex, text, 5) ? "true" : "false");
+    printf("add slice 'brown'? (expect true) : %s\n", clex_add_n(lex, text + 6, 5) ? "true" : "false");
+    printf("add slice 'FOX'? (expect true) : %s\n", clex_add_n(lex, text + 12, 3) ? "true" : "false");
+    printf("add slice 'Quick brown'? (expect true) : %s\n", clex_add_n(lex, text, 11) ? "true" : "false");
+    printf("add slice holding a '\\0'? (expect false) : %s\n", clex_add_n(lex, "fox\0es", 6) ? "true" : "false");
+    printf("word count: %d (expect 4)\n\n", clex_wordcount(lex));
+
+    printf("contains 'quick'? (expect true) : %s\n", clex_contains(lex, "quick") ? "true" : "false");
+    printf("contains 'fox'? (expect true) : %s\n", clex_contains(lex, "fox") ? "true" : "false");
+    printf("contains 'quick brown'? (expect true) : %s\n", clex_contains(lex, "quick brown") ? "true" : "false");
+    printf("contains slice holding a '\\0'? (expect false) : %s\n", clex_contains_n(lex, "fox\0", 4) ? "true" : "false");
+    printf("contains slice 'QUICK'? (expect true) : %s\n", clex_contains_n(lex, "QUICKLY", 5) ? "true" : "false");
+    printf("contains slice 'QUICKL'? (expect false) : %s\n", clex_contains_n(lex, "QUICKLY", 6) ? "true" : "false");
+    printf("contains prefix slice 'bro'? (expect true) : %s\n", clex_contains_prefix_n(lex, "broom", 3) ? "true" : "false");
+    printf("contains prefix slice 'broo'? (expect false) : %s\n", clex_contains_prefix_n(lex, "broom", 4) ? "true" : "false");
+    printf("contains prefix slice ''? (expect true) : %s\n\n", clex_contains_prefix_n(lex, "xyz", 0) ? "true" : "false");
+
+    printf("remove slice 'Fox'? (expect true) : %s\n", clex_remove_n(lex, "Foxes", 3) ? "true" : "false");
+    printf("contains 'fox'? (expect false) : %s\n", clex_contains(lex, "fox") ? "true" : "false");
+    printf("remove prefix slice 'br'? (expect true) : %s\n", clex_remove_prefix_n(lex, "br!", 2) ? "true" : "false");
+    printf("remove prefix 'qu!'? (expect false) : %s\n", clex_remove_prefix(lex, "qu!") ? "true" : "false");
+    printf("word count: %d (expect 2)\n", clex_wordcount(lex));
+
+    clex_delete(lex);
+    printf("\n");
+}
+
+static void print_prefix_counts(CLexicon* lex) {
+    printf("words beginning with '': %d (expect %d)\n", clex_count_prefix(lex, ""), clex_wordcount(lex));
+    printf("words beginning with 'a': %d (expect 23406)\n", clex_count_prefix(lex, "a"));
+    printf("words beginning with 'Hel': %d (expect 456)\n", clex_count_prefix(lex, "Hel"));
+    printf("words beginning with 'zebra': %d (expect 6)\n", clex_count_prefix(lex, "zebra"));
+    printf("words beginning with 'qz': %d (expect 0)\n", clex_count_prefix(lex, "qz"));
+}
+
+void count_test() {
+    printf("---------- Running Count Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    print_prefix_counts(lex);
+    clex_add(lex, "zebraqz");
+    clex_add(lex, "ZebraQZ");
+    printf("words beginning with 'zebra' after adding one: %d (expect 7)\n", clex_count_prefix_n(lex, "zebras", 5));
+    clex_remove(lex, "zebra");
+    printf("words beginning with 'zebra' after removing one: %d (expect 6)\n", clex_count_prefix(lex, "zebra"));
+    clex_remove_prefix(lex, "sing");
+    printf("words beginning with 'sing' after removing them: %d (expect 0)\n", clex_count_prefix(lex, "sing"));
+    printf("words beginning with 's' after removing 'sing': %d (expect %d)\n", clex_count_prefix(lex, "s"), 34071 - 104);
+    printf("word count: %d (expect 349796)\n\n", clex_wordcount(lex));
+
+    printf("freezing...\n");
+    clex_freeze(lex);
+    printf("words beginning with 'zebra' when frozen: %d (expect 6)\n", clex_count_prefix(lex, "zebra"));
+    printf("words beginning with 's' when frozen: %d (expect %d)\n\n", clex_count_prefix(lex, "s"), 34071 - 104);
+    clex_delete(lex);
+
+    printf("building from sorted file...\n");
+    lex = clex_create();
+    clex_add_from_sorted_file(lex, "dictionary.txt");
+    print_prefix_counts(lex);
+    clex_delete(lex);
+    printf("\n");
+}
+
+static bool same_shape(const CLexStats* a, const CLexStats* b) {
+    return a->words == b->words && a->places == b->places && a->max_depth == b->max_depth &&
+           memcmp(a->places_per_depth, b->places_per_depth, sizeof(a->places_per_depth)) == 0 &&
+           memcmp(a->fanout, b->fanout, sizeof(a->fanout)) == 0;
+}
+
+void stats_test() {
+    printf("---------- Running Stats Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    const char* words[] = { "cat", "car", "cart", "dog" };
+    for(size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        clex_add(lex, (char*)words[i]);
+    }
+    CLexStats stats;
+    clex_stats(lex, &stats);
+    printf("words: %d (expect 4)\n", (int)stats.words);
+    printf("nodes: %d (expect 9)\n", (int)stats.nodes);
+    printf("places at depth 3: %d (expect 3)\n", (int)stats.places_per_depth[3]);
+    printf("places with 0, 1 and 2 children (expect 3 4 2) : %d %d %d\n", (int)stats.fanout[0], (int)stats.fanout[1], (int)stats.fanout[2]);
+    printf("average depth (expect 3.25) : %.2f\n", stats.average_depth);
+    printf("max depth: %d (expect 4)\n", stats.max_depth);
+    printf("dead nodes: %d (expect 0)\n", (int)stats.dead_nodes);
+    printf("memory adds up? (expect true) : %s\n", stats.bytes_in_nodes > 0 && stats.bytes_in_nodes + stats.bytes_free <= stats.bytes_allocated ? "true" : "false");
+    clex_remove_prefix(lex, "ca");
+    clex_stats(lex, &stats);
+    printf("nodes after removing 'ca': %d (expect 4)\n", (int)stats.nodes);
+    printf("unlinked nodes after removing 'ca': %d (expect 5)\n", (int)stats.unlinked_nodes);
+    //New nodes are taken from the unlinked ones first, releasing them as they are wanted.
+    clex_add(lex, "cow");
+    size_t unlinked = stats.unlinked_nodes;
+    clex_stats(lex, &stats);
+    printf("fewer unlinked nodes after adding 'cow'? (expect true) : %s\n\n", stats.unlinked_nodes < unlinked ? "true" : "false");
+    clex_delete(lex);
+
+    lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    CLexStats frozen;
+    clex_stats(lex, &stats);
+    clex_freeze(lex);
+    clex_stats(lex, &frozen);
+    printf("places: %d (expect 940659)\n", (int)stats.places);
+    printf("one node per place? (expect true) : %s\n", stats.nodes == stats.places ? "true" : "false");
+    printf("same places when frozen? (expect true) : %s\n", same_shape(&stats, &frozen) ? "true" : "false");
+    printf("fewer nodes and bytes when frozen? (expect true) : %s\n", frozen.nodes < stats.nodes && frozen.bytes_allocated < stats.bytes_allocated ? "true" : "false");
+    printf("frozen memory adds up? (expect true) : %s\n\n", frozen.bytes_in_nodes + frozen.bytes_free <= frozen.bytes_allocated ? "true" : "false");
+    clex_delete(lex);
+}
+
+//Counts words and checks that they arrive in strictly increasing order.
+static int count_in_order(CLexicon* lex, const char* prefix, bool* ordered) {
+    CLexIterator iter;
+    char prev[CLEX_MAX_WORD_LEN + 1] = "";
+    char word[CLEX_MAX_WORD_LEN + 1];
+    int count = 0;
+    *ordered = true;
+    clex_iter_prefix(lex, &iter, prefix);
+    while(clex_iter_next(&iter, word)) {
+        if(count > 0 && strcmp(prev, word) >= 0) *ordered = false;
+        strcpy(prev, word);
+        count++;
+    }
+    return count;
+}
+
+static bool print_first_three(void* context, const char* word, size_t len) {
+    int* seen = context;
+    printf("visited '%s' (%zu letters)\n", word, len);
+    return ++*seen < 3;
+}
+
+void iter_test() {
+    printf("---------- Running Iterator Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+
+    CLexIterator iter;
+    char word[CLEX_MAX_WORD_LEN + 1];
+    printf("words beginning with 'Zebra':\n");
+    clex_iter_prefix(lex, &iter, "Zebra");
+    while(clex_iter_next(&iter, word)) printf("  %s\n", word);
+
+    bool ordered;
+    printf("iterated words beginning with 'a': %d (expect 23406)\n", count_in_order(lex, "a", &ordered));
+    printf("in sorted order? (expect true) : %s\n", ordered ? "true" : "false");
+    printf("iterated words beginning with '': %d (expect 349900)\n", count_in_order(lex, "", &ordered));
+    printf("in sorted order? (expect true) : %s\n", ordered ? "true" : "false");
+    printf("iterated words beginning with 'qz': %d (expect 0)\n\n", count_in_order(lex, "qz", &ordered));
+
+    int seen = 0;
+    clex_visit_prefix(lex, "hel", print_first_three, &seen);
+    printf("words visited before stopping: %d (expect 3)\n\n", seen);
+
+    clex_freeze(lex);
+    printf("iterated words beginning with 'a' when frozen: %d (expect 23406)\n", count_in_order(lex, "a", &ordered));
+    printf("in sorted order? (expect true) : %s\n", ordered ? "true" : "false");
+
+    char longword[CLEX_MAX_WORD_LEN + 2];
+    memset(longword, 'a', CLEX_MAX_WORD_LEN + 1);
+    longword[CLEX_MAX_WORD_LEN + 1] = '\0';
+    printf("add a word longer than CLEX_MAX_WORD_LEN? (expect false) : %s\n", clex_add(lex, longword) ? "true" : "false");
+    longword[CLEX_MAX_WORD_LEN] = '\0';
+    printf("add a word of exactly CLEX_MAX_WORD_LEN? (expect true) : %s\n\n", clex_add(lex, longword) ? "true" : "false");
+    clex_delete(lex);
+}
+
+static void print_top_k(CLexicon* lex, const char* prefix, size_t k, const char* expected) {
+    CLexCompletion out[k];
+    size_t found = clex_top_k(lex, prefix, k, out);
+    printf("top %zu for '%s' (expect %s) : ", k, prefix, expected);
+    for(size_t i = 0; i < found; i++) printf(i == 0 ? "%s=%u" : " %s=%u", out[i].word, out[i].weight);
+    printf("\n");
+}
+
+void weighted_test() {
+    printf("---------- Running Weighted Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    print_top_k(lex, "zebra", 3, "zebra=0 zebraic=0 zebralike=0");
+
+    //"so", "sun" and "sea" are not in dictionary.txt, so they are added.
+    const char* words[] = { "so", "sun", "Sea", "singer", "sing", "zebra", "sunny" };
+    uint32_t weights[] = { 200, 120, 80, 80, 50, 10, 5 };
+    for(size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        clex_add_weighted(lex, words[i], weights[i]);
+    }
+    printf("weight of 'singer'? (expect 80) : %u\n", clex_weight(lex, "singer"));
+    printf("weight of 'singers'? (expect 0) : %u\n", clex_weight(lex, "singers"));
+    printf("word count: %d (expect 349903)\n", clex_wordcount(lex));
+    print_top_k(lex, "s", 5, "so=200 sun=120 sea=80 singer=80 sing=50");
+    print_top_k(lex, "Su", 3, "sun=120 sunny=5 suabau=0");
+
+    clex_add_weighted(lex, "so", 1);
+    clex_remove(lex, "sun");
+    print_top_k(lex, "s", 3, "sea=80 singer=80 sing=50");
+    clex_remove_prefix(lex, "sing");
+    print_top_k(lex, "s", 3, "sea=80 sunny=5 so=1");
+
+    clex_add_weighted(lex, "flupsz", 7);
+    printf("contains 'flupsz'? (expect true) : %s\n", clex_contains(lex, "flupsz") ? "true" : "false");
+    printf("add weighted 'sing!'? (expect true) : %s\n", clex_add_weighted(lex, "sing!", 3) ? "true" : "false");
+    printf("freezing...\n");
+    clex_freeze(lex);
+    print_top_k(lex, "", 4, "sea=80 zebra=10 flupsz=7 sunny=5");
+    print_top_k(lex, "qz", 4, "");
+    printf("\n");
+    clex_delete(lex);
+}
+
+//Counts the words of dictionary.txt within max_edits of word the slow way, one word at a time.
+static int edit_distance(const char* a, const char* b) {
+    size_t alen = strlen(a), blen = strlen(b);
+    int row[blen + 1];
+    for(size_t j = 0; j <= blen; j++) row[j] = j;
+    for(size_t i = 1; i <= alen; i++) {
+        int diagonal = row[0];
+        row[0] = i;
+        for(size_t j = 1; j <= blen; j++) {
+            int edits = diagonal + (a[i - 1] != b[j - 1]);
+            if(row[j] + 1 < edits) edits = row[j] + 1;
+            if(row[j - 1] + 1 < edits) edits = row[j - 1] + 1;
+            diagonal = row[j];
+            row[j] = edits;
+        }
+    }
+    return row[blen];
+}
+
+static int count_within(const char* word, int max_edits) {
+    char lower[strlen(word) + 1];
+    for(size_t i = 0; i <= strlen(word); i++) lower[i] = tolower(word[i]);
+    FILE* file = fopen("dictionary.txt", "r");
+    char line[64];
+    int count = 0;
+    while(fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(edit_distance(line, lower) <= max_edits) count++;
+    }
+    fclose(file);
+    return count;
+}
+
+typedef struct {
+    int found;
+    int limit;
+    bool in_order;
+    char last[CLEX_MAX_WORD_LEN + 1];
+} FuzzyState;
+
+static bool collect_fuzzy(void* context, const char* word, size_t len, int edits) {
+    FuzzyState* state = context;
+    if(state->found > 0 && strcmp(state->last, word) >= 0) state->in_order = false;
+    strcpy(state->last, word);
+    if(state->limit > 0) printf("  %s (%d)\n", word, edits);
+    return ++state->found != state->limit;
+}
+
+static int count_fuzzy(CLexicon* lex, const char* word, int max_edits, bool* in_order) {
+    FuzzyState state = { 0, -1, true, "" };
+    clex_fuzzy_search(lex, word, max_edits, collect_fuzzy, &state);
+    *in_order = state.in_order;
+    return state.found;
+}
+
+void fuzzy_test() {
+    printf("---------- Running Fuzzy Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    bool in_order;
+    const char* words[] = { "speling", "Helo", "recieve", "qzx", "a" };
+    for(int edits = 0; edits <= 2; edits++) {
+        for(size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+            int found = count_fuzzy(lex, words[i], edits, &in_order);
+            printf("words within %d of '%s': %d (expect %d)\n", edits, words[i], found, count_within(words[i], edits));
+        }
+    }
+    count_fuzzy(lex, "speling", 2, &in_order);
+    printf("in alphabetical order? (expect true) : %s\n", in_order ? "true" : "false");
+    printf("words within 2 of 'spel1ng': %d (expect %d)\n\n", count_fuzzy(lex, "spel1ng", 2, &in_order), count_within("spel1ng", 2));
+
+    printf("first three words within 1 of 'hellp':\n");
+    FuzzyState state = { 0, 3, true, "" };
+    clex_fuzzy_search(lex, "hellp", 1, collect_fuzzy, &state);
+    printf("words visited before stopping: %d (expect 3)\n\n", state.found);
+
+    clex_freeze(lex);
+    printf("words within 2 of 'speling' when frozen: %d (expect %d)\n\n", count_fuzzy(lex, "speling", 2, &in_order), count_within("speling", 2));
+    clex_delete(lex);
+}
+
+//Matches word against a pattern of letters, '?' and '*' the slow way, by backtracking.
+static bool glob_match(const char* pattern, const char* word) {
+    if(*pattern == '\0') return *word == '\0';
+    if(*pattern == '*') return glob_match(pattern + 1, word) || (*word != '\0' && glob_match(pattern, word + 1));
+    if(*word == '\0') return false;
+    return (*pattern == '?' || tolower(*pattern) == *word) && glob_match(pattern + 1, word + 1);
+}
+
+//Checks whether word can be spelled with the tiles in letters, '?' being a blank.
+static bool tiles_match(const char* letters, const char* word, bool use_all) {
+    int tiles[27] = { 0 };
+    for(const char* p = letters; *p != '\0'; p++) tiles[*p == '?' ? 26 : tolower(*p) - 'a']++;
+    for(const char* p = word; *p != '\0'; p++) {
+        int tile = tiles[*p - 'a'] > 0 ? *p - 'a' : 26;
+        if(tiles[tile]-- == 0) return false;
+    }
+    return !use_all || strlen(word) == strlen(letters);
+}
+
+//Counts the words of dictionary.txt that pass one of the checks above.
+static int count_matching(const char* query, int mode) {
+    FILE* file = fopen("dictionary.txt", "r");
+    char line[64];
+    int count = 0;
+    while(fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(mode == 0 ? glob_match(query, line) : tiles_match(query, line, mode == 2)) count++;
+    }
+    fclose(file);
+    return count;
+}
+
+typedef struct {
+    int found;
+    bool in_order;
+    char last[CLEX_MAX_WORD_LEN + 1];
+} MatchState;
+
+static bool count_match(void* context, const char* word, size_t len) {
+    MatchState* state = context;
+    if(state->found > 0 && strcmp(state->last, word) >= 0) state->in_order = false;
+    strcpy(state->last, word);
+    state->found++;
+    return true;
+}
+
+void pattern_test() {
+    printf("---------- Running Pattern Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    const char* patterns[] = { "c?t*", "*ing", "?????", "Qu*z*", "a*b*c", "z?bra", "**x**y**", "*" };
+    bool in_order = true;
+    for(size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        MatchState found = { 0, true, "" };
+        clex_match_pattern(lex, patterns[i], count_match, &found);
+        printf("words matching '%s': %d (expect %d)\n", patterns[i], found.found, count_matching(patterns[i], 0));
+        in_order = in_order && found.in_order;
+    }
+    printf("matches in alphabetical order? (expect true) : %s\n", in_order ? "true" : "false");
+    MatchState state = { 0, true, "" };
+    clex_match_pattern(lex, "c!t", count_match, &state);
+    printf("words matching 'c!t': %d (expect 0)\n\n", state.found);
+
+    const char* racks[] = { "listen", "Retains", "tea?", "??", "qqqq" };
+    for(size_t i = 0; i < sizeof(racks) / sizeof(racks[0]); i++) {
+        for(int use_all = 0; use_all <= 1; use_all++) {
+            state = (MatchState){ 0, true, "" };
+            clex_match_letters(lex, racks[i], use_all, count_match, &state);
+            printf("words %s tiles '%s': %d (expect %d)\n", use_all ? "using all the" : "from the", racks[i], state.found, count_matching(racks[i], use_all ? 2 : 1));
+        }
+    }
+
+    clex_freeze(lex);
+    state = (MatchState){ 0, true, "" };
+    clex_match_pattern(lex, "*ing", count_match, &state);
+    printf("words matching '*ing' when frozen: %d (expect %d)\n", state.found, count_matching("*ing", 0));
+    state = (MatchState){ 0, true, "" };
+    clex_match_letters(lex, "Retains", true, count_match, &state);
+    printf("anagrams of 'Retains' when frozen: %d (expect %d)\n\n", state.found, count_matching("Retains", 2));
+    clex_delete(lex);
+}
+
+typedef struct {
+    int found;
+    char list[64];          //the first matches found, as "start+len" pairs
+} ScanResult;
+
+static bool record_scan_match(void* context, size_t start, size_t len) {
+    ScanResult* result = context;
+    size_t used = strlen(result->list);
+    if(used + 8 < sizeof(result->list)) sprintf(result->list + used, "%s%d+%d", used ? " " : "", (int)start, (int)len);
+    result->found++;
+    return true;
+}
+
+static bool stop_scan(void* context, size_t start, size_t len) {
+    return ++*(int*)context < 3;
+}
+
+//Counts the words inside text the slow way, with one lookup for every start and length.
+static int count_words_inside(CLexicon* lex, const char* text, size_t len) {
+    int found = 0;
+    for(size_t start = 0; start < len; start++) {
+        for(size_t n = 1; n <= CLEX_MAX_WORD_LEN && start + n <= len; n++) {
+            if(clex_contains_n(lex, text + start, n)) found++;
+        }
+    }
+    return found;
+}
+
+//Finds the longest word text begins with the slow way, trying every length.
+static int longest_word_at(CLexicon* lex, const char* text, size_t len) {
+    int longest = 0;
+    for(size_t n = 1; n <= CLEX_MAX_WORD_LEN && n <= len; n++) {
+        if(clex_contains_n(lex, text, n)) longest = n;
+    }
+    return longest;
+}
+
+void scan_test() {
+    printf("---------- Running Scan Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    const char* words[] = { "he", "she", "his", "hers" };
+    for(size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        clex_add(lex, (char*)words[i]);
+    }
+    printf("longest prefix of 'hersheys': %d (expect 4)\n", (int)clex_longest_prefix(lex, "hersheys", 8));
+    printf("longest prefix of 'Sheer': %d (expect 3)\n", (int)clex_longest_prefix(lex, "Sheer", 5));
+    printf("longest prefix of the first 3 bytes of 'hers': %d (expect 2)\n", (int)clex_longest_prefix(lex, "hers", 3));
+    printf("longest prefix of 'ahe': %d (expect 0)\n", (int)clex_longest_prefix(lex, "ahe", 3));
+
+    CLexScanner* scanner = clex_scanner_create(lex);
+    ScanResult result = { 0, "" };
+    clex_scanner_scan(scanner, "USHERS", 6, record_scan_match, &result);
+    printf("matches in 'USHERS' (expect 1+3 2+2 2+4) : %s\n", result.list);
+    result = (ScanResult){ 0, "" };
+    clex_scanner_scan(scanner, "his\0she", 7, record_scan_match, &result);
+    printf("matches in 'his\\0she' (expect 0+3 4+3 5+2) : %s\n", result.list);
+    //Words added after the scanner is built are not seen by it.
+    clex_add(lex, "us");
+    result = (ScanResult){ 0, "" };
+    clex_scanner_scan(scanner, "us", 2, record_scan_match, &result);
+    printf("matches of a word added later: %d (expect 0)\n", result.found);
+    clex_scanner_delete(scanner);
+    clex_delete(lex);
+
+    lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    const char* text = "Thequickbrownfoxjumpsoverthelazydog, and then 3 more foxes antidisestablishmentarianism!";
+    size_t textlen = strlen(text);
+    int expected = count_words_inside(lex, text, textlen);
+    scanner = clex_scanner_create(lex);
+    result = (ScanResult){ 0, "" };
+    clex_scanner_scan(scanner, text, textlen, record_scan_match, &result);
+    printf("dictionary words inside the text: %d (expect %d)\n", result.found, expected);
+    int seen = 0;
+    clex_scanner_scan(scanner, text, textlen, stop_scan, &seen);
+    printf("matches seen before stopping: %d (expect 3)\n", seen);
+    clex_scanner_delete(scanner);
+    const char* segment = text + 16;
+    int longest = longest_word_at(lex, segment, strlen(segment));
+    printf("longest prefix of 'jumpsover...': %d (expect %d)\n", (int)clex_longest_prefix(lex, segment, strlen(segment)), longest);
+
+    clex_freeze(lex);
+    scanner = clex_scanner_create(lex);
+    result = (ScanResult){ 0, "" };
+    clex_scanner_scan(scanner, text, textlen, record_scan_match, &result);
+    printf("dictionary words inside the text when frozen: %d (expect %d)\n", result.found, expected);
+    clex_scanner_delete(scanner);
+    printf("longest prefix of 'jumpsover...' when frozen: %d (expect %d)\n", (int)clex_longest_prefix(lex, segment, strlen(segment)), longest);
+    printf("longest prefix of 'antidis...' when frozen: %d (expect %d)\n\n", (int)clex_longest_prefix(lex, text + 59, textlen - 59), longest_word_at(lex, text + 59, textlen - 59));
+    clex_delete(lex);
+}
+
+static bool print_word(void* context, const char* word, size_t len) {
+    printf(" %s", word);
+    return true;
+}
+
+static void print_prefix_words(CLexicon* lex, const char* prefix, const char* expected) {
+    printf("words beginning with '%s' (expect%s) :", prefix, expected);
+    clex_visit_prefix(lex, prefix, print_word, NULL);
+    printf("\n");
+}
+
+void byte_test() {
+    printf("---------- Running Byte Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    const char* words[] = { "don't", "Caf\xc3\xa9", "na\xc3\xafve", "e-mail", "3d", "x", "xa", "x-", "x\xc3\xa9" };
+    for(size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        clex_add(lex, (char*)words[i]);
+    }
+    printf("contains \"DON'T\"? (expect true) : %s\n", clex_contains(lex, "DON'T") ? "true" : "false");
+    printf("contains 'dont'? (expect false) : %s\n", clex_contains(lex, "dont") ? "true" : "false");
+    printf("contains 'CAF\xc3\xa9'? (expect true) : %s\n", clex_contains(lex, "CAF\xc3\xa9") ? "true" : "false");
+    //Only ASCII letters fold, so a capital outside ASCII is a different word.
+    printf("contains 'CAF\xc3\x89'? (expect false) : %s\n", clex_contains(lex, "CAF\xc3\x89") ? "true" : "false");
+    printf("contains prefix ending inside a character? (expect true) : %s\n", clex_contains_prefix(lex, "na\xc3") ? "true" : "false");
+    printf("word count: %d (expect 9)\n\n", clex_wordcount(lex));
+
+    //More than four children for other bytes under 'x' turn its list into a bitmap.
+    char digit[] = "x0";
+    for(char c = '0'; c <= '9'; c++) {
+        digit[1] = c;
+        clex_add(lex, digit);
+    }
+    printf("words beginning with 'x': %d (expect 14)\n", clex_count_prefix(lex, "x"));
+    print_prefix_words(lex, "x", " x x- x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 xa x\xc3\xa9");
+    for(char c = '2'; c <= '9'; c++) {
+        digit[1] = c;
+        clex_remove(lex, digit);
+    }
+    printf("contains 'x1'? (expect true) : %s\n", clex_contains(lex, "x1") ? "true" : "false");
+    printf("contains 'x5'? (expect false) : %s\n", clex_contains(lex, "x5") ? "true" : "false");
+    print_prefix_words(lex, "x", " x x- x0 x1 xa x\xc3\xa9");
+    printf("remove prefix 'x-'? (expect true) : %s\n", clex_remove_prefix(lex, "x-") ? "true" : "false");
+    printf("words beginning with 'x': %d (expect 5)\n\n", clex_count_prefix(lex, "x"));
+
+    clex_add_weighted(lex, "na\xc3\xafvet\xc3\xa9", 9);
+    clex_add(lex, "cafe");
+    print_top_k(lex, "NA", 2, "na\xc3\xafvet\xc3\xa9=9 na\xc3\xafve=0");
+    MatchState state = { 0, true, "" };
+    clex_match_pattern(lex, "caf?", count_match, &state);
+    printf("words matching 'caf?': %d (expect 1)\n", state.found);
+    state = (MatchState){ 0, true, "" };
+    clex_match_pattern(lex, "*'*", count_match, &state);
+    printf("words matching \"*'*\": %d (expect 1)\n", state.found);
+    state = (MatchState){ 0, true, "" };
+    clex_match_letters(lex, "d3", true, count_match, &state);
+    printf("words using all the tiles 'd3': %d (expect 1)\n", state.found);
+    bool in_order;
+    //The accented letter is two bytes, so it is two edits from a plain 'e'.
+    printf("words within 1 of 'cafe': %d (expect 1)\n", count_fuzzy(lex, "cafe", 1, &in_order));
+    printf("words within 2 of 'cafe': %d (expect 2)\n\n", count_fuzzy(lex, "cafe", 2, &in_order));
+
+    printf("freezing...\n");
+    clex_freeze(lex);
+    printf("contains 'x\xc3\xa9'? (expect true) : %s\n", clex_contains(lex, "x\xc3\xa9") ? "true" : "false");
+    print_prefix_words(lex, "x", " x x0 x1 xa x\xc3\xa9");
+    clex_delete(lex);
+
+    char* sorted = "bytes.txt";
+    FILE* file = fopen(sorted, "w");
+    fprintf(file, "3d\ne-mail\nx\nx-\nx0\nx1\nx2\nx3\nx4\nx5\nxa\nx\xc3\xa9\n");
+    fclose(file);
+    lex = clex_create();
+    printf("adding a sorted file of bytes? (expect true) : %s\n", clex_add_from_sorted_file(lex, sorted) ? "true" : "false");
+    printf("word count: %d (expect 12)\n", clex_wordcount(lex));
+    print_prefix_words(lex, "x", " x x- x0 x1 x2 x3 x4 x5 xa x\xc3\xa9");
+    printf("contains 'X5'? (expect true) : %s\n", clex_contains(lex, "X5") ? "true" : "false");
+    clex_delete(lex);
+    remove(sorted);
+    printf("\n");
+}
+
+void chain_test() {
+    printf("---------- Running Chain Test ----------\n");
+
+    //Below "counter" and "counterrevolution" the words run on through nodes with one child,
+    //which a frozen lexicon stores as single nodes labelled with the bytes along them.
+    CLexicon* lex = clex_create();
+    clex_add(lex, "counter");
+    clex_add(lex, "counterrevolutionary");
+    clex_add_weighted(lex, "Counterrevolutionaries", 5);
+    clex_freeze(lex);
+    printf("contains 'counterrevolutionary'? (expect true) : %s\n", clex_contains(lex, "counterrevolutionary") ? "true" : "false");
+    printf("contains 'counterrevolution'? (expect false) : %s\n", clex_contains(lex, "counterrevolution") ? "true" : "false");
+    printf("contains 'counterrevolutionaryx'? (expect false) : %s\n", clex_contains(lex, "counterrevolutionaryx") ? "true" : "false");
+    printf("contains prefix 'COUNTERREV'? (expect true) : %s\n", clex_contains_prefix(lex, "COUNTERREV") ? "true" : "false");
+    printf("contains prefix 'counterrevx'? (expect false) : %s\n", clex_contains_prefix(lex, "counterrevx") ? "true" : "false");
+    printf("contains slice 'counterrevol'? (expect false) : %s\n", clex_contains_n(lex, "counterrevolutionary", 12) ? "true" : "false");
+    const char* prefixes[] = { "count", "counterrevolutionar", "counterrevolutionari", "counterrevolutionarx" };
+    bool found[4];
+    clex_contains_prefix_batch(lex, prefixes, 4, found);
+    printf("batch of prefixes (expect 1 1 1 0) : %d %d %d %d\n", found[0], found[1], found[2], found[3]);
+    printf("words beginning with 'counterr': %d (expect 2)\n", clex_count_prefix(lex, "counterr"));
+    print_prefix_words(lex, "counte", " counter counterrevolutionaries counterrevolutionary");
+    print_top_k(lex, "counterrevo", 2, "counterrevolutionaries=5 counterrevolutionary=0");
+    printf("weight of 'counterrevolutionaries'? (expect 5) : %u\n", clex_weight(lex, "counterrevolutionaries"));
+    MatchState state = { 0, true, "" };
+    clex_match_pattern(lex, "*tionar*", count_match, &state);
+    printf("words matching '*tionar*': %d (expect 2)\n", state.found);
+    bool in_order;
+    printf("words within 1 of 'counterrevolutionery': %d (expect 1)\n", count_fuzzy(lex, "counterrevolutionery", 1, &in_order));
+
+    printf("adding 'counterrevolution' thaws the lexicon\n");
+    clex_add(lex, "counterrevolution");
+    printf("contains 'counterrevolution'? (expect true) : %s\n", clex_contains(lex, "counterrevolution") ? "true" : "false");
+    printf("contains 'counterrevolutionary'? (expect true) : %s\n", clex_contains(lex, "counterrevolutionary") ? "true" : "false");
+    printf("words beginning with 'counterr': %d (expect 3)\n", clex_count_prefix(lex, "counterr"));
+    print_top_k(lex, "counterrevo", 2, "counterrevolutionaries=5 counterrevolution=0");
+    printf("\n");
+    clex_delete(lex);
+}
+
+void jump_test() {
+    printf("---------- Running Jump Table Test ----------\n");
+
+    //Lookups of words beginning with two letters start from a table of the places of every
+    //two-letter prefix, which every change to the tree has to keep up to date.
+    CLexicon* lex = clex_create();
+    printf("contains 'ab' when empty? (expect false) : %s\n", clex_contains(lex, "ab") ? "true" : "false");
+    clex_add(lex, "Ab");
+    clex_add(lex, "abc");
+    clex_add(lex, "a");
+    clex_add(lex, "z9");
+    printf("contains 'ab'? (expect true) : %s\n", clex_contains(lex, "ab") ? "true" : "false");
+    printf("contains 'ABC'? (expect true) : %s\n", clex_contains(lex, "ABC") ? "true" : "false");
+    printf("contains 'z9'? (expect true) : %s\n", clex_contains(lex, "z9") ? "true" : "false");
+    printf("contains prefix 'ac'? (expect false) : %s\n", clex_contains_prefix(lex, "ac") ? "true" : "false");
+    clex_remove(lex, "abc");
+    clex_remove(lex, "ab");
+    printf("contains prefix 'ab' once removed? (expect false) : %s\n", clex_contains_prefix(lex, "ab") ? "true" : "false");
+    clex_add_weighted(lex, "abide", 4);
+    printf("weight of 'abide'? (expect 4) : %u\n", clex_weight(lex, "abide"));
+    clex_remove_prefix(lex, "a");
+    printf("contains prefix 'ab' once 'a' is removed? (expect false) : %s\n", clex_contains_prefix(lex, "ab") ? "true" : "false");
+    clex_add(lex, "abide");
+    printf("contains 'abide' added again? (expect true) : %s\n", clex_contains(lex, "abide") ? "true" : "false");
+    clex_clear(lex);
+    printf("contains 'abide' once cleared? (expect false) : %s\n\n", clex_contains(lex, "abide") ? "true" : "false");
+
+    //A lexicon of one word is a single chain node once frozen, so "xy" lies inside its label.
+    clex_add(lex, "xylophone");
+    clex_freeze(lex);
+    printf("contains 'xylophone'? (expect true) : %s\n", clex_contains(lex, "xylophone") ? "true" : "false");
+    printf("contains 'xy'? (expect false) : %s\n", clex_contains(lex, "xy") ? "true" : "false");
+    printf("contains prefix 'XYLO'? (expect true) : %s\n", clex_contains_prefix(lex, "XYLO") ? "true" : "false");
+    printf("contains prefix 'xz'? (expect false) : %s\n", clex_contains_prefix(lex, "xz") ? "true" : "false");
+    printf("words beginning with 'xy': %d (expect 1)\n", clex_count_prefix(lex, "xy"));
+    const char* words[] = { "xylophone", "xy", "xylophones", "xylophonf" };
+    bool found[4];
+    clex_contains_batch(lex, words, 4, found);
+    printf("batch of words (expect 1 0 0 0) : %d %d %d %d\n", found[0], found[1], found[2], found[3]);
+    clex_contains_prefix_batch(lex, words, 4, found);
+    printf("batch of prefixes (expect 1 1 0 0) : %d %d %d %d\n", found[0], found[1], found[2], found[3]);
+    print_prefix_words(lex, "xyl", " xylophone");
+    clex_add(lex, "xyst");
+    printf("contains 'xylophone' once thawed? (expect true) : %s\n", clex_contains(lex, "xylophone") ? "true" : "false");
+    printf("words beginning with 'xy': %d (expect 2)\n\n", clex_count_prefix(lex, "xy"));
+    clex_delete(lex);
+}
+
+void remove_test() {
+    printf("---------- Running Remove Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+
+    const char* words[] = { "zebra", "notaword", "House", "singing", "sing!" };
+    bool expected[] = { true, false, true, true, false };
+    size_t n = sizeof(words) / sizeof(words[0]);
+    bool removed[n];
+    clex_remove_batch(lex, words, n, removed);
+    for(size_t i = 0; i < n; i++) {
+        printf("batch remove '%s'? (expect %s) : %s\n", words[i], expected[i] ? "true" : "false", removed[i] ? "true" : "false");
+    }
+    printf("contains 'sing'? (expect true) : %s\n", clex_contains(lex, "sing") ? "true" : "false");
+    printf("contains 'singingly'? (expect true) : %s\n", clex_contains(lex, "singingly") ? "true" : "false");
+    printf("word count: %d (expect 349897)\n\n", clex_wordcount(lex));
+
+    //Adds every word "qz" followed by three letters, then removes them one at a time.
+    char word[6] = "qz???";
+    for(int i = 0; i < 26 * 26 * 26; i++) {
+        word[2] = 'a' + i / 676;
+        word[3] = 'a' + i / 26 % 26;
+        word[4] = 'a' + i % 26;
+        clex_add(lex, word);
+    }
+    printf("word count: %d (expect 367473)\n", clex_wordcount(lex));
+    bool all_removed = true;
+    for(int i = 0; i < 26 * 26 * 26; i++) {
+        word[2] = 'a' + i / 676;
+        word[3] = 'a' + i / 26 % 26;
+        word[4] = 'a' + i % 26;
+        all_removed &= clex_remove(lex, word);
+    }
+    printf("were all removes successful? (expect true) : %s\n", all_removed ? "true" : "false");
+    printf("contains prefix 'qz'? (expect false) : %s\n", clex_contains_prefix(lex, "qz") ? "true" : "false");
+    printf("contains prefix 'q'? (expect true) : %s\n", clex_contains_prefix(lex, "q") ? "true" : "false");
+    printf("word count: %d (expect 349897)\n\n", clex_wordcount(lex));
+    clex_delete(lex);
+
+    //Removing the only words under a prefix must not leave the letters above it behind.
+    lex = clex_create();
+    clex_add(lex, "xyzzy");
+    clex_add(lex, "xyzzyq");
+    clex_add(lex, "abc");
+    printf("remove prefix 'xyzz'? (expect true) : %s\n", clex_remove_prefix(lex, "xyzz") ? "true" : "false");
+    printf("contains prefix 'x'? (expect false) : %s\n", clex_contains_prefix(lex, "x") ? "true" : "false");
+    printf("remove 'abc'? (expect true) : %s\n", clex_remove(lex, "abc") ? "true" : "false");
+    printf("contains prefix 'a'? (expect false) : %s\n", clex_contains_prefix(lex, "a") ? "true" : "false");
+    printf("is empty? (expect true) : %s\n", clex_isEmpty(lex) ? "true" : "false");
+    clex_delete(lex);
+    printf("\n");
+}
+
+typedef struct {
+    CLexicon* lex;
+    bool* stop;
+    long lookups;
+    long wrong;
+} ReaderState;
+
+static void* concurrent_reader(void* arg) {
+    ReaderState* state = arg;
+    char* present[] = { "hello", "apple", "zebra", "singing", "house" };
+    const char* batch[] = { "hello", "qzqz", "pear", "zebra" };
+    bool found[4];
+    while(!__atomic_load_n(state->stop, __ATOMIC_RELAXED)) {
+        for(int i = 0; i < 5; i++) {
+            if(!clex_contains(state->lex, present[i])) state->wrong++;
+        }
+        if(clex_contains(state->lex, "notaword") || !clex_contains_prefix(state->lex, "hel")) state->wrong++;
+        //Words beginning with "qz" come and go; only the answer for the other words is known.
+        clex_contains(state->lex, "qzab");
+        clex_contains_prefix(state->lex, "qzb");
+        clex_contains_batch(state->lex, batch, 4, found);
+        if(!found[0] || !found[2] || !found[3]) state->wrong++;
+        state->lookups += 10;
+    }
+    return NULL;
+}
+
+void concurrent_test() {
+    printf("---------- Running Concurrent Test ----------\n");
+
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    clex_set_concurrent(lex, true);
+
+    bool stop = false;
+    pthread_t threads[4];
+    ReaderState states[4];
+    for(int t = 0; t < 4; t++) {
+        states[t] = (ReaderState){ lex, &stop, 0, 0 };
+        pthread_create(&threads[t], NULL, concurrent_reader, &states[t]);
+    }
+
+    //Adds and removes words under "qz" while the readers look up words that never change.
+    char word[5] = "qz??";
+    bool consistent = true;
+    for(int round = 0; round < 2000; round++) {
+        for(int i = 0; i < 26; i++) {
+            word[2] = 'a' + i;
+            word[3] = 'a' + (round + i) % 26;
+            clex_add(lex, word);
+        }
+        if(round % 2 == 0) {
+            consistent &= clex_remove_prefix(lex, "qz");
+        } else {
+            for(int i = 0; i < 26; i++) {
+                word[2] = 'a' + i;
+                word[3] = 'a' + (round + i) % 26;
+                consistent &= clex_remove(lex, word);
+            }
+        }
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+
+    long lookups = 0, wrong = 0;
+    for(int t = 0; t < 4; t++) {
+        pthread_join(threads[t], NULL);
+        lookups += states[t].lookups;
+        wrong += states[t].wrong;
+    }
+    printf("lookups made by readers: %s\n", lookups > 0 ? "some" : "none");
+    printf("did every writer remove succeed? (expect true) : %s\n", consistent ? "true" : "false");
+    printf("were all reader answers right? (expect true) : %s\n", wrong == 0 ? "true" : "false");
+    printf("contains prefix 'qz'? (expect false) : %s\n", clex_contains_prefix(lex, "qz") ? "true" : "false");
+    printf("word count: %d (expect 349900)\n", clex_wordcount(lex));
+
+    clex_set_concurrent(lex, false);
+    printf("contains 'hello' after leaving concurrent mode? (expect true) : %s\n", clex_contains(lex, "hello") ? "true" : "false");
+    clex_delete(lex);
+    printf("\n");
+}
+
+//Returns true if the two lexicons hold exactly the same words, in the same order.
+static bool same_words(CLexicon* a, CLexicon* b) {
+    CLexIterator ia, ib;
+    clex_iter_prefix(a, &ia, "");
+    clex_iter_prefix(b, &ib, "");
+    char wa[CLEX_MAX_WORD_LEN + 1], wb[CLEX_MAX_WORD_LEN + 1];
+    for(;;) {
+        bool more_a = clex_iter_next(&ia, wa);
+        bool more_b = clex_iter_next(&ib, wb);
+        if(more_a != more_b) return false;
+        if(!more_a) return true;
+        if(strcmp(wa, wb) != 0) return false;
+    }
+}
+
+void merge_test() {
+    printf("---------- Running Merge Test ----------\n");
+
+    CLexicon* serial = clex_create();
+    clex_add_from_file(serial, "dictionary.txt", true);
+    CLexicon* lex = clex_create();
+    clex_add(lex, "flupsz");
+    printf("adding words from file on 4 threads...\n");
+    bool successful = clex_add_from_file_parallel(lex, "dictionary.txt", 4);
+    printf("was file add successful? (expect true) %s\n", successful ? "true" : "false");
+    printf("word count: %d (expect 349901)\n", clex_wordcount(lex));
+    printf("words beginning with 's': %d (expect %d)\n", clex_count_prefix(lex, "s"), clex_count_prefix(serial, "s"));
+    clex_remove(lex, "flupsz");
+    printf("same words as a load on one thread? (expect true) : %s\n", same_words(lex, serial) ? "true" : "false");
+    printf("adding a file that does not exist? (expect false) : %s\n", clex_add_from_file_parallel(lex, "nosuchfile.txt", 4) ? "true" : "false");
+    clex_delete(lex);
+    clex_delete(serial);
+
+    char* bad = "badwords.txt";
+    FILE* file = fopen(bad, "w");
+    fprintf(file, "apple\nbanana\n\ncherry\n");
+    fclose(file);
+    lex = clex_create();
+    printf("adding a file with an empty line? (expect false) : %s\n", clex_add_from_file_parallel(lex, bad, 2) ? "true" : "false");
+    printf("word count: %d (expect 0)\n", clex_wordcount(lex));
+    file = fopen(bad, "wb");
+    fwrite("apple\nban\0ana\n", 1, 14, file);
+    fclose(file);
+    printf("adding a file with a '\\0' in a word? (expect false) : %s\n", clex_add_from_file_parallel(lex, bad, 2) ? "true" : "false");
+    //Unsorted, with mixed case, carriage returns and no newline at the end.
+    file = fopen(bad, "wb");
+    fprintf(file, "Banana\r\napple\nbANANA\nCherry\r\nberry");
+    fclose(file);
+    printf("adding an unsorted file? (expect true) : %s\n", clex_add_from_file_parallel(lex, bad, 3) ? "true" : "false");
+    printf("word count: %d (expect 4)\n", clex_wordcount(lex));
+    printf("contains 'banana', 'cherry' and 'berry'? (expect true) : %s\n\n", clex_contains(lex, "banana") && clex_contains(lex, "cherry") && clex_contains(lex, "berry") ? "true" : "false");
+    clex_delete(lex);
+    remove(bad);
+
+    //The shards' slabs are taken over whole, so less than a slab of 65536 words is neither in nodes nor free.
+    lex = clex_create();
+    clex_add_from_file_parallel(lex, "dictionary.txt", 4);
+    CLexStats stats;
+    clex_stats(lex, &stats);
+    printf("parallel load memory accounted for? (expect true) : %s\n\n", stats.bytes_allocated - stats.bytes_in_nodes - stats.bytes_free < 65536 * sizeof(uint32_t) ? "true" : "false");
+    clex_delete(lex);
+
+    CLexicon* dst = clex_create();
+    CLexicon* src = clex_create();
+    const char* dst_words[] = { "apple", "apply", "banana", "counterrevolt" };
+    const char* src_words[] = { "apply", "cherry", "counterrevolution" };
+    for(size_t i = 0; i < 4; i++) clex_add(dst, (char*)dst_words[i]);
+    for(size_t i = 0; i < 3; i++) clex_add(src, (char*)src_words[i]);
+    clex_add_weighted(dst, "banana", 3);
+    clex_add_weighted(src, "Apricot", 7);
+    clex_freeze(src);
+    printf("words merged in (expect 3) : %d\n", clex_merge(dst, src));
+    printf("word count: %d (expect 7)\n", clex_wordcount(dst));
+    printf("words beginning with 'ap': %d (expect 3)\n", clex_count_prefix(dst, "ap"));
+    printf("contains 'counterrevolution'? (expect true) : %s\n", clex_contains(dst, "counterrevolution") ? "true" : "false");
+    printf("contains 'counterrevolt'? (expect true) : %s\n", clex_contains(dst, "counterrevolt") ? "true" : "false");
+    print_top_k(dst, "", 3, "apricot=7 banana=3 apple=0");
+    printf("is the source still frozen? (expect true) : %s\n", clex_isFrozen(src) ? "true" : "false");
+    printf("source word count: %d (expect 4)\n", clex_wordcount(src));
+    printf("words merged in again (expect 0) : %d\n", clex_merge(dst, src));
+    printf("words merged into itself (expect 0) : %d\n\n", clex_merge(dst, dst));
+    clex_delete(src);
+    clex_delete(dst);
+}
+
+void layout_test() {
+    printf("---------- Running Layout Test ----------\n");
+
+    AllocCounter counter = { 0, 0 };
+    CLexAllocator allocator = { counting_alloc, counting_free, &counter };
+    CLexicon* lex = clex_create_with_allocator(&allocator);
+    clex_add_from_file(lex, "dictionary.txt", true);
+    CLexicon* reference = clex_create();
+    clex_add_from_file(reference, "dictionary.txt", true);
+    int removed = clex_count_prefix(lex, "s");
+    clex_remove_prefix(lex, "s");
+    clex_remove_prefix(reference, "s");
+    clex_add_weighted(lex, "sun", 120);
+    clex_add_weighted(lex, "sea", 80);
+    clex_add_weighted(reference, "sun", 120);
+    clex_add_weighted(reference, "sea", 80);
+    size_t before = counter.live_bytes;
+
+    printf("optimizing the layout...\n");
+    clex_optimize_layout(lex);
+    printf("fewer bytes after optimizing? (expect true) : %s\n", counter.live_bytes < before ? "true" : "false");
+    printf("word count: %d (expect %d)\n", clex_wordcount(lex), 349900 - removed + 2);
+    printf("contains 'hello'? (expect true) : %s\n", clex_contains(lex, "hello") ? "true" : "false");
+    printf("contains 'singing'? (expect false) : %s\n", clex_contains(lex, "singing") ? "true" : "false");
+    printf("words beginning with 'incre': %d (expect %d)\n", clex_count_prefix(lex, "incre"), clex_count_prefix(reference, "incre"));
+    printf("same words as before? (expect true) : %s\n", same_words(lex, reference) ? "true" : "false");
+    print_top_k(lex, "s", 2, "sun=120 sea=80");
+    clex_add(lex, "flupsz");
+    printf("contains 'flupsz' added afterwards? (expect true) : %s\n", clex_contains(lex, "flupsz") ? "true" : "false");
+    clex_remove(lex, "flupsz");
+
+    clex_freeze(lex);
+    clex_optimize_layout(lex);
+    printf("still frozen? (expect true) : %s\n", clex_isFrozen(lex) ? "true" : "false");
+    printf("same words when frozen? (expect true) : %s\n", same_words(lex, reference) ? "true" : "false");
+    print_top_k(lex, "s", 2, "sun=120 sea=80");
+    clex_delete(reference);
+    clex_delete(lex);
+    printf("live blocks after deleting (expect 0): %d\n\n", counter.live_blocks);
+}
+
+void sorted_file_test() {
+    printf("---------- Running Sorted File Test ----------\n");
+
+    AllocCounter counter = { 0, 0 };
+    CLexAllocator allocator = { counting_alloc, counting_free, &counter };
+    CLexicon* lex = clex_create_with_allocator(&allocator);
+
+    printf("building frozen lexicon from sorted file...\n");
+    bool successful = clex_add_from_sorted_file(lex, "dictionary.txt");
+    printf("was file add successful? (expect true) %s\n", successful ? "true" : "false");
+    printf("is frozen? (expect true) : %s\n", clex_isFrozen(lex) ? "true" : "false");
+    printf("word count: %d (expect 349900)\n", clex_wordcount(lex));
+    printf("bytes: %zu\n\n", counter.live_bytes);
+
+    printf("contains 'hello'? (expect true) : %s\n", clex_contains(lex, "hello") ? "true" : "false");
+    printf("contains 'zzzzzzzz'? (expect true) : %s\n", clex_contains(lex, "zzzzzzzz") ? "true" : "false");
+    printf("contains 'notaword'? (expect false) : %s\n", clex_contains(lex, "notaword") ? "true" : "false");
+    printf("contains prefix 'incre'? (expect true) : %s\n", clex_contains_prefix(lex, "incre") ? "true" : "false");
+    printf("contains prefix 'flupsz'? (expect false) : %s\n\n", clex_contains_prefix(lex, "flupsz") ? "true" : "false");
+    clex_delete(lex);
+
+    char* unsorted = "unsorted.txt";
+    FILE* file = fopen(unsorted, "w");
+    fprintf(file, "apple\npear\nbanana\n");
+    fclose(file);
+    lex = clex_create();
+    printf("adding an unsorted file? (expect false) : %s\n", clex_add_from_sorted_file(lex, unsorted) ? "true" : "false");
+    printf("lexicon left empty? (expect true) : %s\n", clex_isEmpty(lex) ? "true" : "false");
+    clex_add(lex, "cherry");
+    printf("adding an unsorted file to a lexicon with words? (expect false) : %s\n", clex_add_from_sorted_file(lex, unsorted) ? "true" : "false");
+    printf("words: %d (expect 1)\n", clex_wordcount(lex));
+    printf("is frozen? (expect false) : %s\n", clex_isFrozen(lex) ? "true" : "false");
+    file = fopen(unsorted, "w");
+    fprintf(file, "apple\nbanana\npear\n");
+    fclose(file);
+    printf("adding a sorted file to a lexicon with words? (expect true) : %s\n", clex_add_from_sorted_file(lex, unsorted) ? "true" : "false");
+    printf("words: %d (expect 4)\n", clex_wordcount(lex));
+    printf("is frozen? (expect true) : %s\n", clex_isFrozen(lex) ? "true" : "false");
+    printf("contains 'cherry' and 'banana'? (expect true) : %s\n", clex_contains(lex, "cherry") && clex_contains(lex, "banana") ? "true" : "false");
+    clex_delete(lex);
+    remove(unsorted);
+    printf("\n");
+}
+
+//The words of up to four letters over "abc", for the random snapshot test.
+#define SNAP_WORDS 120
+static void snap_word(int i, char* word) {
+    int len = 1, first = 0, span = 3;
+    while(i >= first + span) {
+        first += span;
+        span *= 3;
+        len++;
+    }
+    for(int k = len - 1, n = i - first; k >= 0; k--, n /= 3) {
+        word[k] = "abc"[n % 3];
+    }
+    word[len] = '\0';
+}
+
+//Counts the words of SNAP_WORDS whose membership in lex differs from expect.
+static int snap_differences(CLexicon* lex, const bool* expect) {
+    int differences = 0, count = 0;
+    char word[8];
+    for(int i = 0; i < SNAP_WORDS; i++) {
+        snap_word(i, word);
+        if(clex_contains(lex, word) != expect[i]) differences++;
+        if(expect[i]) count++;
+    }
+    if(clex_wordcount(lex) != count) differences++;
+    return differences;
+}
+
+void snapshot_test() {
+    printf("---------- Running Snapshot Test ----------\n");
+
+    AllocCounter counter = { 0, 0 };
+    CLexAllocator allocator = { counting_alloc, counting_free, &counter };
+    CLexicon* lex = clex_create_with_allocator(&allocator);
+    const char* words[] = { "cat", "car", "cart", "dog" };
+    for(size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        clex_add(lex, (char*)words[i]);
+    }
+    CLexicon* snap = clex_snapshot(lex);
+    clex_add(lex, "cow");
+    clex_remove(lex, "car");
+    clex_remove_prefix(lex, "do");
+    printf("snapshot contains 'car' and 'dog'? (expect true) : %s\n", clex_contains(snap, "car") && clex_contains(snap, "dog") ? "true" : "false");
+    printf("snapshot contains 'cow'? (expect false) : %s\n", clex_contains(snap, "cow") ? "true" : "false");
+    printf("lexicon contains 'car' or 'dog'? (expect false) : %s\n", clex_contains(lex, "car") || clex_contains(lex, "dog") ? "true" : "false");
+    printf("words in snapshot: %d (expect 4)\n", clex_wordcount(snap));
+    printf("words in lexicon: %d (expect 3)\n", clex_wordcount(lex));
+    printf("snapshot of a snapshot? (expect NULL) : %s\n", clex_snapshot(snap) == NULL ? "NULL" : "not NULL");
+    bool removed[2];
+    const char* batch[] = { "cat", "dog" };
+    clex_remove_batch(snap, batch, 2, removed);
+    bool changed = clex_add(snap, "cow") || clex_add_weighted(snap, "cub", 3) || clex_remove(snap, "cat")
+                   || clex_remove_prefix(snap, "do") || clex_merge(snap, lex) != 0 || removed[0] || removed[1]
+                   || clex_add_from_file(snap, "dictionary.txt", true) || clex_add_from_file_parallel(snap, "dictionary.txt", 2)
+                   || clex_add_from_sorted_file(snap, "dictionary.txt");
+    clex_freeze(snap);
+    clex_optimize_layout(snap);
+    clex_clear(snap);
+    printf("snapshot changed? (expect false) : %s\n", changed || clex_isFrozen(snap) ? "true" : "false");
+    printf("words in snapshot after trying to change it: %d (expect 4)\n", clex_wordcount(snap));
+    printf("snapshot still contains 'cat'? (expect true) : %s\n", clex_contains(snap, "cat") ? "true" : "false");
+    clex_clear(lex);
+    printf("snapshot contains 'cart' after clearing? (expect true) : %s\n", clex_contains(snap, "cart") ? "true" : "false");
+    clex_delete(lex);
+    printf("snapshot contains prefix 'ca' after deleting the lexicon? (expect true) : %s\n", clex_contains_prefix(snap, "ca") ? "true" : "false");
+    clex_delete(snap);
+    printf("live blocks after deleting both (expect 0): %d\n\n", counter.live_blocks);
+
+    lex = clex_create_with_allocator(&allocator);
+    clex_add_from_file(lex, "dictionary.txt", true);
+    int count = clex_count_prefix(lex, "a");
+    snap = clex_snapshot(lex);
+    clex_remove_prefix(lex, "a");
+    clex_freeze(lex);
+    CLexicon* frozen = clex_snapshot(lex);
+    clex_add(lex, "aardvarkz");
+    bool ordered;
+    printf("words beginning with 'a' in snapshot: %d (expect %d)\n", clex_count_prefix(snap, "a"), count);
+    printf("words beginning with 'a' iterated in snapshot: %d (expect %d)\n", count_in_order(snap, "a", &ordered), count);
+    printf("words beginning with 'a' in frozen snapshot: %d (expect 0)\n", clex_count_prefix(frozen, "a"));
+    printf("frozen snapshot frozen? (expect true) : %s\n", clex_isFrozen(frozen) ? "true" : "false");
+    CLexStats stats;
+    clex_stats(frozen, &stats);
+    printf("frozen snapshot memory adds up? (expect true) : %s\n", stats.bytes_in_nodes > 0 && stats.bytes_in_nodes + stats.bytes_free <= stats.bytes_allocated ? "true" : "false");
+    printf("words beginning with 'a' in lexicon: %d (expect 1)\n", clex_count_prefix(lex, "a"));
+    clex_delete(snap);
+    clex_delete(frozen);
+    clex_delete(lex);
+    printf("live blocks after deleting all three (expect 0): %d\n\n", counter.live_blocks);
+
+    //Random changes with up to four snapshots alive, each checked against the words it was taken with.
+    lex = clex_create_with_allocator(&allocator);
+    CLexicon* snaps[4] = { NULL };
+    bool expect[5][SNAP_WORDS] = { { false } };
+    int differences = 0;
+    char word[8];
+    srand(5);
+    for(int step = 0; step < 4000; step++) {
+        int op = rand() % 100;
+        int i = rand() % SNAP_WORDS;
+        snap_word(i, word);
+        if(op < 40) {
+            clex_add(lex, word);
+            expect[4][i] = true;
+        } else if(op < 45) {
+            clex_add_weighted(lex, word, rand() % 100);
+            expect[4][i] = true;
+        } else if(op < 80) {
+            clex_remove(lex, word);
+            expect[4][i] = false;
+        } else if(op < 85) {
+            if(i >= 12) word[2] = '\0';
+            size_t len = strlen(word);
+            clex_remove_prefix(lex, word);
+            for(int j = 0; j < SNAP_WORDS; j++) {
+                char other[8];
+                snap_word(j, other);
+                if(strncmp(other, word, len) == 0) expect[4][j] = false;
+            }
+        } else if(op < 95) {
+            int s = rand() % 4;
+            if(snaps[s] != NULL) clex_delete(snaps[s]);
+            snaps[s] = rand() % 3 ? clex_snapshot(lex) : NULL;
+            memcpy(expect[s], expect[4], sizeof(expect[4]));
+        } else if(op < 97) {
+            clex_optimize_layout(lex);
+        } else if(op < 99) {
+            clex_freeze(lex);
+        } else {
+            clex_merge(lex, snaps[0] != NULL ? snaps[0] : lex);
+            if(snaps[0] != NULL) {
+                for(int j = 0; j < SNAP_WORDS; j++) expect[4][j] |= expect[0][j];
+            }
+        }
+        differences += snap_differences(lex, expect[4]);
+        for(int s = 0; s < 4; s++) {
+            if(snaps[s] != NULL) differences += snap_differences(snaps[s], expect[s]);
+        }
+    }
+    for(int s = 0; s < 4; s++) {
+        if(snaps[s] != NULL) clex_delete(snaps[s]);
+    }
+    printf("differences from the expected versions in random changes: %d (expect 0)\n", differences);
+    clex_delete(lex);
+    printf("live blocks after deleting everything (expect 0): %d\n\n", counter.live_blocks);
+
+    //Loading and merging copy the tree away from the snapshots while readers are looking up words.
+    lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+    clex_set_concurrent(lex, true);
+    char* extra = "qzwords.txt";
+    FILE* file = fopen(extra, "w");
+    fprintf(file, "qzab\nqzac\n");
+    fclose(file);
+    CLexicon* qz = clex_create();
+    clex_add(qz, "qzba");
+    bool stop = false;
+    pthread_t threads[4];
+    ReaderState states[4];
+    for(int t = 0; t < 4; t++) {
+        states[t] = (ReaderState){ lex, &stop, 0, 0 };
+        pthread_create(&threads[t], NULL, concurrent_reader, &states[t]);
+    }
+    CLexicon* older = NULL;
+    bool kept = true;
+    for(int round = 0; round < 12; round++) {
+        snap = clex_snapshot(lex);
+        if(round % 2 == 0) clex_add_from_file(lex, extra, true);
+        else clex_merge(lex, qz);
+        clex_remove_prefix(lex, "qz");
+        kept &= clex_contains(snap, "hello") && clex_wordcount(snap) == 349900;
+        if(older != NULL) clex_delete(older);
+        older = snap;
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    long wrong = 0;
+    for(int t = 0; t < 4; t++) {
+        pthread_join(threads[t], NULL);
+        wrong += states[t].wrong;
+    }
+    printf("were all reader answers right during loads and merges? (expect true) : %s\n", wrong == 0 ? "true" : "false");
+    printf("did the snapshots keep their words? (expect true) : %s\n", kept ? "true" : "false");
+    printf("word count: %d (expect 349900)\n\n", clex_wordcount(lex));
+    clex_delete(older);
+    clex_delete(qz);
+    clex_delete(lex);
+    remove(extra);
+}
+
+//Collects the words of lex in order, separated by spaces, into out.
+static void join_words(CLexicon* lex, char* out) {
+    CLexIterator iter;
+    char word[CLEX_MAX_WORD_LEN + 1];
+    out[0] = '\0';
+    clex_iter_prefix(lex, &iter, "");
+    while(clex_iter_next(&iter, word)) {
+        strcat(out, word);
+        strcat(out, " ");
+    }
+}
+
+void set_test() {
+    printf("---------- Running Set Operations Test ----------\n");
+
+    CLexicon* a = clex_create();
+    CLexicon* b = clex_create();
+    const char* a_words[] = { "cat", "car", "cart", "dog" };
+    const char* b_words[] = { "car", "cow", "dog", "doge" };
+    for(int i = 0; i < 4; i++) {
+        clex_add(a, (char*)a_words[i]);
+        clex_add(b, (char*)b_words[i]);
+    }
+    clex_add_weighted(a, "cat", 7);
+    clex_add_weighted(b, "cow", 3);
+    char words[256];
+    CLexicon* out = clex_union(a, b, 1);
+    join_words(out, words);
+    printf("union (expect car cart cat cow dog doge ) : %s\n", words);
+    printf("words in union: %d (expect 6)\n", clex_wordcount(out));
+    CLexCompletion top[2];
+    size_t found = clex_top_k(out, "c", 2, top);
+    printf("top 2 for 'c' (expect cat=7 cow=3) : %s=%u %s=%u\n", found > 0 ? top[0].word : "", found > 0 ? top[0].weight : 0, found > 1 ? top[1].word : "", found > 1 ? top[1].weight : 0);
+    clex_delete(out);
+    out = clex_intersect(a, b, 1);
+    join_words(out, words);
+    printf("intersection (expect car dog ) : %s\n", words);
+    printf("words beginning with 'do' in intersection: %d (expect 1)\n", clex_count_prefix(out, "do"));
+    clex_delete(out);
+    out = clex_difference(a, b, 1);
+    join_words(out, words);
+    printf("difference (expect cart cat ) : %s\n", words);
+    printf("contains prefix 'd' in difference? (expect false) : %s\n\n", clex_contains_prefix(out, "d") ? "true" : "false");
+    clex_delete(out);
+    clex_delete(a);
+    clex_delete(b);
+
+    a = clex_create();
+    clex_add_from_file(a, "dictionary.txt", true);
+    int total = clex_wordcount(a);
+    b = clex_create();
+    CLexIterator iter;
+    char word[CLEX_MAX_WORD_LEN + 1];
+    clex_iter_prefix(a, &iter, "un");
+    while(clex_iter_next(&iter, word)) {
+        clex_add(b, word);
+    }
+    int un = clex_wordcount(b);
+    clex_add(b, "zzzzq");
+    clex_freeze(a);
+    out = clex_difference(a, b, 4);
+    printf("words in the dictionary but not in its 'un' words: %d (expect %d)\n", clex_wordcount(out), total - un);
+    printf("words beginning with 'un' in the difference: %d (expect 0)\n", clex_count_prefix(out, "un"));
+    printf("words beginning with 'a' in the difference: %d (expect %d)\n", clex_count_prefix(out, "a"), clex_count_prefix(a, "a"));
+    clex_delete(out);
+    out = clex_intersect(a, b, 4);
+    printf("words in both: %d (expect %d)\n", clex_wordcount(out), un);
+    clex_delete(out);
+    out = clex_union(b, a, 4);
+    printf("words in either: %d (expect %d)\n", clex_wordcount(out), total + 1);
+    printf("contains 'zzzzq' and 'zaachila'? (expect true) : %s\n", clex_contains(out, "zzzzq") && clex_contains(out, "zaachila") ? "true" : "false");
+    //The shards' roots and the ends of their slabs are free space of the union, so less than a slab of 65536 words is neither.
+    CLexStats stats;
+    clex_stats(out, &stats);
+    printf("union memory accounted for? (expect true) : %s\n", stats.bytes_allocated - stats.bytes_in_nodes - stats.bytes_free < 65536 * sizeof(uint32_t) ? "true" : "false");
+    clex_add(out, "zzzzqa");
+    clex_add(out, "aaaaq");
+    printf("words in either after adding two: %d (expect %d)\n\n", clex_wordcount(out), total + 3);
+    clex_delete(out);
+    clex_delete(a);
+    clex_delete(b);
+
+    //Random sets, sometimes frozen, through one to four threads.
+    int differences = 0;
+    srand(6);
+    for(int trial = 0; trial < 200; trial++) {
+        bool in_a[SNAP_WORDS], in_b[SNAP_WORDS], expect[SNAP_WORDS];
+        a = clex_create();
+        b = clex_create();
+        for(int i = 0; i < SNAP_WORDS; i++) {
+            snap_word(i, word);
+            in_a[i] = rand() % 3 == 0;
+            in_b[i] = rand() % 3 == 0;
+            if(in_a[i]) clex_add(a, word);
+            if(in_b[i]) clex_add(b, word);
+        }
+        if(rand() % 2) clex_freeze(a);
+        if(rand() % 2) clex_freeze(b);
+        int nthreads = 1 + rand() % 4;
+        for(int op = 0; op < 3; op++) {
+            for(int i = 0; i < SNAP_WORDS; i++) {
+                expect[i] = op == 0 ? in_a[i] || in_b[i] : op == 1 ? in_a[i] && in_b[i] : in_a[i] && !in_b[i];
+            }
+            out = op == 0 ? clex_union(a, b, nthreads) : op == 1 ? clex_intersect(a, b, nthreads) : clex_difference(a, b, nthreads);
+            differences += snap_differences(out, expect);
+            clex_delete(out);
+        }
+        clex_delete(a);
+        clex_delete(b);
+    }
+    printf("differences from the expected sets with random lexicons: %d (expect 0)\n\n", differences);
+}
+
+//Counts the words of dictionary.txt that end in infix, or that contain it if anywhere is true.
+static int count_containing(const char* infix, bool anywhere) {
+    FILE* file = fopen("dictionary.txt", "r");
+    char line[64];
+    int count = 0;
+    size_t len = strlen(infix);
+    while(fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        size_t n = strlen(line);
+        if(anywhere ? strstr(line, infix) != NULL : n >= len && strcmp(line + n - len, infix) == 0) count++;
+    }
+    fclose(file);
+    return count;
+}
+
+//Counts the words of SNAP_WORDS ending in suffix whose membership in lex differs from expect,
+//as seen by both suffix functions.
+static int suffix_differences(CLexicon* lex, const bool* expect, const char* suffix) {
+    int count = 0;
+    char word[8];
+    size_t len = strlen(suffix);
+    for(int i = 0; i < SNAP_WORDS; i++) {
+        snap_word(i, word);
+        size_t n = strlen(word);
+        if(expect[i] && n >= len && strcmp(word + n - len, suffix) == 0) count++;
+    }
+    MatchState state = { 0, true, "" };
+    clex_visit_suffix(lex, suffix, count_match, &state);
+    return abs(state.found - count) + (clex_contains_suffix(lex, suffix) != (count > 0));
+}
+
+void suffix_test() {
+    printf("---------- Running Suffix Test ----------\n");
+
+    AllocCounter counter = { 0, 0 };
+    CLexAllocator allocator = { counting_alloc, counting_free, &counter };
+    CLexicon* lex = clex_create_with_allocator(&allocator);
+    const char* words[] = { "heat", "boat", "Boast", "at" };
+    for(size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        clex_add(lex, (char*)words[i]);
+    }
+    printf("contains suffix 'AT'? (expect true) : %s\n", clex_contains_suffix(lex, "AT") ? "true" : "false");
+    printf("contains suffix 'oat'? (expect true) : %s\n", clex_contains_suffix(lex, "oat") ? "true" : "false");
+    printf("contains suffix 'hat'? (expect false) : %s\n", clex_contains_suffix(lex, "hat") ? "true" : "false");
+    printf("words ending in 'at' without an index (expect at boat heat) :");
+    clex_visit_suffix(lex, "at", print_word, NULL);
+    printf("\n");
+    clex_set_suffix_index(lex, true);
+    printf("words ending in 'at' with an index (expect at heat boat) :");
+    clex_visit_suffix(lex, "at", print_word, NULL);
+    printf("\n");
+    printf("contains suffix 'ST'? (expect true) : %s\n", clex_contains_suffix(lex, "ST") ? "true" : "false");
+    clex_add(lex, "chat");
+    clex_remove(lex, "heat");
+    printf("words ending in 'at' after adding 'chat' and removing 'heat' (expect at chat boat) :");
+    clex_visit_suffix(lex, "at", print_word, NULL);
+    printf("\n");
+    CLexicon* snap = clex_snapshot(lex);
+    clex_remove_prefix(lex, "bo");
+    printf("contains suffix 'oat' after removing prefix 'bo'? (expect false) : %s\n", clex_contains_suffix(lex, "oat") ? "true" : "false");
+    printf("snapshot contains suffix 'oat'? (expect true) : %s\n", clex_contains_suffix(snap, "oat") ? "true" : "false");
+    clex_delete(snap);
+    clex_clear(lex);
+    printf("contains suffix '' after clearing? (expect false) : %s\n\n", clex_contains_suffix(lex, "") ? "true" : "false");
+
+    clex_add_from_file(lex, "dictionary.txt", true);
+    MatchState state = { 0, true, "" };
+    clex_visit_suffix(lex, "ology", count_match, &state);
+    printf("words ending in 'ology' with an index: %d (expect %d)\n", state.found, count_containing("ology", false));
+    printf("contains suffix 'zzzzq'? (expect false) : %s\n", clex_contains_suffix(lex, "zzzzq") ? "true" : "false");
+    clex_add(lex, "zzzzq");
+    clex_freeze(lex);
+    printf("contains suffix 'zzzzq' after adding it and freezing? (expect true) : %s\n", clex_contains_suffix(lex, "zzzzq") ? "true" : "false");
+    clex_set_suffix_index(lex, false);
+    state = (MatchState){ 0, true, "" };
+    clex_visit_suffix(lex, "ness", count_match, &state);
+    printf("words ending in 'ness' without an index: %d (expect %d)\n", state.found, count_containing("ness", false));
+    printf("in alphabetical order? (expect true) : %s\n\n", state.in_order ? "true" : "false");
+
+    CLexInfix* index = clex_infix_create(lex);
+    state = (MatchState){ 0, true, "" };
+    clex_infix_visit(index, "olog", count_match, &state);
+    printf("words containing 'olog': %d (expect %d)\n", state.found, count_containing("olog", true));
+    printf("in alphabetical order? (expect true) : %s\n", state.in_order ? "true" : "false");
+    state = (MatchState){ 0, true, "" };
+    clex_infix_visit(index, "SS", count_match, &state);
+    printf("words containing 'SS': %d (expect %d)\n", state.found, count_containing("ss", true));
+    state = (MatchState){ 0, true, "" };
+    clex_infix_visit(index, "", count_match, &state);
+    printf("words containing '': %d (expect %d)\n", state.found, clex_wordcount(lex));
+    clex_delete(lex);
+    state = (MatchState){ 0, true, "" };
+    clex_infix_visit(index, "zzzzq", count_match, &state);
+    printf("words containing 'zzzzq' after deleting the lexicon: %d (expect 1)\n", state.found);
+    clex_infix_delete(index);
+    printf("live blocks after deleting everything (expect 0): %d\n\n", counter.live_blocks);
+
+    //Random changes with the index on, checked against the words expected.
+    const char* suffixes[] = { "", "a", "b", "ca", "abc", "cbca" };
+    bool expect[SNAP_WORDS] = { false };
+    char word[8];
+    int differences = 0;
+    lex = clex_create();
+    clex_set_suffix_index(lex, true);
+    srand(7);
+    for(int i = 0; i < 3000; i++) {
+        int op = rand() % 100, j = rand() % SNAP_WORDS;
+        snap_word(j, word);
+        if(op < 55) {
+            clex_add(lex, word);
+            expect[j] = true;
+        } else if(op < 90) {
+            clex_remove(lex, word);
+            expect[j] = false;
+        } else if(op < 94) {
+            size_t len = strlen(word) / 2;
+            word[len] = '\0';
+            clex_remove_prefix(lex, word);
+            for(int k = 0; k < SNAP_WORDS; k++) {
+                char other[8];
+                snap_word(k, other);
+                if(strncmp(other, word, len) == 0) expect[k] = false;
+            }
+        } else if(op < 97) {
+            clex_freeze(lex);
+        } else if(op < 99) {
+            clex_optimize_layout(lex);
+        } else {
+            clex_set_suffix_index(lex, false);
+            clex_set_suffix_index(lex, true);
+        }
+        differences += snap_differences(lex, expect);
+        for(size_t s = 0; s < sizeof(suffixes) / sizeof(suffixes[0]); s++) {
+            differences += suffix_differences(lex, expect, suffixes[s]);
+        }
+    }
+    printf("differences from the expected suffixes in random changes: %d (expect 0)\n\n", differences);
+    clex_delete(lex);
+}
+
+//Rewrites the image of a file written by clex_save_binary with word at set to value, then opens
+//it and, if that works, walks it. Returns true if the file was turned down.
+static bool open_mangled(const uint32_t* file, size_t nwords, size_t at, uint32_t value) {
+    FILE* out = fopen("mangled.clex", "wb");
+    for(size_t i = 0; i < nwords; i++) {
+        uint32_t word = i == at ? value : file[i];
+        fwrite(&word, sizeof(word), 1, out);
+    }
+    fclose(out);
+    CLexicon* lex = clex_open_mapped("mangled.clex");
+    if(lex == NULL) return true;
+    MatchState state = { 0, true, "" };
+    clex_visit_prefix(lex, "", count_match, &state);
+    clex_remove(lex, "cat");
+    clex_delete(lex);
+    return false;
+}
+
+void binary_test() {
+    printf("---------- Running Binary File Test ----------\n");
+
+    char* filename = "dictionary.clex";
+    CLexicon* lex = clex_create();
+    clex_add_from_file(lex, "dictionary.txt", true);
+
+    printf("saving lexicon to %s...\n", filename);
+    bool saved = clex_save_binary(lex, filename);
+    printf("was save successful? (expect true) : %s\n", saved ? "true" : "false");
+    printf("is original frozen? (expect false) : %s\n", clex_isFrozen(lex) ? "true" : "false");
+    clex_delete(lex);
+
+    printf("mapping %s...\n", filename);
+    CLexicon* mapped = clex_open_mapped(filename);
+    printf("was open successful? (expect true) : %s\n", mapped != NULL ? "true" : "false");
+    printf("is mapped lexicon frozen? (expect true) : %s\n", clex_isFrozen(mapped) ? "true" : "false");
+    printf("word count: %d (expect 349900)\n\n", clex_wordcount(mapped));
+
+    printf("contains 'hello'? (expect true) : %s\n", clex_contains(mapped, "hello") ? "true" : "false");
+    printf("contains 'notaword'? (expect false) : %s\n", clex_contains(mapped, "notaword") ? "true" : "false");
+    printf("contains prefix 'sub'? (expect true) : %s\n", clex_contains_prefix(mapped, "sub") ? "true" : "false");
+    printf("contains prefix 'flupsz'? (expect false) : %s\n\n", clex_contains_prefix(mapped, "flupsz") ? "true" : "false");
+    CLexStats stats;
+    clex_stats(mapped, &stats);
+    printf("mapped words and free bytes (expect 349900 0) : %d %d\n\n", (int)stats.words, (int)stats.bytes_free);
+
+    printf("removing 'hello' copies the lexicon out of the file\n");
+    clex_remove(mapped, "hello");
+    printf("contains 'hello'? (expect false) : %s\n", clex_contains(mapped, "hello") ? "true" : "false");
+    printf("contains 'apple'? (expect true) : %s\n", clex_contains(mapped, "apple") ? "true" : "false");
+    clex_delete(mapped);
+
+    printf("opening a file that is not a lexicon? (expect false) : %s\n",
+           clex_open_mapped("dictionary.txt") != NULL ? "true" : "false");
+    remove(filename);
+
+    //The header (six words) is followed by the image; a root with two letters has them right after its own two words.
+    lex = clex_create();
+    clex_add(lex, "cat");
+    clex_add(lex, "dog");
+    clex_save_binary(lex, filename);
+    clex_delete(lex);
+    uint32_t file[64];
+    FILE* in = fopen(filename, "rb");
+    size_t nwords = fread(file, sizeof(uint32_t), 64, in);
+    fclose(in);
+    uint32_t root = 6 + file[4];
+    printf("opening the unchanged file? (expect true) : %s\n", !open_mangled(file, nwords, 0, file[0]) ? "true" : "false");
+    file[root + 3] = 0x7fffff00;
+    printf("opening a file whose child indices are out of range? (expect false) : %s\n", !open_mangled(file, nwords, root + 2, 0x7fffff00) ? "true" : "false");
+    file[root + 3] = file[4];
+    printf("opening a file whose root is its own child? (expect false) : %s\n", !open_mangled(file, nwords, root + 2, file[4]) ? "true" : "false");
+    in = fopen(filename, "rb");
+    nwords = fread(file, sizeof(uint32_t), 64, in);
+    fclose(in);
+    const uint32_t values[] = { 0, 1, 2, file[4], 0x7fffff00, 0xffffffffu, 0x03ffffffu, 0xe0000000u };
+    int turned_down = 0;
+    for(size_t at = 6; at < nwords; at++) {
+        for(size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+            if(open_mangled(file, nwords, at, values[v])) turned_down++;
+        }
+    }
+    printf("mangled files opened or turned down without crashing (expect true) : %s\n", turned_down > 0 ? "true" : "false");
+    remove("mangled.clex");
+    remove(filename);
+    printf("\n");
+}
+
 int main(int argc, char *argv[]) {
     simple_test();
     prefix_test();
     file_reading_test();
+    allocator_test();
+    freeze_test();
+    sorted_file_test();
+    merge_test();
+    layout_test();
+    batch_test();
+    parallel_test();
+    slice_test();
+    remove_test();
+    count_test();
+    stats_test();
+    iter_test();
+    weighted_test();
+    fuzzy_test();
+    pattern_test();
+    scan_test();
+    byte_test();
+    chain_test();
+    jump_test();
+    concurrent_test();
+    snapshot_test();
+    set_test();
+    suffix_test();
+    binary_test();
     return 0;
 }
@@ -0,0 +1,153 @@
+/* File: lextest_cpp.cpp
+ * ---------------------
+ * Simple client program for testing the C++ Lexicon and its alphabets.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include "Lexicon.hpp"
+
+using namespace clex;
+
+static const char* tf(bool b) { return b ? "true" : "false"; }
+
+void lowercase_test() {
+    printf("---------- Running Lowercase Test ----------\n");
+
+    Lexicon<Lowercase> lex;
+    printf("dense nodes? (expect false) : %s\n", tf(Lexicon<Lowercase>::dense));
+    printf("bytes per node: %d (expect 16)\n", (int)Lexicon<Lowercase>::node_size);
+    lex.add("hello");
+    lex.add("Apple");
+    lex.add("pear");
+
+    printf("contains 'hello'? (expect true) : %s\n", tf(lex.contains("hello")));
+    printf("contains 'APPLE'? (expect true) : %s\n", tf(lex.contains("APPLE")));
+    printf("contains 'hel'? (expect false) : %s\n", tf(lex.contains("hel")));
+    printf("contains 'hello!'? (expect false) : %s\n", tf(lex.contains("hello!")));
+    printf("contains prefix 'HE'? (expect true) : %s\n", tf(lex.contains_prefix("HE")));
+    printf("add 'pear' again? (expect false) : %s\n", tf(lex.add("pear")));
+    printf("add 'pear2'? (expect false) : %s\n", tf(lex.add("pear2")));
+    printf("words: %d (expect 3)\n", (int)lex.size());
+
+    std::string all;
+    lex.visit_prefix("", [&](std::string_view word) { all += std::string(word) + " "; return true; });
+    printf("words in order (expect apple hello pear ) : %s\n", all.c_str());
+
+    printf("remove 'hello'? (expect true) : %s\n", tf(lex.remove("hello")));
+    printf("remove 'hello' again? (expect false) : %s\n", tf(lex.remove("hello")));
+    printf("contains prefix 'h'? (expect false) : %s\n", tf(lex.contains_prefix("h")));
+    printf("words: %d (expect 2)\n\n", (int)lex.size());
+}
+
+void dna_test() {
+    printf("---------- Running DNA Test ----------\n");
+
+    Lexicon<Dna> lex;
+    printf("dense nodes? (expect true) : %s\n", tf(Lexicon<Dna>::dense));
+    printf("bytes per node: %d (expect 28)\n", (int)Lexicon<Dna>::node_size);
+
+    lex.add("GATTACA");
+    lex.add("gatt");
+    lex.add("CAT");
+    printf("contains 'gattaca'? (expect true) : %s\n", tf(lex.contains("gattaca")));
+    printf("contains 'GATTACU'? (expect false) : %s\n", tf(lex.contains("GATTACU")));
+    printf("add 'GATU'? (expect false) : %s\n", tf(lex.add("GATU")));
+    printf("words beginning with 'GA': %d (expect 2)\n", (int)lex.count_prefix("GA"));
+
+    std::string all;
+    lex.visit_prefix("ga", [&](std::string_view word) { all += std::string(word) + " "; return true; });
+    printf("words beginning with 'ga' (expect GATT GATTACA ) : %s\n", all.c_str());
+
+    int seen = 0;
+    lex.visit_prefix("", [&](std::string_view) { return ++seen < 2; });
+    printf("words visited before stopping: %d (expect 2)\n", seen);
+
+    printf("remove 'GATT'? (expect true) : %s\n", tf(lex.remove("GATT")));
+    printf("contains 'GATTACA'? (expect true) : %s\n", tf(lex.contains("GATTACA")));
+    printf("contains 'GATT'? (expect false) : %s\n\n", tf(lex.contains("GATT")));
+}
+
+void hex_test() {
+    printf("---------- Running Hex Test ----------\n");
+
+    Lexicon<Hex> lex;
+    lex.add("DEADBEEF");
+    lex.add("deadbe");
+    lex.add("0123");
+    printf("contains 'deadbeef'? (expect true) : %s\n", tf(lex.contains("deadbeef")));
+    printf("contains 'DEADBE'? (expect true) : %s\n", tf(lex.contains("DEADBE")));
+    printf("add 'deadbeeg'? (expect false) : %s\n", tf(lex.add("deadbeeg")));
+
+    std::string all;
+    lex.visit_prefix("", [&](std::string_view word) { all += std::string(word) + " "; return true; });
+    printf("words in order (expect 0123 deadbe deadbeef ) : %s\n\n", all.c_str());
+}
+
+void ascii_test() {
+    printf("---------- Running ASCII Test ----------\n");
+
+    Lexicon<Ascii> lex;
+    printf("dense nodes? (expect false) : %s\n", tf(Lexicon<Ascii>::dense));
+    lex.add("Hello, World!");
+    lex.add("hello");
+    lex.add("");
+    printf("contains 'Hello, World!'? (expect true) : %s\n", tf(lex.contains("Hello, World!")));
+    printf("contains 'Hello'? (expect false) : %s\n", tf(lex.contains("Hello")));
+    printf("contains ''? (expect true) : %s\n", tf(lex.contains("")));
+    printf("add 'caf\\xc3\\xa9'? (expect false) : %s\n", tf(lex.add("caf\xc3\xa9")));
+    printf("words: %d (expect 3)\n", (int)lex.size());
+    lex.clear();
+    printf("empty after clear? (expect true) : %s\n", tf(lex.empty()));
+    printf("contains prefix ''? (expect false) : %s\n\n", tf(lex.contains_prefix("")));
+}
+
+//Checks a lexicon against a std::set through random adds and removes.
+template <class Alphabet>
+int random_differences(const char* symbols, int nsymbols, unsigned seed) {
+    Lexicon<Alphabet> lex;
+    std::set<std::string> expect;
+    int differences = 0;
+    srand(seed);
+    for(int i = 0; i < 20000; i++) {
+        std::string word;
+        for(int len = rand() % 7; len > 0; len--) word += symbols[rand() % nsymbols];
+        if(rand() % 3) {
+            if(lex.add(word) != expect.insert(word).second) differences++;
+        } else {
+            if(lex.remove(word) != (expect.erase(word) == 1)) differences++;
+        }
+    }
+    if(lex.size() != expect.size()) differences++;
+    for(const std::string& word : expect) {
+        if(!lex.contains(word)) differences++;
+    }
+    auto at = expect.begin();
+    lex.visit_prefix("", [&](std::string_view word) {
+        if(at == expect.end() || word != *at) differences++;
+        else at++;
+        return true;
+    });
+    return differences;
+}
+
+void random_test() {
+    printf("---------- Running Random Test ----------\n");
+
+    printf("lowercase differences from std::set: %d (expect 0)\n",
+           random_differences<Lowercase>("abcdefghij", 10, 1));
+    printf("DNA differences from std::set: %d (expect 0)\n", random_differences<Dna>("ACGT", 4, 2));
+    printf("ASCII differences from std::set: %d (expect 0)\n\n",
+           random_differences<Ascii>(" !09AZaz~", 9, 3));
+}
+
+int main() {
+    lowercase_test();
+    dna_test();
+    hex_test();
+    ascii_test();
+    random_test();
+    return 0;
+}